@@ -39,7 +39,10 @@ void test()
     e.emit("hello", Value("world"));
 
     std::string s = "97:0{\"sid\":\"TtSjLPMbakR18eXMAAAE\",\"upgrades\":[\"websocket\"],\"pingInterval\":25000,\"pingTimeout\":60000}";
-    engineio::parser::decodePayload(s);
+    engineio::parser::decodePayload(Value(s), [](const EngineIOPacket& packet, size_t, size_t) {
+        printf("decoded packet: %s %s\n", packet.type.c_str(), packet.data.toString().c_str());
+        return true;
+    });
 }
 
 @implementation ViewController
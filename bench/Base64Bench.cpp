@@ -0,0 +1,66 @@
+#include "Bench.h"
+
+#include "IOBase64.h"
+#include "IOSimd.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * base64 throughput from 1 KB to 16 MB, in bytes of binary data per
+ * nanosecond for both directions. Every size runs over about 64 MB so the
+ * small ones aren't dominated by the clock.
+ */
+
+static const size_t TOTAL_BYTES = 64 << 20;
+
+static const char* kernel()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return "avx2";
+    if (simd::hasSSSE3())
+        return "ssse3";
+#endif
+    return "scalar";
+}
+
+int main()
+{
+    printf("base64, %s kernel\n", kernel());
+
+    std::vector<uint8_t> data(16 << 20);
+    uint32_t seed = 1;
+    for (uint8_t& byte : data) {
+        seed = seed * 1103515245 + 12345;
+        byte = (uint8_t)(seed >> 16);
+    }
+
+    std::string text;
+    Buffer decoded;
+    for (size_t size = 1 << 10; size <= data.size(); size <<= 2) {
+        size_t iterations = TOTAL_BYTES / size;
+        char name[64];
+
+        text.resize(base64::encodedLength(size));
+        snprintf(name, sizeof(name), "encode %zu KB", size >> 10);
+        bench::report(name, bench::measure(iterations, [&]() {
+            base64::encode(data.data(), size, &text[0]);
+            bench::keep(text);
+        }), size);
+
+        snprintf(name, sizeof(name), "decode %zu KB", size >> 10);
+        bench::report(name, bench::measure(iterations, [&]() {
+            base64::decode(text.data(), text.size(), decoded);
+            bench::keep(decoded);
+        }), size);
+
+        if (decoded.length() != size || memcmp(decoded.data(), data.data(), size) != 0) {
+            printf("  %zu bytes don't read back\n", size);
+            return 1;
+        }
+    }
+
+    return 0;
+}
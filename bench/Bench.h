@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+/**
+ * Helpers for the benchmarks. Every benchmark is a single translation
+ * unit including this header once, which also replaces the global
+ * allocator with one counting the allocations.
+ */
+
+static size_t __allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++__allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace bench {
+
+/**
+ * Allocations made by the program so far.
+ */
+
+inline size_t allocations()
+{
+    return __allocations;
+}
+
+/**
+ * Keeps the optimizer from dropping the computation of `value`.
+ */
+
+template<class T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Result of one measured loop.
+ */
+
+struct Sample
+{
+    double nanoseconds;
+    double allocations;
+};
+
+/**
+ * Calls `fn` `iterations` times after a short warm up.
+ *
+ * @return time and allocations per call
+ */
+
+template<class F>
+Sample measure(size_t iterations, F fn)
+{
+    for (size_t i = 0; i < iterations / 10 + 1; ++i)
+        fn();
+
+    size_t allocated = __allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+
+    Sample sample;
+    sample.nanoseconds = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    sample.allocations = (double)(__allocations - allocated) / iterations;
+    return sample;
+}
+
+inline void report(const char* name, const Sample& sample)
+{
+    printf("  %-40s %10.1f ns %8.2f allocs\n", name, sample.nanoseconds, sample.allocations);
+}
+
+/**
+ * Throughput of `bytes` processed per call.
+ */
+
+inline void report(const char* name, const Sample& sample, size_t bytes)
+{
+    printf("  %-40s %10.1f ns %8.2f GB/s\n", name, sample.nanoseconds, bytes / sample.nanoseconds);
+}
+
+} // namespace bench {
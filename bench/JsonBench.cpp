@@ -0,0 +1,101 @@
+#include "Bench.h"
+
+#include "IOJson.h"
+#include "IOSimd.h"
+
+#include <string>
+
+/**
+ * Parse time of the JSON socket.io puts on the wire, from the open
+ * packet's handshake to a large event payload. The classify kernel is
+ * picked once from the CPU, so run it on machines with and without AVX2
+ * to compare kernels.
+ */
+
+static const size_t ITERATIONS = 200000;
+
+static const char* kernel()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return "avx2";
+    if (simd::hasSSE2())
+        return "sse2";
+#endif
+    return "scalar";
+}
+
+/**
+ * A list of `count` user records, the kind of payload rooms and presence
+ * events carry.
+ */
+
+static std::string users(int count)
+{
+    std::string out = "[\"users\",[";
+    for (int i = 0; i < count; ++i) {
+        if (i)
+            out += ',';
+        out += "{\"id\":" + std::to_string(1000 + i)
+            + ",\"name\":\"user " + std::to_string(i) + "\""
+            + ",\"status\":\"online\",\"lastSeen\":1712345678.5"
+            + ",\"tags\":[\"admin\",\"beta\"],\"avatar\":null,\"verified\":true}";
+    }
+    out += "]]";
+    return out;
+}
+
+int main()
+{
+    struct Payload
+    {
+        const char* name;
+        std::string text;
+    };
+
+    Payload payloads[] = {
+        { "handshake",
+          "{\"sid\":\"lv_VI97HAXpY6yYWAAAC\",\"upgrades\":[\"websocket\"],"
+          "\"pingInterval\":25000,\"pingTimeout\":20000,\"maxPayload\":1000000}" },
+        { "chat event",
+          "[\"chat message\",{\"room\":\"general\",\"from\":\"alice\","
+          "\"text\":\"hey, did you see the \\\"release\\\" notes?\\nlooks good\","
+          "\"sent\":1712345678}]" },
+        { "ack",
+          "[{\"ok\":true,\"id\":42}]" },
+        { "binary placeholders",
+          "[\"upload\",{\"name\":\"photo.jpg\",\"size\":48213,"
+          "\"chunks\":[{\"_placeholder\":true,\"num\":0},{\"_placeholder\":true,\"num\":1}]}]" },
+        { "100 user records", users(100) },
+    };
+
+    printf("json::Parser, %s kernel\n", kernel());
+
+    json::Parser parser;
+    for (const Payload& payload : payloads) {
+        Value value;
+        if (!parser.parse(payload.text.data(), payload.text.size(), value)) {
+            printf("  %s doesn't parse\n", payload.name);
+            return 1;
+        }
+
+        size_t iterations = payload.text.size() > 4096 ? ITERATIONS / 50 : ITERATIONS;
+        std::string name = std::string(payload.name) + " (" + std::to_string(payload.text.size()) + " B)";
+        bench::Sample sample = bench::measure(iterations, [&]() {
+            Value out;
+            parser.parse(payload.text.data(), payload.text.size(), out);
+            bench::keep(out);
+        });
+        printf("  %-40s %10.1f ns %8.1f MB/s %6.2f allocs\n", name.c_str(), sample.nanoseconds,
+               payload.text.size() * 1000.0 / sample.nanoseconds, sample.allocations);
+    }
+
+    const std::string& chat = payloads[1].text;
+    bench::report("chat event, new parser per call", bench::measure(ITERATIONS, [&]() {
+        Value out;
+        json::parse(chat, out);
+        bench::keep(out);
+    }));
+
+    return 0;
+}
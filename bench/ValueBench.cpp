@@ -0,0 +1,53 @@
+#include "Bench.h"
+
+#include "Emitter.h"
+#include "IOTypes.h"
+
+/**
+ * Allocations and time per event for the Values a chat-style emit
+ * builds: a short event name, a short message, a number and a small
+ * binary attachment.
+ */
+
+static const size_t ITERATIONS = 1000000;
+
+int main()
+{
+    const uint8_t bytes[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    printf("Value, small payloads\n");
+
+    bench::report("short string", bench::measure(ITERATIONS, [&]() {
+        Value name("ack");
+        bench::keep(name);
+    }));
+
+    Value attachment(Buffer(bytes, sizeof(bytes)));
+    bench::report("copy of an 8 byte binary", bench::measure(ITERATIONS, [&]() {
+        Value copy(attachment);
+        bench::keep(copy);
+    }));
+
+    bench::report("event arguments", bench::measure(ITERATIONS, [&]() {
+        ValueArray args;
+        args.reserve(4);
+        args.push_back(Value("chat"));
+        args.push_back(Value("hello"));
+        args.push_back(Value(42));
+        args.push_back(Value(Buffer(bytes, sizeof(bytes))));
+        Value event(args);
+        bench::keep(event);
+    }));
+
+    Emitter emitter;
+    size_t received = 0;
+    emitter.on("chat", [&](const Value& args) {
+        received += args.asArray().size();
+    });
+    bench::report("emit with one listener", bench::measure(ITERATIONS, [&]() {
+        emitter.emit("chat", Value("hello"));
+    }));
+    bench::keep(received);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "Bench.h"
+
+#include "IOJson.h"
+#include "IOTypes.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Decoding objects of the sizes the protocol exchanges and looking up
+ * every key, with ValueObject and, for comparison, with the same entries
+ * in the std::unordered_map ValueObject used to be.
+ */
+
+static const size_t ITERATIONS = 500000;
+
+struct Payload
+{
+    const char* name;
+    std::string json;
+    std::vector<std::string> keys;
+};
+
+static Payload makePayload(const char* name, const std::string& json)
+{
+    Payload payload;
+    payload.name = name;
+    payload.json = json;
+
+    Value parsed;
+    json::parse(json, parsed);
+    for (const auto& entry : parsed.asObject())
+        payload.keys.push_back(entry.first);
+    return payload;
+}
+
+int main()
+{
+    std::string wide = "{";
+    for (int i = 0; i < 32; ++i)
+        wide += (i ? ",\"field" : "\"field") + std::to_string(i) + "\":" + std::to_string(i);
+    wide += "}";
+
+    std::vector<Payload> payloads = {
+        makePayload("handshake, 4 keys", "{\"sid\":\"lv_VI97HAXpY6yYWAAAC\",\"upgrades\":[\"websocket\"],\"pingInterval\":25000,\"pingTimeout\":60000}"),
+        makePayload("chat message, 6 keys", "{\"room\":\"general\",\"user\":\"alice\",\"text\":\"hello there\",\"ts\":1476543210,\"seq\":42,\"edited\":false}"),
+        makePayload("record, 32 keys", wide),
+    };
+
+    for (const auto& payload : payloads)
+    {
+        printf("%s\n", payload.name);
+
+        bench::report("decode + lookups, ValueObject", bench::measure(ITERATIONS, [&]() {
+            Value value;
+            json::parse(payload.json, value);
+            const ValueObject& object = value.asObject();
+            size_t found = 0;
+            for (const auto& key : payload.keys)
+                found += object.find(key) != object.end();
+            bench::keep(found);
+        }));
+
+        Value parsed;
+        json::parse(payload.json, parsed);
+        const ValueObject& entries = parsed.asObject();
+
+        bench::report("build + lookups, ValueObject", bench::measure(ITERATIONS, [&]() {
+            ValueObject object;
+            for (const auto& entry : entries)
+                object[entry.first] = entry.second;
+            size_t found = 0;
+            for (const auto& key : payload.keys)
+                found += object.find(key) != object.end();
+            bench::keep(found);
+        }));
+
+        bench::report("build + lookups, std::unordered_map", bench::measure(ITERATIONS, [&]() {
+            std::unordered_map<std::string, Value> object;
+            for (const auto& entry : entries)
+                object[entry.first] = entry.second;
+            size_t found = 0;
+            for (const auto& key : payload.keys)
+                found += object.find(key) != object.end();
+            bench::keep(found);
+        }));
+    }
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include "ConcurrentEmitter.h"
+
+#include <thread>
+
+QueueExecutor::QueueExecutor()
+: _stopped(false)
+{
+}
+
+QueueExecutor::~QueueExecutor()
+{
+}
+
+void QueueExecutor::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _cond.notify_one();
+}
+
+size_t QueueExecutor::poll()
+{
+    std::deque<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        tasks.swap(_tasks);
+    }
+
+    for (auto& task : tasks)
+        task();
+    return tasks.size();
+}
+
+void QueueExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopped)
+    {
+        if (_tasks.empty())
+        {
+            _cond.wait(lock);
+            continue;
+        }
+
+        std::function<void()> task = std::move(_tasks.front());
+        _tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+    _stopped = false;
+}
+
+void QueueExecutor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _cond.notify_all();
+}
+
+struct ConcurrentEmitter::Listener
+{
+    ValueFunction fn;
+    int64_t key;
+    std::shared_ptr<Executor> executor;
+    bool once;
+
+    // set by off(), checked again before a posted call runs
+    std::atomic<bool> cancelled;
+
+    // claimed by the one emit that gets to call a `once` listener
+    std::atomic<bool> fired;
+
+    Listener(const ValueFunction& fn_, int64_t key_, std::shared_ptr<Executor> executor_, bool once_)
+    : fn(fn_)
+    , key(key_)
+    , executor(std::move(executor_))
+    , once(once_)
+    , cancelled(false)
+    , fired(false)
+    {}
+};
+
+ConcurrentEmitter::ConcurrentEmitter()
+: _table(nullptr)
+, _epoch(0)
+{
+    _readers[0] = 0;
+    _readers[1] = 0;
+}
+
+ConcurrentEmitter::~ConcurrentEmitter()
+{
+    delete _table.load();
+}
+
+void ConcurrentEmitter::on(EventId event, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor)
+{
+    add(event, std::make_shared<Listener>(fn, key, std::move(executor), false));
+}
+
+void ConcurrentEmitter::on(const std::string& eventName, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor)
+{
+    on(EventId(eventName), fn, key, std::move(executor));
+}
+
+void ConcurrentEmitter::once(EventId event, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor)
+{
+    add(event, std::make_shared<Listener>(fn, key, std::move(executor), true));
+}
+
+void ConcurrentEmitter::once(const std::string& eventName, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor)
+{
+    once(EventId(eventName), fn, key, std::move(executor));
+}
+
+void ConcurrentEmitter::add(EventId event, std::shared_ptr<Listener> listener)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const Table* table = _table.load(std::memory_order_relaxed);
+    Table* updated = table ? new Table(*table) : new Table();
+    if (event.index() >= updated->size())
+        updated->resize(event.index() + 1);
+
+    auto& slot = (*updated)[event.index()];
+    auto list = slot ? std::make_shared<ListenerList>(*slot) : std::make_shared<ListenerList>();
+    list->push_back(std::move(listener));
+    slot = std::move(list);
+
+    publish(updated);
+}
+
+void ConcurrentEmitter::remove(EventId event, const std::function<bool(const Listener&)>& match, bool cancel)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const Table* table = _table.load(std::memory_order_relaxed);
+    if (!table || !event.isValid() || event.index() >= table->size() || !(*table)[event.index()])
+        return;
+
+    const ListenerList& current = *(*table)[event.index()];
+    auto list = std::make_shared<ListenerList>();
+    list->reserve(current.size());
+    for (const auto& listener : current)
+    {
+        if (!match(*listener))
+            list->push_back(listener);
+        else if (cancel)
+            listener->cancelled.store(true, std::memory_order_release);
+    }
+
+    if (list->size() == current.size())
+        return;
+
+    Table* updated = new Table(*table);
+    if (list->empty())
+        (*updated)[event.index()] = nullptr;
+    else
+        (*updated)[event.index()] = std::move(list);
+
+    publish(updated);
+}
+
+void ConcurrentEmitter::off(EventId event, int64_t key)
+{
+    remove(event, [key](const Listener& listener) {
+        return listener.key == key;
+    });
+}
+
+void ConcurrentEmitter::off(EventId event)
+{
+    remove(event, [](const Listener&) {
+        return true;
+    });
+}
+
+void ConcurrentEmitter::offAll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const Table* table = _table.load(std::memory_order_relaxed);
+    if (!table)
+        return;
+
+    for (const auto& list : *table)
+    {
+        if (!list)
+            continue;
+        for (const auto& listener : *list)
+            listener->cancelled.store(true, std::memory_order_release);
+    }
+
+    publish(nullptr);
+}
+
+void ConcurrentEmitter::publish(const Table* table)
+{
+    const Table* replaced = _table.exchange(table);
+    synchronize();
+    delete replaced;
+}
+
+/**
+ * Waits until no emit can still be reading a table replaced before the
+ * call. Readers that come later see the new one.
+ *
+ * Emits mark themselves on the counter of the epoch they read, so after
+ * a flip the old counter only drains. Flipping twice covers a reader
+ * which read the epoch before the previous flip but marked itself after
+ * that writer was done waiting.
+ */
+void ConcurrentEmitter::synchronize()
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        unsigned epoch = _epoch.fetch_add(1);
+        while (_readers[epoch & 1].load() != 0)
+            std::this_thread::yield();
+    }
+}
+
+std::shared_ptr<const ConcurrentEmitter::ListenerList> ConcurrentEmitter::load(EventId event) const
+{
+    if (!event.isValid())
+        return nullptr;
+
+    std::atomic<int>& readers = _readers[_epoch.load() & 1];
+    readers.fetch_add(1);
+
+    // the list is reference counted, only the table needs the counter
+    std::shared_ptr<const ListenerList> list;
+    const Table* table = _table.load();
+    if (table && event.index() < table->size())
+        list = (*table)[event.index()];
+
+    readers.fetch_sub(1);
+    return list;
+}
+
+void ConcurrentEmitter::emit(EventId event)
+{
+    dispatch(event, Value(), false);
+}
+
+void ConcurrentEmitter::emit(EventId event, const Value& args)
+{
+    dispatch(event, args, true);
+}
+
+void ConcurrentEmitter::emit(const std::string& eventName, const Value& args)
+{
+    dispatch(EventId::find(eventName), args, true);
+}
+
+bool ConcurrentEmitter::hasListeners(EventId event) const
+{
+    return load(event) != nullptr;
+}
+
+void ConcurrentEmitter::dispatch(EventId event, const Value& args, bool hasArgs)
+{
+    std::shared_ptr<const ListenerList> list = load(event);
+    if (!list)
+        return;
+
+    Value boxed;
+    for (const auto& listener : *list)
+    {
+        if (listener->cancelled.load(std::memory_order_acquire))
+            continue;
+
+        if (listener->once)
+        {
+            if (listener->fired.exchange(true, std::memory_order_acq_rel))
+                continue;
+
+            // taken off the list without cancelling, a posted call must still run
+            const Listener* self = listener.get();
+            remove(event, [self](const Listener& l) {
+                return &l == self;
+            }, false);
+        }
+
+        if (!boxed.isValid())
+            boxed = hasArgs ? Value::concat(event.getName(), args) : Value(event.getName());
+
+        if (listener->executor)
+        {
+            // each thread gets its own copy: lazy values change when read
+            std::shared_ptr<Listener> target = listener;
+            Value copy = boxed;
+            listener->executor->post([target, copy]() {
+                if (!target->cancelled.load(std::memory_order_acquire))
+                    target->fn(copy);
+            });
+        }
+        else
+        {
+            listener->fn(boxed);
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Emitter.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * Runs callbacks on the thread it belongs to.
+ */
+
+class Executor
+{
+public:
+    virtual ~Executor() {}
+
+    /**
+     * Queues `task`, called from any thread.
+     *
+     * @api public
+     */
+
+    virtual void post(std::function<void()> task) = 0;
+};
+
+/**
+ * Executor whose tasks run wherever `poll` or `run` is called, typically
+ * from the loop of a UI or worker thread.
+ */
+
+class QueueExecutor : public Executor
+{
+public:
+    QueueExecutor();
+    virtual ~QueueExecutor();
+
+    virtual void post(std::function<void()> task) override;
+
+    /**
+     * Runs the tasks queued so far without waiting for more.
+     *
+     * @return {Number} tasks run
+     * @api public
+     */
+
+    size_t poll();
+
+    /**
+     * Runs tasks as they come until `stop`.
+     *
+     * @api public
+     */
+
+    void run();
+    void stop();
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<std::function<void()>> _tasks;
+    bool _stopped;
+};
+
+/**
+ * Emitter safe to use from several threads at once, for handing events
+ * from the network thread to other threads.
+ *
+ * Emits never lock or wait: the listeners of an event are an immutable
+ * list and `on`/`off` publish a modified copy of the table of lists
+ * through an atomic pointer (RCU). An emit only marks itself on one of
+ * two reader counters while it takes a reference to its list; a writer
+ * frees the table it replaced once both counters have drained, flipping
+ * readers to the other counter so they can't hold it back forever.
+ *
+ * An emit racing with `off` may still call the removed listener once, as
+ * it walks the list it loaded; a listener posted to an executor is checked
+ * again before it runs, so it never runs after `off` returned.
+ *
+ * Listeners registered with an executor are posted to it with a copy of
+ * the arguments, the others are called on the emitting thread.
+ *
+ * Listeners get the same arguments as with Emitter: the event name alone,
+ * or the name followed by `args`.
+ */
+
+class ConcurrentEmitter
+{
+public:
+    ConcurrentEmitter();
+    ~ConcurrentEmitter();
+
+    /**
+     * Listen on the given `event` with `fn`, called on `executor` if
+     * there is one.
+     *
+     * @api public
+     */
+
+    void on(EventId event, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor = nullptr);
+    void on(const std::string& eventName, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor = nullptr);
+
+    /**
+     * Adds an `event` listener that will be invoked a single time, even
+     * when emitted from several threads at once, then removed.
+     *
+     * @api public
+     */
+
+    void once(EventId event, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor = nullptr);
+    void once(const std::string& eventName, const ValueFunction& fn, int64_t key, std::shared_ptr<Executor> executor = nullptr);
+
+    /**
+     * Remove the listener `key` of `event`, every listener of `event` or
+     * every listener.
+     *
+     * @api public
+     */
+
+    void off(EventId event, int64_t key);
+    void off(EventId event);
+    void offAll();
+
+    /**
+     * Emit `event` with the given args.
+     *
+     * @api public
+     */
+
+    void emit(EventId event);
+    void emit(EventId event, const Value& args);
+    void emit(const std::string& eventName, const Value& args);
+
+    bool hasListeners(EventId event) const;
+
+private:
+    struct Listener;
+    typedef std::vector<std::shared_ptr<Listener>> ListenerList;
+    typedef std::vector<std::shared_ptr<const ListenerList>> Table;
+
+    void add(EventId event, std::shared_ptr<Listener> listener);
+    void remove(EventId event, const std::function<bool(const Listener&)>& match, bool cancel = true);
+    void dispatch(EventId event, const Value& args, bool hasArgs);
+    std::shared_ptr<const ListenerList> load(EventId event) const;
+    void publish(const Table* table);
+    void synchronize();
+
+    // indexed by EventId::index(), replaced as a whole by writers
+    std::atomic<const Table*> _table;
+
+    // emits in progress, counted on the side given by the epoch's low bit
+    mutable std::atomic<unsigned> _epoch;
+    mutable std::atomic<int> _readers[2];
+
+    // serializes writers
+    std::mutex _mutex;
+};
@@ -1,6 +1,170 @@
 #include "Emitter.h"
 #include "IOUtils.h"
 
+#include <assert.h>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+/**
+ * Names by index, in fixed chunks that never move so `getName` can read
+ * them without locking while other threads intern.
+ */
+
+class AtomTable
+{
+public:
+    static const uint32_t CHUNK_SIZE = 256;
+    static const uint32_t CHUNK_COUNT = 1024;
+
+    AtomTable()
+    : _size(0)
+    {
+        for (auto& chunk : _chunks)
+            chunk.store(nullptr, std::memory_order_relaxed);
+
+        static const char* builtins[] = {
+            "open",
+            "close",
+            "packet",
+            "data",
+            "message",
+            "heartbeat",
+            "drain",
+            "flush",
+            "writable",
+            "error",
+            "ping",
+            "pong",
+            "poll",
+            "pollComplete",
+            "handshake",
+            "upgrade",
+            "upgrading",
+            "upgradeError",
+            "packetCreate",
+            "decoded",
+            "connect",
+            "connect_error",
+            "connect_timeout",
+            "connecting",
+            "disconnect",
+            "reconnect",
+            "reconnect_attempt",
+            "reconnect_failed",
+            "reconnect_error",
+            "reconnecting"
+        };
+        static_assert(sizeof(builtins) / sizeof(builtins[0]) == EventId::BUILTIN_COUNT, "builtin event names out of sync");
+
+        for (const char* name : builtins)
+            intern(name);
+    }
+
+    ~AtomTable()
+    {
+        for (auto& chunk : _chunks)
+            delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    uint32_t intern(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _ids.find(name);
+        if (iter != _ids.end())
+            return iter->second;
+
+        uint32_t index = _size;
+        assert(index < CHUNK_SIZE * CHUNK_COUNT);
+
+        std::string* chunk = _chunks[index / CHUNK_SIZE].load(std::memory_order_relaxed);
+        if (chunk == nullptr)
+        {
+            chunk = new std::string[CHUNK_SIZE];
+            _chunks[index / CHUNK_SIZE].store(chunk, std::memory_order_release);
+        }
+        chunk[index % CHUNK_SIZE] = name;
+
+        _ids.emplace(name, index);
+        ++_size;
+        return index;
+    }
+
+    uint32_t find(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _ids.find(name);
+        return iter != _ids.end() ? iter->second : 0xffffffffu;
+    }
+
+    const std::string& getName(uint32_t index) const
+    {
+        return _chunks[index / CHUNK_SIZE].load(std::memory_order_acquire)[index % CHUNK_SIZE];
+    }
+
+private:
+    std::mutex _mutex;
+    std::unordered_map<std::string, uint32_t> _ids;
+    std::atomic<std::string*> _chunks[CHUNK_COUNT];
+    uint32_t _size;
+};
+
+AtomTable& getAtomTable()
+{
+    static AtomTable __table;
+    return __table;
+}
+
+} // namespace {
+
+EventId::EventId(const std::string& name)
+: _index(getAtomTable().intern(name))
+{
+}
+
+EventId EventId::find(const std::string& name)
+{
+    EventId ret;
+    ret._index = getAtomTable().find(name);
+    return ret;
+}
+
+const std::string& EventId::getName() const
+{
+    static const std::string empty;
+    return isValid() ? getAtomTable().getName(_index) : empty;
+}
+
+/**
+ * Listeners of one event.
+ *
+ * Emits walk `callbacks` in place. A listener removed while an emit is
+ * running leaves a null tombstone and its callback is parked in
+ * `removed` (it may be the one running); both are cleaned up when the last
+ * emit over the list returns. Listeners added meanwhile are appended and
+ * only called from the next emit on.
+ */
+
+struct Emitter::Listeners
+{
+    std::vector<std::unique_ptr<Callback>> callbacks;
+    std::vector<std::unique_ptr<Callback>> removed;
+    size_t live;
+    int emitting;
+
+    Listeners()
+    : live(0)
+    , emitting(0)
+    {}
+
+    void compact()
+    {
+        callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), nullptr), callbacks.end());
+        removed.clear();
+    }
+};
+
 Emitter::Emitter()
 {
 
@@ -13,121 +177,273 @@ Emitter::~Emitter()
 
 void Emitter::on(const std::string& eventName, const ValueFunction& fn, int64_t key)
 {
-  Callback cb(fn, key);
-  _callbacks[eventName].push_back(std::move(cb));
+  on(EventId(eventName), fn, key);
 }
 
 void Emitter::on(const std::string& eventName, const ValueFunction& fn)
 {
-    Callback cb(fn, ID());
-    _callbacks[eventName].push_back(std::move(cb));
+  on(EventId(eventName), fn, ID());
+}
+
+void Emitter::on(EventId event, const ValueFunction& fn, int64_t key)
+{
+  add(event, Callback(fn, key));
+}
+
+void Emitter::add(EventId event, Callback&& cb)
+{
+  if (event.index() >= _callbacks.size())
+    _callbacks.resize(event.index() + 1);
+
+  auto& listeners = _callbacks[event.index()];
+  if (!listeners)
+    listeners = std::make_shared<Listeners>();
+
+  listeners->callbacks.emplace_back(new Callback(std::move(cb)));
+  ++listeners->live;
 }
 
 void Emitter::once(const std::string& eventName, const ValueFunction& fn, int64_t key)
+{
+  once(EventId(eventName), fn, key);
+}
+
+void Emitter::once(const std::string& eventName, const ValueFunction& fn)
+{
+  once(EventId(eventName), fn, ID());
+}
+
+void Emitter::once(EventId event, const ValueFunction& fn, int64_t key)
 {
   auto cb = [=](const Value& args) {
-    off(eventName, key);
+    off(event, key);
     fn(args);
   };
 
-  on(eventName, cb, key);
+  on(event, cb, key);
 }
 
-void Emitter::once(const std::string& eventName, const ValueFunction& fn)
+void Emitter::remove(Listeners& listeners, size_t index)
 {
-    ListenerId key = ID();
-    auto cb = [=](const Value& args) {
-        off(eventName, key);
-        fn(args);
-    };
-
-    on(eventName, cb, key);
+    --listeners.live;
+    if (listeners.emitting > 0)
+    {
+        listeners.removed.push_back(std::move(listeners.callbacks[index]));
+    }
+    else
+    {
+        listeners.callbacks.erase(listeners.callbacks.begin() + index);
+    }
 }
 
 void Emitter::offAll()
 {
-    _callbacks.clear();
+    for (auto& listeners : _callbacks)
+    {
+        if (!listeners)
+            continue;
+
+        for (size_t i = listeners->callbacks.size(); i-- > 0;)
+        {
+            if (listeners->callbacks[i])
+                remove(*listeners, i);
+        }
+    }
 }
 
 void Emitter::off(const std::string& eventName)
 {
-    auto iter = _callbacks.find(eventName);
-    if (iter != _callbacks.end())
+    Listeners* listeners = findListeners(EventId::find(eventName));
+    if (listeners)
     {
-        _callbacks.erase(iter);
+        for (size_t i = listeners->callbacks.size(); i-- > 0;)
+        {
+            if (listeners->callbacks[i])
+                remove(*listeners, i);
+        }
     }
 }
 
 void Emitter::off(const std::string& eventName, int64_t key)
+{
+  off(EventId::find(eventName), key);
+}
+
+void Emitter::off(EventId event, int64_t key)
 {
   // specific event
-  auto iter = _callbacks.find(eventName);
-  if (iter == _callbacks.end())
+  Listeners* listeners = findListeners(event);
+  if (!listeners)
   {
       return;
   }
-  auto& callbacks = iter->second;
 
   // remove specific handler
-  for (auto iter = callbacks.begin(); iter != callbacks.end(); ++iter)
+  for (size_t i = 0; i < listeners->callbacks.size(); ++i)
   {
-      auto& cb = *iter;
-      if (cb.key == key)
+      const auto& cb = listeners->callbacks[i];
+      if (cb && cb->key == key)
       {
-        callbacks.erase(iter);
+        remove(*listeners, i);
         break;
       }
   }
 }
 
+Emitter::Listeners* Emitter::findListeners(EventId event) const
+{
+    if (!event.isValid() || event.index() >= _callbacks.size())
+        return nullptr;
+
+    Listeners* listeners = _callbacks[event.index()].get();
+    return listeners && listeners->live > 0 ? listeners : nullptr;
+}
+
+void Emitter::dispatch(EventId event, Visitor visit, void* context)
+{
+    std::shared_ptr<Listeners> listeners = _callbacks[event.index()];
+
+    struct Scope
+    {
+        Listeners& listeners;
+
+        Scope(Listeners& l) : listeners(l) { ++listeners.emitting; }
+        ~Scope()
+        {
+            if (--listeners.emitting == 0 && !listeners.removed.empty())
+                listeners.compact();
+        }
+    } scope(*listeners);
+
+    // listeners added by these calls wait for the next emit
+    size_t count = listeners->callbacks.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        Callback* cb = listeners->callbacks[i].get();
+        if (cb)
+            visit(*cb, context);
+    }
+}
+
 void Emitter::emit(const std::string& eventName, const Value& args)
 {
-    ValueArray arguments = Value::concat(eventName, args);
-    Emitter::emit(arguments);
+    emit(EventId::find(eventName), args);
+}
+
+void Emitter::emit(const std::string& eventName, Value&& args)
+{
+    emit(EventId::find(eventName), std::move(args));
 }
 
 void Emitter::emit(const Value& args)
 {
+    EventId event;
     if (args.getType() == Value::Type::ARRAY)
     {
         const ValueArray& arguments = args.asArray();
         if (arguments.empty())
             return;
 
-        std::string eventName = arguments[0].asString();
+        event = EventId::find(arguments[0].asString());
+    } else if (args.getType() == Value::Type::STRING) {
+        event = EventId::find(args.asString());
+    }
+
+    if (!findListeners(event))
+        return;
+
+    // typed listeners can't be given the boxed arguments
+    auto call = [&](const Callback& cb) {
+        if (cb.fn)
+            cb.fn(args);
+    };
+    dispatch(event, &visit<decltype(call)>, &call);
+}
+
+void Emitter::emit(EventId event)
+{
+    emit<>(event);
+}
 
-        auto iter = _callbacks.find(eventName);
-        if (iter != _callbacks.end())
+void Emitter::emit(EventId event, const Value& args)
+{
+    if (!findListeners(event))
+        return;
+
+    Value boxed;
+    auto call = [&](const Callback& cb) {
+        if (cb.signature == &EventSignature<Value>::tag)
         {
-            std::vector<Callback> copied = iter->second;
-            for (const auto& cb : copied)
-            {
-                cb.fn(args);
-            }
+            (*static_cast<std::function<void(const Value&)>*>(cb.typed.get()))(args);
         }
-    } else if (args.getType() == Value::Type::STRING) {
-        std::string eventName = args.asString();
+        else if (cb.fn)
+        {
+            if (!boxed.isValid())
+                boxed = Value::concat(event.getName(), args);
+            cb.fn(boxed);
+        }
+    };
+    dispatch(event, &visit<decltype(call)>, &call);
+}
+
+void Emitter::emit(EventId event, Value&& args)
+{
+    Listeners* listeners = findListeners(event);
+    if (!listeners)
+        return;
+
+    // the box takes `args` over unless a typed listener needs them as
+    // well, a list with both kinds pays for one copy
+    bool typed = false;
+    for (const auto& cb : listeners->callbacks)
+    {
+        if (cb && cb->signature == &EventSignature<Value>::tag)
+        {
+            typed = true;
+            break;
+        }
+    }
 
-        auto iter = _callbacks.find(eventName);
-        if (iter != _callbacks.end())
+    Value boxed;
+    auto call = [&](const Callback& cb) {
+        if (cb.signature == &EventSignature<Value>::tag)
         {
-            std::vector<Callback> copied = iter->second;
-            for (const auto& cb : copied)
+            (*static_cast<std::function<void(const Value&)>*>(cb.typed.get()))(args);
+        }
+        else if (cb.fn)
+        {
+            if (!boxed.isValid())
             {
-                cb.fn(args);
+                if (typed)
+                    boxed = Value::concat(event.getName(), static_cast<const Value&>(args));
+                else
+                    boxed = Value::concat(event.getName(), std::move(args));
             }
+            cb.fn(boxed);
         }
-    }
+    };
+    dispatch(event, &visit<decltype(call)>, &call);
 }
 
-const std::vector<Emitter::Callback>& Emitter::getListeners(const std::string& eventName) const
+std::vector<Emitter::Callback> Emitter::getListeners(const std::string& eventName) const
 {
-    return _callbacks.at(eventName);
+    std::vector<Callback> ret;
+    Listeners* listeners = findListeners(EventId::find(eventName));
+    if (listeners)
+    {
+        ret.reserve(listeners->live);
+        for (const auto& cb : listeners->callbacks)
+        {
+            if (cb)
+                ret.push_back(*cb);
+        }
+    }
+    return ret;
 }
 
 bool Emitter::hasListeners(const std::string& eventName) const
 {
-    return _callbacks.find(eventName) != _callbacks.end();
+    return findListeners(EventId::find(eventName)) != nullptr;
 }
 
 OnObj gon(std::shared_ptr<Emitter> obj, const std::string& ev, const ValueFunction& fn, int64_t key)
@@ -1,6 +1,103 @@
 #pragma once
 
 #include "IOTypes.h"
+#include "IOUtils.h"
+
+/**
+ * Interned event name.
+ *
+ * Every name gets a small index in a process wide atom table the first
+ * time it is interned, so emitters dispatch by array index instead of
+ * hashing the name on every emit. The events the library emits itself
+ * have fixed ids known at compile time.
+ *
+ * Names coming from the network should be looked up with `find` rather
+ * than interned: a name nobody listens to has no id and needs no dispatch,
+ * and the table never shrinks.
+ */
+
+class EventId
+{
+public:
+    enum Builtin : uint32_t
+    {
+        OPEN,
+        CLOSE,
+        PACKET,
+        DATA,
+        MESSAGE,
+        HEARTBEAT,
+        DRAIN,
+        FLUSH,
+        WRITABLE,
+        ERROR,
+        PING,
+        PONG,
+        POLL,
+        POLL_COMPLETE,
+        HANDSHAKE,
+        UPGRADE,
+        UPGRADING,
+        UPGRADE_ERROR,
+        PACKET_CREATE,
+        DECODED,
+        CONNECT,
+        CONNECT_ERROR,
+        CONNECT_TIMEOUT,
+        CONNECTING,
+        DISCONNECT,
+        RECONNECT,
+        RECONNECT_ATTEMPT,
+        RECONNECT_FAILED,
+        RECONNECT_ERROR,
+        RECONNECTING,
+        BUILTIN_COUNT
+    };
+
+    constexpr EventId() : _index(NPOS) {}
+    constexpr EventId(Builtin builtin) : _index(builtin) {}
+
+    /**
+     * Interns `name`.
+     */
+    explicit EventId(const std::string& name);
+
+    /**
+     * Id of an already interned name, an invalid id otherwise.
+     */
+    static EventId find(const std::string& name);
+
+    bool isValid() const { return _index != NPOS; }
+    uint32_t index() const { return _index; }
+    const std::string& getName() const;
+
+    bool operator==(EventId o) const { return _index == o._index; }
+    bool operator!=(EventId o) const { return _index != o._index; }
+
+private:
+    static const uint32_t NPOS = 0xffffffffu;
+
+    uint32_t _index;
+};
+
+/**
+ * Tags the argument list of typed listeners, see Emitter::on<Args...>.
+ */
+template<class... Args>
+struct EventSignature
+{
+    static const char tag;
+};
+
+template<class... Args>
+const char EventSignature<Args...>::tag = 0;
+
+// keeps explicitly given template arguments from being deduced
+template<class T>
+struct NonDeduced
+{
+    typedef T type;
+};
 
 class Emitter
 {
@@ -30,6 +127,51 @@ public:
     virtual void once(const std::string& eventName, const ValueFunction& fn, int64_t key);
     virtual void once(const std::string& eventName, const ValueFunction& fn);
 
+    void on(EventId event, const ValueFunction& fn, int64_t key);
+    void once(EventId event, const ValueFunction& fn, int64_t key);
+
+    /**
+     * Typed listeners, called with the arguments of `emit<Args...>` as
+     * they were passed: nothing is boxed into a Value for them. They are
+     * only called by emits with the same argument types, plus the plain
+     * `emit(event)` for `on<>` and `emit(event, value)` for `on<Value>`.
+     *
+     *     socket->on<EngineIOPacket>(EventId::PACKET, [this](const EngineIOPacket& packet) {...});
+     *
+     * @api public
+     */
+
+    template<class... Args>
+    void on(EventId event, const typename NonDeduced<std::function<void(const Args&...)>>::type& fn, int64_t key)
+    {
+        Callback cb;
+        cb.key = key;
+        cb.signature = &EventSignature<Args...>::tag;
+        cb.typed = std::make_shared<std::function<void(const Args&...)>>(fn);
+        add(event, std::move(cb));
+    }
+
+    template<class... Args>
+    void on(EventId event, const typename NonDeduced<std::function<void(const Args&...)>>::type& fn)
+    {
+        on<Args...>(event, fn, ID());
+    }
+
+    template<class... Args>
+    void once(EventId event, const typename NonDeduced<std::function<void(const Args&...)>>::type& fn, int64_t key)
+    {
+        on<Args...>(event, [=](const Args&... args) {
+            off(event, key);
+            fn(args...);
+        }, key);
+    }
+
+    template<class... Args>
+    void once(EventId event, const typename NonDeduced<std::function<void(const Args&...)>>::type& fn)
+    {
+        once<Args...>(event, fn, ID());
+    }
+
     /**
      * Remove the given callback for `event` or all
      * registered callbacks.
@@ -42,6 +184,7 @@ public:
     virtual void offAll();
     virtual void off(const std::string& eventName);
     virtual void off(const std::string& eventName, int64_t key);
+    void off(EventId event, int64_t key);
 
 
     /**
@@ -53,21 +196,76 @@ public:
      */
 
     virtual void emit(const std::string& eventName, const Value& args);
+    virtual void emit(const std::string& eventName, Value&& args);
     virtual void emit(const Value& args);
 
+    /**
+     * Emits an interned event on this emitter. Nothing is built when
+     * there are no listeners. Listeners get the same arguments as with
+     * the string overloads: the event name alone, or the name followed
+     * by `args`.
+     *
+     * Unlike the string overloads these are not virtual, they always
+     * dispatch locally.
+     */
+
+    void emit(EventId event);
+    void emit(EventId event, const Value& args);
+    void emit(EventId event, Value&& args);
+
+    /**
+     * Emits typed arguments, passed by reference to the `on<Args...>`
+     * listeners. Listeners registered with a ValueFunction get them boxed
+     * into `[event name, args...]`, built once and only if there is such
+     * a listener.
+     *
+     *     emit<EngineIOPacket>(EventId::PACKET, packet);
+     *
+     * @api public
+     */
+
+    template<class... Args>
+    void emit(EventId event, const typename NonDeduced<Args>::type&... args)
+    {
+        if (!findListeners(event))
+            return;
+
+        Value boxed;
+        auto call = [&](const Callback& cb) {
+            if (cb.signature == &EventSignature<Args...>::tag)
+            {
+                (*static_cast<std::function<void(const Args&...)>*>(cb.typed.get()))(args...);
+            }
+            else if (cb.fn)
+            {
+                if (!boxed.isValid())
+                    boxed = box(event, args...);
+                cb.fn(boxed);
+            }
+        };
+        dispatch(event, &visit<decltype(call)>, &call);
+    }
+
     struct Callback
     {
         ValueFunction fn;
         int64_t key;
 
+        // typed listeners: the std::function<void(const Args&...)> and
+        // the EventSignature tag of its Args
+        std::shared_ptr<void> typed;
+        const void* signature;
+
         Callback()
         : fn(nullptr)
         , key(-1)
+        , signature(nullptr)
         {}
 
         Callback(const ValueFunction& fn_, int64_t key_)
         : fn(fn_)
         , key(key_)
+        , signature(nullptr)
         {}
     };
 
@@ -79,7 +277,7 @@ public:
      * @api public
      */
 
-    virtual const std::vector<Callback>& getListeners(const std::string& eventName) const;
+    virtual std::vector<Callback> getListeners(const std::string& eventName) const;
 
     /**
      * Check if this emitter has `event` handlers.
@@ -92,7 +290,41 @@ public:
     virtual bool hasListeners(const std::string& eventName) const;
 
 private:
-    std::unordered_map<std::string, std::vector<Callback>> _callbacks;
+    struct Listeners;
+
+    typedef void (*Visitor)(const Callback& cb, void* context);
+
+    template<class F>
+    static void visit(const Callback& cb, void* f)
+    {
+        (*static_cast<F*>(f))(cb);
+    }
+
+    static Value box(EventId event)
+    {
+        return Value(event.getName());
+    }
+
+    template<class... Args>
+    static Value box(EventId event, const Args&... args)
+    {
+        ValueArray arguments;
+        arguments.reserve(1 + sizeof...(Args));
+        arguments.push_back(Value(event.getName()));
+        int expand[] = { (arguments.push_back(Value(args)), 0)... };
+        (void)expand;
+        return Value(std::move(arguments));
+    }
+
+    void add(EventId event, Callback&& cb);
+    void dispatch(EventId event, Visitor visit, void* context);
+    Listeners* findListeners(EventId event) const;
+    void remove(Listeners& listeners, size_t index);
+
+    // indexed by EventId::index(); listeners are emitted in place, never
+    // copied. Shared so a list outlives an emitter destroyed by one of
+    // its own listeners.
+    std::vector<std::shared_ptr<Listeners>> _callbacks;
 };
 
 struct OnObj
@@ -110,3 +342,15 @@ struct OnObj
 
 OnObj gon(std::shared_ptr<Emitter> obj, const std::string& ev, const ValueFunction& fn, int64_t key);
 OnObj gon(std::shared_ptr<Emitter> obj, const std::string& ev, const ValueFunction& fn);
+
+template<class... Args>
+OnObj gon(std::shared_ptr<Emitter> obj, EventId ev, const typename NonDeduced<std::function<void(const Args&...)>>::type& fn)
+{
+  int64_t key = grabListenerId();
+  obj->on<Args...>(ev, fn, key);
+  OnObj onObj;
+  onObj.destroy = [obj, ev, key](){
+    obj->off(ev, key);
+  };
+  return onObj;
+}
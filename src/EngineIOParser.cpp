@@ -1,6 +1,10 @@
 #include "EngineIOParser.h"
 #include "IOUtils.h"
+#include "IOJson.h"
+#include "IOBase64.h"
+#include "IOUtf8.h"
 #include <assert.h>
+#include <string.h>
 
 namespace engineio { namespace parser {
 
@@ -25,10 +29,10 @@ static std::unordered_map<std::string, uint8_t> __packets = {
 
 static const std::vector<std::string> __packetslist = {
   "open",
-  "close"
+  "close",
   "ping",
   "pong",
-  "message"
+  "message",
   "upgrade",
   "noop"
 };
@@ -42,10 +46,14 @@ static const std::vector<std::string> __packetslist = {
 
 std::string encodeBase64Packet(const EngineIOPacket& packet)
 {
-    std::string message = std::string("b") + toString(__packets[packet.type]);
     assert(packet.data.getType() == Value::Type::BINARY);
+    const Buffer& data = packet.data.asBuffer();
 
-    message += packet.data.asBuffer().toBase64String();
+    std::string message;
+    message.reserve(2 + base64::encodedLength(data.length()));
+    message += 'b';
+    message += (char)('0' + __packets[packet.type]);
+    base64::encode(data.data(), data.length(), message);
     return message;
 }
 
@@ -69,6 +77,49 @@ static Value encodeBuffer(const EngineIOPacket& packet, bool supportsBinary)
     return buf;
 }
 
+bool encodePacket(const EngineIOPacket& packet, bool supportsBinary, PacketSlices& encoded)
+{
+    auto iter = __packets.find(packet.type);
+    if (iter == __packets.end())
+        return false;
+
+    encoded.data.data = nullptr;
+    encoded.data.length = 0;
+
+    if (packet.data.getType() == Value::Type::BINARY)
+    {
+        if (!supportsBinary)
+        {
+            encoded.base64 = encodeBase64Packet(packet);
+            encoded.header = (uint8_t)encoded.base64[0];
+            encoded.data.data = (const uint8_t*)encoded.base64.data() + 1;
+            encoded.data.length = encoded.base64.length() - 1;
+            encoded.binary = false;
+            return true;
+        }
+
+        const Buffer& data = packet.data.asBuffer();
+        encoded.header = iter->second;
+        encoded.data.data = data.data();
+        encoded.data.length = data.length();
+        encoded.binary = true;
+        return true;
+    }
+
+    encoded.header = (uint8_t)('0' + iter->second);
+    encoded.binary = false;
+
+    // data fragment is optional
+    if (packet.data.isValid())
+    {
+        assert(packet.data.getType() == Value::Type::STRING);
+        const std::string& data = packet.data.asString();
+        encoded.data.data = (const uint8_t*)data.data();
+        encoded.data.length = data.length();
+    }
+    return true;
+}
+
 Value encodePacket(const EngineIOPacket& packet, bool supportsBinary, bool utf8encode)
 {
     if (packet.data.getType() == Value::Type::BINARY) {
@@ -76,29 +127,28 @@ Value encodePacket(const EngineIOPacket& packet, bool supportsBinary, bool utf8e
     }
 
   // encode string
-  std::stringstream encoded;
   // Sending data as a utf-8 string
   auto iter = __packets.find(packet.type);
   if (iter == __packets.end())
     return "";
 
-  encoded << iter->second;
-
-    assert(packet.data.getType() == Value::Type::STRING);
+  std::string encoded(1, (char)('0' + iter->second));
 
   // data fragment is optional
   if (packet.data.isValid()) {
-    if (utf8encode)
+    assert(packet.data.getType() == Value::Type::STRING);
+    const std::string& data = packet.data.asString();
+    if (utf8encode && !utf8::validate(data.data(), data.length()))
     {
-      encoded << utf8Encode(packet.data.asString());
+      encoded += utf8::sanitize(data.data(), data.length());
     }
     else
     {
-      encoded << packet.data.asString();
+      encoded += data;
     }
   }
 
-  return encoded.str();
+  return Value(std::move(encoded));
 }
 
 /**
@@ -108,59 +158,86 @@ Value encodePacket(const EngineIOPacket& packet, bool supportsBinary, bool utf8e
  * @return {Object} with `type` and `data` (if any)
  */
 
-static EngineIOPacket decodeBase64Packet(const std::string& msg) {
-    std::string type = __packetslist[msg[0]];
-    std::string base64 = msg.substr(1);
-    Buffer data = base64Decode(base64);
+static EngineIOPacket decodeBase64Packet(const char* msg, size_t len) {
+    if (len == 0 || (uint8_t)(msg[0] - '0') >= __packetslist.size()) {
+        return EngineIOPacket::ERROR;
+    }
+    uint8_t type = msg[0] - '0';
+
+    Buffer data;
+    if (!base64::decode(msg + 1, len - 1, data)) {
+        return EngineIOPacket::ERROR;
+    }
 
     EngineIOPacket packet;
-    packet.type = type;
-    packet.data = data;
+    packet.type = __packetslist[type];
+    packet.data = std::move(data);
     return packet;
 }
 
+/**
+ * Decodes a packet from `len` bytes of text. Only the data fragment is
+ * copied, so it can point into a bigger payload.
+ */
+
+static EngineIOPacket decodeText(const char* str, size_t len, bool utf8decode)
+{
+    if (len == 0) {
+        return EngineIOPacket::ERROR;
+    }
+
+    if (str[0] == 'b') {
+        return decodeBase64Packet(str + 1, len - 1);
+    }
+
+    uint8_t type = str[0] - '0';
+    if (type >= __packetslist.size()) {
+        return EngineIOPacket::ERROR;
+    }
+
+    EngineIOPacket ret;
+    ret.type = __packetslist[type];
+    if (len > 1) {
+        if (utf8decode && !utf8::validate(str + 1, len - 1)) {
+            return EngineIOPacket::ERROR;
+        }
+        ret.data = std::string(str + 1, len - 1);
+    }
+    return ret;
+}
+
+/**
+ * Decodes a binary packet, the data shares `buf`'s storage.
+ */
+
+static EngineIOPacket decodeBinary(const Buffer& buf)
+{
+    if (buf.length() == 0 || buf[0] >= __packetslist.size()) {
+        return EngineIOPacket::ERROR;
+    }
+
+    EngineIOPacket ret;
+    ret.type = __packetslist[buf[0]];
+    ret.data = buf.slice(1);
+    return ret;
+}
+
 EngineIOPacket decodePacket(const Value& data, bool utf8decode)
 {
   if (!data.isValid()) {
       return EngineIOPacket::ERROR;
   }
 
-    EngineIOPacket ret;
   // String data
     if (data.getType() == Value::Type::STRING) {
         const std::string& str = data.asString();
-        if (str[0] == 'b') {
-          return decodeBase64Packet(str.substr(1));
-        }
-
-        uint8_t type = str[0] - '0';
-
-        std::string decodedStr;
-        if (utf8decode) {
-          decodedStr = utf8Decode(str);
-            if (decodedStr.empty()){
-            return EngineIOPacket::ERROR;
-          }
-        }
-
-        if (type >= __packetslist.size()) {
-          return EngineIOPacket::ERROR;
-        }
-
-        ret.type = __packetslist[type];
-        if (str.length() > 1) {
-            ret.data = str.substr(1);
-        }
+        return decodeText(str.data(), str.length(), utf8decode);
     } else if (data.getType() == Value::Type::BINARY) {
-
-        // Binary data
-        const Buffer& buf = data.asBuffer();
-        uint8_t type = buf[0];
-        ret.type = __packetslist[type];
-        ret.data = std::move(Buffer(buf.data() + 1, buf.length() - 1));
+        // Binary data, the payload shares the frame's storage
+        return decodeBinary(data.asBuffer());
     }
 
-    return ret;
+    return EngineIOPacket();
 }
 
 //function tryDecode(data) {
@@ -181,74 +258,75 @@ EngineIOPacket decodePacket(const Value& data, bool utf8decode)
  * Example:
  * 1 3 255 1 2 3, if the binary contents are interpreted as 8 bit integers
  *
+ * Packets are encoded first so the payload is allocated and filled once.
+ *
  * @param {Array} packets
  * @return {Buffer} encoded payload
  * @api private
  */
 
-static Value encodePayloadAsBinary(const EngineIOPacket& packets)
+static Value encodePayloadAsBinary(const EngineIOPacket* packets, size_t count)
 {
-//  if (!packets.isValid()) {
-//      return Value::NONE;
-//  }
-//
-//  auto encodeOne = [](const EngineIOPacket& p, doneCallback) {
-//      EngineIOPacket encoded = encodePacket(p, true, true);
-//
-//      if (typeof packet == "string") {
-//        var encodingLength = "" + packet.length;
-//        var sizeBuffer = new Buffer(encodingLength.length + 2);
-//        sizeBuffer[0] = 0; // is a string (not true binary = 0)
-//        for (var i = 0; i < encodingLength.length; i++) {
-//          sizeBuffer[i + 1] = parseInt(encodingLength[i], 10);
-//        }
-//        sizeBuffer[sizeBuffer.length - 1] = 255;
-//        return doneCallback(null, Buffer.concat([sizeBuffer, stringToBuffer(packet)]));
-//      }
-//
-//      var encodingLength = "" + packet.length;
-//      var sizeBuffer = new Buffer(encodingLength.length + 2);
-//      sizeBuffer[0] = 1; // is binary (true binary = 1)
-//      for (var i = 0; i < encodingLength.length; i++) {
-//        sizeBuffer[i + 1] = parseInt(encodingLength[i], 10);
-//      }
-//      sizeBuffer[sizeBuffer.length - 1] = 255;
-//      doneCallback(null, Buffer.concat([sizeBuffer, packet]));
-//    });
-//  };
-//
-//  map(packets, encodeOne, function(err, results) {
-//    return callback(Buffer.concat(results));
-//  });
+    if (count == 0) {
+        return Buffer(nullptr, 0);
+    }
+
+    std::vector<Value> encoded;
+    encoded.reserve(count);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        encoded.push_back(encodePacket(packets[i], true, true));
+        const Value& e = encoded.back();
+        size_t len = e.getType() == Value::Type::BINARY ? e.asBuffer().length() : e.asString().length();
+        // type, length digits, 255, data
+        total += 2 + len;
+        do { ++total; len /= 10; } while (len > 0);
+    }
 
-    return Value::NONE;
+    uint8_t digits[20];
+
+    Buffer payload(nullptr, total);
+    uint8_t* out = payload.mutableData();
+    for (const auto& e : encoded) {
+        bool isBinary = e.getType() == Value::Type::BINARY;
+        const uint8_t* data = isBinary ? e.asBuffer().data() : (const uint8_t*)e.asString().data();
+        size_t len = isBinary ? e.asBuffer().length() : e.asString().length();
+
+        *out++ = isBinary ? 1 : 0; // is binary (true binary = 1)
+        size_t n = 0;
+        size_t l = len;
+        do { digits[n++] = l % 10; l /= 10; } while (l > 0);
+        while (n > 0) {
+            *out++ = digits[--n];
+        }
+        *out++ = 255;
+        memcpy(out, data, len);
+        out += len;
+    }
+    return payload;
 }
 
-Value encodePayload(const std::vector<EngineIOPacket>& packet, bool supportsBinary)
+Value encodePayload(const EngineIOPacket* packets, size_t count, bool supportsBinary)
 {
-//  if (supportsBinary) {
-//    return exports.encodePayloadAsBinary(packets, callback);
-//  }
-//
-//  if (!packets.length) {
-//    return callback("0:");
-//  }
-//
-//  function setLengthHeader(message) {
-//    return message.length + ":" + message;
-//  }
-//
-//  function encodeOne(packet, doneCallback) {
-//    exports.encodePacket(packet, supportsBinary, true, function(message) {
-//      doneCallback(null, setLengthHeader(message));
-//    });
-//  }
-//
-//  map(packets, encodeOne, function(err, results) {
-//    return callback(results.join(""));
-//  });
+  if (supportsBinary) {
+    return encodePayloadAsBinary(packets, count);
+  }
+
+  if (count == 0) {
+    return "0:";
+  }
 
-    return Value::NONE;
+  // <length>:<message>, binary packets become base64 messages
+  std::string payload;
+  for (size_t i = 0; i < count; i++) {
+    Value message = encodePacket(packets[i], false, true);
+    const std::string& str = message.asString();
+    json::appendInt(payload, (int)str.length());
+    payload += ':';
+    payload += str;
+  }
+  return Value(std::move(payload));
 }
 
 /**
@@ -280,113 +358,100 @@ Value encodePayload(const std::vector<EngineIOPacket>& packet, bool supportsBina
  * @api public
  */
 
-static EngineIOPacket decodePayloadAsBinary(const Value& data, bool binaryType)
+static void decodePayloadAsBinary(const Buffer& data, const PayloadCallback& callback)
 {
-//  var bufferTail = data;
-//  var buffers = [];
-//
-//  while (bufferTail.length > 0) {
-//    var strLen = "";
-//    var isString = bufferTail[0] == 0;
-//    var numberTooLong = false;
-//    for (var i = 1; ; i++) {
-//      if (bufferTail[i] == 255)  break;
-//      // 310 = char length of Number.MAX_VALUE
-//      if (strLen.length > 310) {
-//        numberTooLong = true;
-//        break;
-//      }
-//      strLen += "" + bufferTail[i];
-//    }
-//    if(numberTooLong) return callback(err, 0, 1);
-//    bufferTail = bufferTail.slice(strLen.length + 1);
-//
-//    var msgLength = parseInt(strLen, 10);
-//
-//    var msg = bufferTail.slice(1, msgLength + 1);
-//    if (isString) msg = bufferToString(msg);
-//    buffers.push(msg);
-//    bufferTail = bufferTail.slice(msgLength + 1);
-//  }
-//
-//  var total = buffers.length;
-//  buffers.forEach(function(buffer, i) {
-//    callback(decodePacket(buffer, binaryType, true), i, total);
-//  });
-    return EngineIOPacket::NONE;
-}
+    const uint8_t* bytes = data.data();
+    size_t l = data.length();
+    size_t i = 0;
+
+    while (i < l) {
+        bool isString = bytes[i] == 0;
+
+        size_t msgLength = 0;
+        size_t digits = 0;
+        while (++i < l && bytes[i] != 255) {
+            // 20 digits overflow size_t; longer than any payload anyway
+            if (bytes[i] > 9 || ++digits > 19) {
+                callback(EngineIOPacket::ERROR, 0, 1);
+                return;
+            }
+            msgLength = msgLength * 10 + bytes[i];
+        }
 
-/*
- * Decodes data when a payload is maybe expected. Possible binary contents are
- * decoded from their base64 representation
- *
- * @param {String} data, callback method
- * @api public
- */
+        if (i >= l || digits == 0 || msgLength > l - i - 1) {
+            callback(EngineIOPacket::ERROR, 0, 1);
+            return;
+        }
+        ++i;
 
-EngineIOPacket decodePayload(const Value& d)
+        EngineIOPacket packet = isString
+            ? decodeText((const char*)bytes + i, msgLength, true)
+            : decodeBinary(data.slice(i, msgLength));
+        i += msgLength;
+
+        if (!callback(packet, i, l)) return;
+    }
+}
+
+void decodePayload(const Value& d, const PayloadCallback& callback)
 {
     if (d.getType() == Value::Type::BINARY) {
-        return decodePayloadAsBinary(d, true);
+        decodePayloadAsBinary(d.asBuffer(), callback);
+        return;
     }
 
-    EngineIOPacket packet;
-    const std::string& data = d.asString();
-    if (data.empty()) {
+    if (d.getType() != Value::Type::STRING || d.asString().empty()) {
         // parser error - ignoring payload
-        return packet;
+        callback(EngineIOPacket::ERROR, 0, 1);
+        return;
     }
 
-    std::string length = "";
-    size_t n;
-    std::string msg;
+    const std::string& data = d.asString();
+    size_t length = 0;
+    bool hasLength = false;
 
     for (size_t i = 0, l = data.size(); i < l; i++) {
         char chr = data[i];
 
         if (':' != chr) {
-            length += chr;
-        } else {
-            if (length.empty()) {
+            if (chr < '0' || chr > '9' || length > (l - i) / 10 + 1) {
                 // parser error - ignoring payload
-//                return callback(err, 0, 1);
-                return packet;
-            }
-
-            n = atoi(length.c_str());
-            msg = data.substr(i + 1, n);
-
-            if (atoi(length.c_str()) != msg.length()) {
-                // parser error - ignoring payload
-                //cjh        return callback(err, 0, 1);
-              return packet;
+                callback(EngineIOPacket::ERROR, 0, 1);
+                return;
             }
+            length = length * 10 + (chr - '0');
+            hasLength = true;
+            continue;
+        }
 
-            if (!msg.empty()) {
-                packet = decodePacket(msg, true);
+        if (!hasLength || length > l - i - 1) {
+            // parser error - ignoring payload
+            callback(EngineIOPacket::ERROR, 0, 1);
+            return;
+        }
 
-    //        if (err.type == packet.type && err.data == packet.data) {
-    //          // parser error in individual packet - ignoring payload
-    //          return callback(err, 0, 1);
-    //        }
-    //
-    //        var ret = callback(packet, i + n, l);
+        if (length > 0) {
+            EngineIOPacket packet = decodeText(data.data() + i + 1, length, true);
 
-                return packet;
-    //        if (false == ret) return;
+            if (EngineIOPacket::ERROR.type == packet.type) {
+                // parser error in individual packet - ignoring payload
+                callback(EngineIOPacket::ERROR, 0, 1);
+                return;
             }
 
-            // advance cursor
-            i += n;
-            length = "";
+            if (!callback(packet, i + 1 + length, l)) return;
         }
-  }
 
-  if (length != "") {
-    // parser error - ignoring payload
-//    return callback(err, 0, 1);
-  }
-    return EngineIOPacket::NONE;
+        // advance cursor
+        i += length;
+        length = 0;
+        hasLength = false;
+    }
+
+    if (hasLength) {
+        // parser error - ignoring payload
+        callback(EngineIOPacket::ERROR, 0, 1);
+    }
 }
 
 /**
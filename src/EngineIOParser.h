@@ -29,6 +29,34 @@ uint8_t getProtocolVersion();
 
 Value encodePacket(const EngineIOPacket& packet, bool supportsBinary, bool utf8encode);
 
+/**
+ * A packet encoded for a gather write: the type byte, then the data left
+ * where it is in the packet, unless it had to be base64 encoded.
+ */
+
+struct PacketSlices
+{
+    uint8_t header;
+    IOVec data;
+    bool binary;
+
+    // holds `data` for base64 encoded binary
+    std::string base64;
+
+    size_t length() const { return 1 + data.length; }
+};
+
+/**
+ * Encodes a packet like `encodePacket` without `utf8encode`, but without
+ * copying its data into a new Buffer or string. `encoded` borrows from
+ * `packet`, and can be reused for the next one.
+ *
+ * @return {Boolean} false for an unknown packet type
+ * @api private
+ */
+
+bool encodePacket(const EngineIOPacket& packet, bool supportsBinary, PacketSlices& encoded);
+
 /**
  * Decodes a packet. Data also available as an ArrayBuffer if requested.
  *
@@ -51,20 +79,42 @@ EngineIOPacket decodePacket(const Value& data, bool utf8decode);
  * If any contents are binary, they will be encoded as base64 strings. Base64
  * encoded strings are marked with a b before the length specifier
  *
+ * With `supportsBinary` the payload is a Buffer in the binary framing
+ * instead, see decodePayload. Lengths count bytes.
+ *
  * @param {Array} packets
+ * @param {Number} number of packets
  * @api private
  */
 
-Value encodePayload(const std::vector<EngineIOPacket>& packet, bool supportsBinary);
+Value encodePayload(const EngineIOPacket* packets, size_t count, bool supportsBinary);
+inline Value encodePayload(const std::vector<EngineIOPacket>& packets, bool supportsBinary) { return encodePayload(packets.data(), packets.size(), supportsBinary); }
+
+/**
+ * Called for each packet of a payload, with the number of bytes decoded
+ * so far and the payload size (`index == total` for the last packet).
+ * Return false to stop decoding.
+ */
+
+using PayloadCallback = std::function<bool(const EngineIOPacket& packet, size_t index, size_t total)>;
 
 /*
  * Decodes data when a payload is maybe expected. Possible binary contents are
  * decoded from their base64 representation
  *
+ * Strings use the `<length>:data` framing, Buffers the binary one:
+ *
+ *     <0 = string, 1 = binary><length digits as bytes 0-9><255><data>
+ *
+ * Packets are handed to `callback` as they are found, in a single pass and
+ * without copying the payload; binary packet data shares its storage.
+ * A malformed payload calls `callback(EngineIOPacket::ERROR, 0, 1)` and
+ * stops.
+ *
  * @param {String} data, callback method
  * @api public
  */
 
-EngineIOPacket decodePayload(const Value& data);
+void decodePayload(const Value& data, const PayloadCallback& callback);
 
 }} //namespace engineio { namespace parser {
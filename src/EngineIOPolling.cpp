@@ -61,34 +61,38 @@ void EngineIOPolling::poll()
   debug("polling");
   _polling = true;
   doPoll();
-  emit("poll");
+  emit(EventId::POLL);
 }
 
 void EngineIOPolling::onData(const Value& data)
 {
   debug("polling got data %s", data.toString().c_str());
 
-    // decode payload
-    EngineIOPacket packet = engineio::parser::decodePayload(data);
-    // if its the first message we consider the transport open
-    if (ReadyState::OPENING == _readyState) {
-        onOpen();
-    }
+    auto callback = [this](const EngineIOPacket& packet, size_t index, size_t total) {
+        // if its the first message we consider the transport open
+        if (ReadyState::OPENING == _readyState) {
+            onOpen();
+        }
 
-    // if its a close packet, we close the ongoing requests
-    if ("close" == packet.type) {
-        onClose();
-        return;
-    }
+        // if its a close packet, we close the ongoing requests
+        if ("close" == packet.type) {
+            onClose();
+            return false;
+        }
+
+        // otherwise bypass onData and handle the message
+        onPacket(packet);
+        return true;
+    };
 
-    // otherwise bypass onData and handle the message
-    onPacket(packet);
+    // decode payload
+    engineio::parser::decodePayload(data, callback);
 
     // if an event did not trigger closing
     if (ReadyState::CLOSED != _readyState) {
         // if we got data we're not polling
         _polling = false;
-        emit("pollComplete");
+        emit(EventId::POLL_COMPLETE);
 
         if (ReadyState::OPENED == _readyState) {
             poll();
@@ -102,11 +106,9 @@ void EngineIOPolling::doClose()
 {
   auto close = [this](const Value&) {
     debug("writing close packet");
-      std::vector<EngineIOPacket> packets;
       EngineIOPacket p;
       p.type = "close";
-      packets.push_back(p);
-      write(packets);
+      write(&p, 1);
   };
 
     if (ReadyState::OPENED == _readyState) {
@@ -120,15 +122,15 @@ void EngineIOPolling::doClose()
     }
 }
 
-bool EngineIOPolling::write(const std::vector<EngineIOPacket>& packets)
+bool EngineIOPolling::write(const EngineIOPacket* packets, size_t count)
 {
   _writable = false;
   auto callbackfn = [this](const Value&) {
     _writable = true;
-    emit("drain");
+    emit(EventId::DRAIN);
   };
 
-  const Value& data = engineio::parser::encodePayload(packets, _supportsBinary);
+  const Value& data = engineio::parser::encodePayload(packets, count, _supportsBinary);
   doWrite(data, callbackfn);
     return true;
 }
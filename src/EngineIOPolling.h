@@ -33,7 +33,7 @@ public:
      * @api private
      */
 
-    virtual bool write(const std::vector<EngineIOPacket>& packets) override;
+    virtual bool write(const EngineIOPacket* packets, size_t count) override;
 
     virtual const std::string& getName() const override;
     /**
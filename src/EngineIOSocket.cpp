@@ -2,9 +2,30 @@
 #include "EngineIOParser.h"
 #include "EngineIOTransport.h"
 #include "IOUtils.h"
+#include "IOHeartbeatMonitor.h"
+#include "IOEventLoop.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 
 static bool __priorWebsocketSuccess = false;
 
+/**
+ * Bytes a packet adds to the write buffer, type byte and payload, near
+ * enough for batching and watermarks.
+ */
+
+static size_t packetSize(const EngineIOPacket& packet)
+{
+  size_t bytes = 1;
+  if (Value::Type::STRING == packet.data.getType())
+    bytes += packet.data.asString().length();
+  else if (Value::Type::BINARY == packet.data.getType())
+    bytes += packet.data.asBuffer().length();
+  return bytes;
+}
+
 EngineIOSocket::EngineIOSocket(const std::string& uri, const Opts& opts)
 {
 //  if (uri) {
@@ -78,6 +99,39 @@ EngineIOSocket::EngineIOSocket(const std::string& uri, const Opts& opts)
 //    }
 //  }
 //
+  _perMessageDeflate = opts.perMessageDeflate;
+  _upgrade = true;
+  if (opts.transports.empty()) {
+    _transports.push_back("polling");
+    _transports.push_back("websocket");
+  } else {
+    _transports = opts.transports;
+  }
+  _readyState = ReadyState::NONE;
+  _rememberUpgrade = false;
+  _upgrading = false;
+  _onlyBinaryUpgrades = false;
+  _supportsBinary = true;
+
+  _prevBufferLen = 0;
+  _queued = 0;
+  _groupOpen = false;
+  _groupLane = Priority::EVENT;
+
+  _coalesce = opts.coalesce;
+  _coalesceDelay = std::max(opts.coalesceDelay, 0);
+  _coalesceBytes = opts.coalesceBytes;
+  _pendingBytes = 0;
+  _flushScheduled = false;
+  _flushTimer = INVALID_TIMER_HANDLE;
+  _alive = std::make_shared<bool>(true);
+  memset(&_flushStats, 0, sizeof(_flushStats));
+
+  _highWaterMark = opts.highWaterMark;
+  _lowWaterMark = _highWaterMark > 0 ? std::min(opts.lowWaterMark, _highWaterMark - 1) : 0;
+  _bufferedBytes = 0;
+  _needWritable = false;
+
   // set on handshake
   _id = "";
   _upgrades.clear();
@@ -91,6 +145,15 @@ EngineIOSocket::EngineIOSocket(const std::string& uri, const Opts& opts)
   open();
 }
 
+EngineIOSocket::~EngineIOSocket()
+{
+  // the timers call back into this socket
+  clearTimeout(_pingIntervalTimer);
+  clearTimeout(_flushTimer);
+  if (_heartbeat)
+    _heartbeat->unwatch(_pingTimeoutTimer);
+}
+
 int EngineIOSocket::getProtocolVersion() const
 {
     return engineio::parser::getProtocolVersion();
@@ -120,6 +183,7 @@ std::shared_ptr<EngineIOTransport> EngineIOSocket::createTransport(const std::st
         query["sid"] = _id;
 
     ValueObject opts;
+    opts["perMessageDeflate"] = _perMessageDeflate;
     auto transport = EngineIOTransport::create(name, opts);
 //  auto transport = new transports[name]({
 //    agent: this.agent,
@@ -170,7 +234,7 @@ void EngineIOSocket::open()
   } else if (_transports.empty()) {
     // Emit error on next tick so it can be listened to
     setTimeout([this]() {
-      this->emit("error", "No transports available");
+      this->emit(EventId::ERROR, "No transports available");
     }, 0);
     return;
   } else {
@@ -204,12 +268,11 @@ void EngineIOSocket::setTransport(std::shared_ptr<EngineIOTransport> transport)
   _transport = transport;
 
   // set up transport listeners
-  transport->on("drain", [this](const Value&) {
+  transport->on<>(EventId::DRAIN, [this]() {
     this->onDrain();
   });
 
-  transport->on("packet", [this](const Value& v) {
-      const EngineIOPacket& packet = v.asEngineIOPacket();
+  transport->on<EngineIOPacket>(EventId::PACKET, [this](const EngineIOPacket& packet) {
       this->onPacket(packet);
   });
 
@@ -217,7 +280,7 @@ void EngineIOSocket::setTransport(std::shared_ptr<EngineIOTransport> transport)
 //cjh    this->onError(e);
   });
 
-  transport->on("close", [this](const Value&) {
+  transport->on<>(EventId::CLOSE, [this]() {
       this->onClose("transport close", "");
   });
 }
@@ -254,11 +317,9 @@ void EngineIOSocket::probe(const std::string& name)
       packets.push_back(std::move(p));
       transport->send(packets);
 
-    transport->once("packet", [=](const Value& msg) {
+    transport->once<EngineIOPacket>(EventId::PACKET, [=](const EngineIOPacket& packet) {
       if (*failed) return;
 
-        const EngineIOPacket& packet = msg.asEngineIOPacket();
-
       if ("pong" == packet.type && "probe" == packet.data.asString()) {
         debug("probe transport %s pong", name.c_str());
         _upgrading = true;
@@ -279,7 +340,7 @@ void EngineIOSocket::probe(const std::string& name)
             p2.type = "upgrade";
 
             std::vector<EngineIOPacket> ps;
-            ps.push_back(p2);
+            ps.push_back(std::move(p2));
 
             transport->send(ps);
 //cjh          emit("upgrade", transport);
@@ -353,7 +414,7 @@ void EngineIOSocket::onOpen()
   debug("socket open");
   _readyState = ReadyState::OPENED;
   __priorWebsocketSuccess = "websocket" == _transport->getName();
-  emit("open");
+  emit(EventId::OPEN);
   flush();
 
   // we check for `readyState` in case an `open`
@@ -371,25 +432,26 @@ void EngineIOSocket::onPacket(const EngineIOPacket& packet)
 {
   if (ReadyState::OPENING == _readyState || ReadyState::OPENED == _readyState ||
       ReadyState::CLOSING == _readyState) {
-    debug("socket receive: type %s, data %s", packet.type.c_str(), packet.data.toString().c_str());
+    debug("socket receive: type %s, data %s", packet.type.c_str(), packet.data.isValid() ? packet.data.toString().c_str() : "");
 
 //cjh    emit("packet", packet);
 
     // Socket is live - any packet counts
-    emit("heartbeat");
+    emit(EventId::HEARTBEAT);
+    onHeartbeat(_pingInterval + _pingTimeout);
 
       if (packet.type == "open") {
         onHandshake(parsejson(packet.data.asString()));
       } else if (packet.type == "pong") {
         setPing();
-        emit("pong");
+        emit(EventId::PONG);
       } else if (packet.type == "error") {
 //        var err = new Error("server error");
 //        err.code = packet.data;
 //        this.onError(err);
       } else if (packet.type == "message") {
-        emit("data", packet.data);
-        emit("message", packet.data);
+        emit(EventId::DATA, packet.data);
+        emit(EventId::MESSAGE, packet.data);
       }
   } else {
     debug("packet received with socket readyState %d", _readyState);
@@ -398,7 +460,7 @@ void EngineIOSocket::onPacket(const EngineIOPacket& packet)
 
 void EngineIOSocket::onHandshake(const ValueObject& data)
 {
-    emit("handshake", data);
+    emit(EventId::HANDSHAKE, data);
     _id = data.at("sid").asString();
     _transport->_query["sid"] = _id;
     _upgrades = filterUpgrades(data.at("upgrades").asArray());
@@ -411,18 +473,22 @@ void EngineIOSocket::onHandshake(const ValueObject& data)
 
     setPing();
     // Prolong liveness of socket on heartbeat
-    off("heartbeat", _heartbeatId);
-    on("heartbeat", std::bind(&EngineIOSocket::onHeartbeat, this, std::placeholders::_1), ID(&_heartbeatId));
+    if (!_heartbeat) {
+      _heartbeat = HeartbeatMonitor::get();
+      _pingTimeoutTimer = _heartbeat->watch([this] () {
+        _pingTimeoutTimer = INVALID_TIMER_HANDLE;
+        if (ReadyState::CLOSED == _readyState)
+          return;
+        onClose("ping timeout", "");
+      });
+    }
 }
 
-void EngineIOSocket::onHeartbeat(const Value& timeout)
+void EngineIOSocket::onHeartbeat(long timeout)
 {
-  clearTimeout(_pingTimeoutTimer);
-  _pingTimeoutTimer = setTimeout([=] () {
-    if (ReadyState::CLOSED == _readyState)
-      return;
-    onClose("ping timeout", "");
-  }, timeout.getType() == Value::Type::INTEGER ? timeout.asInt() : (_pingInterval + _pingTimeout));
+  // only records the deadline, no timer is touched per packet
+  if (_heartbeat)
+    _heartbeat->touch(_pingTimeoutTimer, timeout);
 }
 
 void EngineIOSocket::setPing()
@@ -431,67 +497,190 @@ void EngineIOSocket::setPing()
   _pingIntervalTimer = setTimeout([=] () {
     debug("writing ping packet - expecting pong within %ldms", _pingTimeout);
     ping();
-    onHeartbeat(Value((int)_pingTimeout));
+    onHeartbeat(_pingTimeout);
   }, _pingInterval);
 }
 
 void EngineIOSocket::ping()
 {
     sendPacket("ping", Value::NONE, ValueObject(), [this](const Value& unused) {
-        emit("ping");
+        emit(EventId::PING);
     });
 }
 
 void EngineIOSocket::onDrain()
 {
-  _writeBuffer.erase(_writeBuffer.begin(), _writeBuffer.begin() + _prevBufferLen);
+  // the slots are reused by later packets, payloads go now
+  for (size_t i = 0; i < _prevBufferLen; i++) {
+    _bufferedBytes -= packetSize(_writeBuffer[i]);
+    _writeBuffer[i].data = Value();
+    _writeBuffer[i].options.clear();
+  }
+  _writeBuffer.pop(_prevBufferLen);
 
   // setting prevBufferLen = 0 is very important
   // for example, when upgrading, upgrade packet is sent over,
   // and a nonzero prevBufferLen could cause problems on `drain`
   _prevBufferLen = 0;
 
-  if (_writeBuffer.empty()) {
-    emit("drain");
+  // packets sent from the listener are flushed below
+  if (_needWritable && _bufferedBytes <= _lowWaterMark) {
+    _needWritable = false;
+    emit(EventId::WRITABLE);
+  }
+
+  if (_writeBuffer.empty() && 0 == _queued) {
+    emit(EventId::DRAIN);
   } else {
     flush();
   }
 }
 
+size_t EngineIOSocket::takeLane(Priority lane)
+{
+  RingBuffer<EngineIOPacket>& queue = _lanes[(int)lane];
+  size_t budget = Priority::BULK == lane ? BULK_CHUNK : SIZE_MAX;
+  size_t bytes = 0;
+  while (!queue.empty()) {
+    EngineIOPacket& packet = queue.front();
+    size_t size = packetSize(packet);
+    // the first always goes, a packet bigger than a chunk goes alone
+    if (bytes > 0 && bytes + size > budget)
+      break;
+    bytes += size;
+    if (Priority::CONTROL != lane) {
+      auto continued = packet.options.find("continued");
+      _groupOpen = continued != packet.options.end() && continued->second.asBool();
+      _groupLane = lane;
+    }
+    _writeBuffer.push() = std::move(packet);
+    queue.pop();
+    _queued--;
+  }
+  return bytes;
+}
+
 void EngineIOSocket::flush()
 {
   if (ReadyState::CLOSED != _readyState && _transport->isWritable() &&
-    !_upgrading && !_writeBuffer.empty()) {
+    !_upgrading && (!_writeBuffer.empty() || _queued > 0)) {
+    // the parts of a binary socket.io packet stay together, only engine
+    // packets may come between the writes they are split over
+    size_t bytes = takeLane(Priority::CONTROL);
+    if (_groupOpen) {
+      if (_lanes[(int)_groupLane].empty())
+        _groupOpen = false; // the rest was dropped, closing
+      else
+        bytes += takeLane(_groupLane);
+    }
+    for (Priority lane : { Priority::ACK, Priority::EVENT, Priority::BULK }) {
+      if (_groupOpen) break;
+      bytes += takeLane(lane);
+    }
+    if (_writeBuffer.empty()) return;
+
     debug("flushing %d packets in socket", (int)_writeBuffer.size());
-    _transport->send(_writeBuffer);
+
+    uint64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - _pendingSince).count();
+    _flushStats.writes++;
+    _flushStats.packets += _writeBuffer.size();
+    _flushStats.bytes += bytes;
+    _flushStats.totalDelay += delay;
+    _flushStats.maxDelay = std::max(_flushStats.maxDelay, delay);
+    _pendingBytes = bytes < _pendingBytes ? _pendingBytes - bytes : 0;
+
+    _transport->send(_writeBuffer.linearize(), _writeBuffer.size());
     // keep track of current length of writeBuffer
     // splice writeBuffer and callbackBuffer on `drain`
     _prevBufferLen = _writeBuffer.size();
-    emit("flush");
+    emit(EventId::FLUSH);
   }
 }
 
 // write
-void EngineIOSocket::send(const Value& msg, const ValueObject& options, const ValueFunction& fn)
+bool EngineIOSocket::send(const Value& msg, const ValueObject& options, const ValueFunction& fn)
+{
+    return sendPacket("message", msg, options, fn);
+}
+
+bool EngineIOSocket::send(Value&& msg, const ValueObject& options, const ValueFunction& fn)
 {
-    sendPacket("message", msg, options, fn);
+    return sendPacket("message", std::move(msg), options, fn);
 }
 
-void EngineIOSocket::sendPacket(const std::string& type, const Value& data, const ValueObject& options, const ValueFunction& fn)
+bool EngineIOSocket::sendPacket(const std::string& type, const Value& data, const ValueObject& options, const ValueFunction& fn)
+{
+    return sendPacket(type, Value(data), options, fn);
+}
+
+bool EngineIOSocket::sendPacket(const std::string& type, Value&& data, const ValueObject& options, const ValueFunction& fn)
 {
   if (ReadyState::CLOSING == _readyState || ReadyState::CLOSED == _readyState) {
-    return;
+    return false;
   }
 
-    EngineIOPacket packet;
+    if (0 == _queued)
+      _pendingSince = std::chrono::steady_clock::now();
+
+    Priority lane = Priority::CONTROL;
+    if ("message" == type) {
+      auto priority = options.find("priority");
+      lane = priority == options.end() ? Priority::EVENT
+        : (Priority)std::min(std::max(priority->second.asInt(), (int)Priority::ACK), (int)Priority::BULK);
+    }
+
+    EngineIOPacket& packet = _lanes[(int)lane].push();
+    _queued++;
     packet.type = type;
-    packet.data = data;
+    packet.data = std::move(data);
     packet.options = options;
 
+    size_t bytes = packetSize(packet);
+    _bufferedBytes += bytes;
+
 //cjh  emit("packetCreate", packet);
-  _writeBuffer.push_back(packet);
   if (fn) once("flush", fn);
-  flush();
+
+  if (_coalesce) {
+    scheduleFlush(bytes);
+  } else {
+    _pendingBytes += bytes;
+    flush();
+  }
+
+  if (writable()) return true;
+  _needWritable = true;
+  return false;
+}
+
+void EngineIOSocket::scheduleFlush(size_t bytes)
+{
+  _pendingBytes += bytes;
+  if (_coalesceBytes > 0 && _pendingBytes >= _coalesceBytes) {
+    flush();
+    return;
+  }
+
+  // an earlier packet's window is already open and closes sooner
+  if (_flushScheduled) return;
+  _flushScheduled = true;
+
+  if (_coalesceDelay > 0) {
+    // timers tick in milliseconds, never close the window early
+    _flushTimer = setTimeout([this] () {
+      _flushTimer = INVALID_TIMER_HANDLE;
+      _flushScheduled = false;
+      flush();
+    }, (_coalesceDelay + 999) / 1000);
+  } else {
+    std::weak_ptr<bool> alive = _alive;
+    getEventLoop()->post([this, alive] () {
+      if (alive.expired()) return;
+      _flushScheduled = false;
+      flush();
+    });
+  }
 }
 //
 void EngineIOSocket::close()
@@ -517,7 +706,7 @@ void EngineIOSocket::close()
   if (ReadyState::OPENING == _readyState || ReadyState::OPENED == _readyState) {
     _readyState = ReadyState::CLOSING;
 
-    if (!_writeBuffer.empty()) {
+    if (!_writeBuffer.empty() || _queued > 0) {
       once("drain", [=](const Value&) {
         if (_upgrading) {
           waitForUpgrade();
@@ -537,7 +726,7 @@ void EngineIOSocket::onError(const std::string& err)
 {
   debug("socket error %s", err.c_str());
   __priorWebsocketSuccess = false;
-  emit("error", err);
+  emit(EventId::ERROR, err);
   onClose("transport error", err);
 }
 
@@ -548,7 +737,9 @@ void EngineIOSocket::onClose(const std::string& reason, const std::string& desc)
 
     // clear timers
     clearTimeout(_pingIntervalTimer);
-    clearTimeout(_pingTimeoutTimer);
+    if (_heartbeat)
+      _heartbeat->unwatch(_pingTimeoutTimer);
+    _pingTimeoutTimer = INVALID_TIMER_HANDLE;
 
     // stop event from firing again for transport
     _transport->off("close");
@@ -569,12 +760,19 @@ void EngineIOSocket::onClose(const std::string& reason, const std::string& desc)
       ValueArray args;
       args.push_back(reason);
       args.push_back(desc);
-      emit("close", args);
+      emit(EventId::CLOSE, std::move(args));
 
     // clean buffers after, so users can still
     // grab the buffers on `close` event
     _writeBuffer.clear();
+    for (auto& lane : _lanes)
+      lane.clear();
+    _queued = 0;
+    _groupOpen = false;
     _prevBufferLen = 0;
+    _pendingBytes = 0;
+    _bufferedBytes = 0;
+    _needWritable = false;
   }
 }
 
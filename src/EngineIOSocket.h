@@ -1,6 +1,11 @@
 #pragma once
 
 #include "Emitter.h"
+#include "IORingBuffer.h"
+
+#include <chrono>
+
+class HeartbeatMonitor;
 
 class EngineIOTransport;
 
@@ -15,6 +20,27 @@ public:
      * @api public
      */
     EngineIOSocket(const std::string& uri, const Opts& opts);
+    virtual ~EngineIOSocket();
+
+    /**
+     * Lanes of the write queue, served in this order. Engine packets
+     * (ping, pong, upgrade...) are CONTROL, messages take the `priority`
+     * option and default to EVENT. BULK goes out at most BULK_CHUNK bytes
+     * per write so the other lanes can get in between.
+     *
+     * Messages with the `continued` option belong with the next one (the
+     * parts of a binary socket.io packet): no other message cuts in until
+     * the last part is written.
+     */
+    enum class Priority
+    {
+        CONTROL,
+        ACK,
+        EVENT,
+        BULK
+    };
+
+    static const size_t BULK_CHUNK = 64 * 1024;
 
     /**
      * Protocol version.
@@ -29,13 +55,46 @@ public:
      * @param {String} message.
      * @param {Function} callback function.
      * @param {Object} options.
-     * @return {Socket} for chaining.
+     * @return {Boolean} false once the bytes queued reach `Opts::highWaterMark`,
+     *   `writable` is emitted when they are down to `Opts::lowWaterMark`
      * @api public
      */
-    void send(const Value& msg, const ValueObject& options = OBJECT_NONE, const ValueFunction& fn = nullptr);
+    bool send(const Value& msg, const ValueObject& options = OBJECT_NONE, const ValueFunction& fn = nullptr);
+    bool send(Value&& msg, const ValueObject& options = OBJECT_NONE, const ValueFunction& fn = nullptr);
+
+    /**
+     * Whether the bytes queued, sent or not, are below the high watermark.
+     *
+     * @api public
+     */
+    bool writable() const { return 0 == _highWaterMark || _bufferedBytes < _highWaterMark; }
+    size_t getBufferedAmount() const { return _bufferedBytes; }
 
     const std::string& getId() const { return _id; }
 
+    /**
+     * Counts of what went to the transport, each write carrying every packet
+     * buffered so far. `delay` is how long the oldest packet of a write
+     * waited in the buffer, which `Opts::coalesce` trades for fewer writes.
+     *
+     * @api public
+     */
+
+    struct FlushStats
+    {
+        uint64_t writes;
+        uint64_t packets;
+        uint64_t bytes;
+        uint64_t totalDelay; // microseconds
+        uint64_t maxDelay;   // microseconds
+
+        double averagePackets() const { return writes ? (double)packets / writes : 0; }
+        double averageBytes() const { return writes ? (double)bytes / writes : 0; }
+        double averageDelay() const { return writes ? (double)totalDelay / writes : 0; }
+    };
+
+    const FlushStats& getFlushStats() const { return _flushStats; }
+
 
 
     /**
@@ -95,6 +154,24 @@ private:
      */
     void flush();
 
+    /**
+     * Arranges for a flush once the coalescing window of the packet just
+     * buffered closes, or flushes now if the byte limit is reached.
+     *
+     * @param {Number} bytes the packet adds
+     * @api private
+     */
+    void scheduleFlush(size_t bytes);
+
+    /**
+     * Moves packets of `lane` behind the write buffer, BULK_CHUNK bytes at
+     * most for BULK.
+     *
+     * @return {Number} bytes moved
+     * @api private
+     */
+    size_t takeLane(Priority lane);
+
     /**
      * Sends a packet.
      *
@@ -104,7 +181,8 @@ private:
      * @param {Function} callback function.
      * @api private
      */
-    void sendPacket(const std::string& type, const Value& data, const ValueObject& options, const ValueFunction& fn);
+    bool sendPacket(const std::string& type, const Value& data, const ValueObject& options, const ValueFunction& fn);
+    bool sendPacket(const std::string& type, Value&& data, const ValueObject& options, const ValueFunction& fn);
 
     /**
      * Called upon transport close.
@@ -141,12 +219,12 @@ private:
     void onHandshake(const ValueObject& data);
 
     /**
-     * Resets ping timeout.
+     * Resets ping timeout to `timeout` ms from now.
      *
      * @api private
      */
 
-    void onHeartbeat(const Value& timeout);
+    void onHeartbeat(long timeout);
 
     /**
      * Pings server every `this.pingInterval` and expects response
@@ -179,7 +257,15 @@ private:
     std::vector<std::string> _transports;
     std::vector<std::string> _upgrades;
 
-    std::vector<EngineIOPacket> _writeBuffer;
+    // the packets of the last write, until the transport drains
+    RingBuffer<EngineIOPacket> _writeBuffer;
+
+    // packets waiting for a write, by Priority
+    RingBuffer<EngineIOPacket> _lanes[4];
+    size_t _queued;
+    // the last packet written had `continued`, its lane goes on first
+    bool _groupOpen;
+    Priority _groupLane;
 
     std::shared_ptr<EngineIOTransport> _transport;
 
@@ -192,19 +278,41 @@ private:
     bool _upgrade;
 
     TimerHandle _pingIntervalTimer;
+
+    // ping timeout, watched by the monitor shared by all sockets so
+    // packets don't re-arm a timer each
+    std::shared_ptr<HeartbeatMonitor> _heartbeat;
     TimerHandle _pingTimeoutTimer;
 
     long _pingInterval;
     long _pingTimeout;
 
-    ListenerId _heartbeatId;
-
     size_t _prevBufferLen;
     bool _onlyBinaryUpgrades;
     bool _perMessageDeflate;
 
     bool _supportsBinary;
 
+    // coalescing, see Opts
+    bool _coalesce;
+    int _coalesceDelay;
+    size_t _coalesceBytes;
+    size_t _pendingBytes;
+    bool _flushScheduled;
+    TimerHandle _flushTimer;
+    // dropped with the socket so a flush posted to the loop is skipped
+    std::shared_ptr<bool> _alive;
+
+    // backpressure, bytes of every packet in _writeBuffer
+    size_t _highWaterMark;
+    size_t _lowWaterMark;
+    size_t _bufferedBytes;
+    bool _needWritable;
+
+    // when the oldest packet not yet written was buffered
+    std::chrono::steady_clock::time_point _pendingSince;
+    FlushStats _flushStats;
+
     // Listener Ids
     ListenerId _idOnTransportOpen;
     ListenerId _idOnerror;
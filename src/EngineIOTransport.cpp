@@ -103,10 +103,10 @@ void EngineIOTransport::close()
  * @api private
  */
 
-bool EngineIOTransport::send(const std::vector<EngineIOPacket>& packets)
+bool EngineIOTransport::send(const EngineIOPacket* packets, size_t count)
 {
     if (ReadyState::OPENED == _readyState) {
-        return write(packets);
+        return write(packets, count);
     }
     return false;
 }
@@ -121,7 +121,7 @@ void EngineIOTransport::onOpen()
 {
     _readyState = ReadyState::OPENED;
     _writable = true;
-    emit("open");
+    emit(EventId::OPEN);
 }
 
 /**
@@ -143,7 +143,7 @@ void EngineIOTransport::onData(const Value& data)
 
 void EngineIOTransport::onPacket(const EngineIOPacket& packet)
 {
-    emit("packet", packet);
+    emit<EngineIOPacket>(EventId::PACKET, packet);
 }
 
 /**
@@ -155,7 +155,7 @@ void EngineIOTransport::onPacket(const EngineIOPacket& packet)
 void EngineIOTransport::onClose()
 {
     _readyState = ReadyState::CLOSED;
-    emit("close");
+    emit(EventId::CLOSE);
 }
 
 //}} // namespace socketio { namespace transport {
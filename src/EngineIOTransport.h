@@ -14,7 +14,8 @@ public:
 
     bool open();
     void close();
-    bool send(const std::vector<EngineIOPacket>& packets);
+    bool send(const EngineIOPacket* packets, size_t count);
+    bool send(const std::vector<EngineIOPacket>& packets) { return send(packets.data(), packets.size()); }
     virtual void pause(const std::function<void()>& fn) = 0;
 
     bool isWritable() const { return _writable; }
@@ -29,10 +30,10 @@ public:
      * Writes a packets payload.
      *
      * @param {Array} data packets
-     * @param {Function} drain callback
+     * @param {Number} number of packets
      * @api private
      */
-    virtual bool write(const std::vector<EngineIOPacket>& packets) = 0;
+    virtual bool write(const EngineIOPacket* packets, size_t count) = 0;
     virtual bool doOpen() = 0;
     virtual void doClose() = 0;
     virtual const std::string& getName() const = 0;
@@ -2,20 +2,41 @@
 #include "IOUtils.h"
 #include "EngineIOParser.h"
 
+// packets smaller than this aren't worth deflating
+static const size_t DEFAULT_DEFLATE_THRESHOLD = 1024;
 
 EngineIOWebSocket::EngineIOWebSocket(const ValueObject& opts)
 : EngineIOTransport(opts)
+, _drainTimer(INVALID_TIMER_HANDLE)
+, _waitingDrain(false)
 {
-  bool forceBase64 = opts.at("forceBase64").asBool();
-  if (forceBase64) {
-    _supportsBinary = false;
+  auto forceBase64 = opts.find("forceBase64");
+  _supportsBinary = forceBase64 == opts.end() || !forceBase64->second.asBool();
+
+  // `true`, or an object with the `threshold` to compress from
+  _perMessageDeflate = false;
+  _threshold = DEFAULT_DEFLATE_THRESHOLD;
+  auto perMessageDeflate = opts.find("perMessageDeflate");
+  if (perMessageDeflate != opts.end())
+  {
+    if (perMessageDeflate->second.getType() == Value::Type::OBJECT)
+    {
+      const ValueObject& deflateOpts = perMessageDeflate->second.asObject();
+      auto threshold = deflateOpts.find("threshold");
+      if (threshold != deflateOpts.end())
+        _threshold = (size_t)std::max(threshold->second.asInt(), 0);
+      _perMessageDeflate = true;
+    }
+    else
+    {
+      _perMessageDeflate = perMessageDeflate->second.asBool();
+    }
   }
-  _perMessageDeflate = opts.at("perMessageDeflate").asBool();
 }
 
 EngineIOWebSocket::~EngineIOWebSocket()
 {
-  
+  clearTimeout(_drainTimer);
 }
 
 /**
@@ -66,18 +87,17 @@ bool EngineIOWebSocket::doOpen()
 //  }
 
     _ws = getWebSocketFactory()->create();
+    _ws->perMessageDeflate = _perMessageDeflate;
 
     std::string uri;
     std::vector<std::string> protocols;
 
     bool r = _ws->open(uri, protocols, "");
     if (!r) {
-        emit("error");
+        emit(EventId::ERROR);
         return false;
     }
 
-    _supportsBinary = true;
-
     addEventListeners();
 
     return true;
@@ -93,13 +113,20 @@ void EngineIOWebSocket::addEventListeners()
       onClose();
     };
 
-    _ws->onmessage = [this](const Buffer& ev) {
+    _ws->onmessage = [this](const Value& ev) {
       onData(ev);
     };
 
     _ws->onerror = [this](const std::string& e) {
         onError("websocket error", e);
     };
+
+    _ws->ondrain = [this]() {
+      if (_waitingDrain) {
+        _waitingDrain = false;
+        drain();
+      }
+    };
 }
 
 void EngineIOWebSocket::pause(const std::function<void()>& fn)
@@ -107,30 +134,44 @@ void EngineIOWebSocket::pause(const std::function<void()>& fn)
 //cjh
 }
 
-bool EngineIOWebSocket::write(const std::vector<EngineIOPacket>& packets)
+bool EngineIOWebSocket::write(const EngineIOPacket* packets, size_t count)
 {
   _writable = false;
 
     auto done = [this]() {
-        emit("flush");
-
-        // fake drain
-        // defer to next tick to allow Socket to clear writeBuffer
-        setTimeout([this]() {
-            _writable = true;
-            emit("drain");
-        }, 0);
+        emit(EventId::FLUSH);
+
+        // what the socket couldn't take yet holds the next write back, so
+        // packets queued meanwhile can still be reordered by priority
+        if (_ws->getBufferedAmount() > 0) {
+            _waitingDrain = true;
+        } else {
+            drain();
+        }
     };
 
   // encodePacket efficient as it uses WS framing
   // no need for encodePayload
-    for (const auto& packet : packets)
+    // packets go out as type byte + data slices, each held back until the
+    // next one is known so all but the last can say `more` and the batch
+    // leaves in one write
+    engineio::parser::PacketSlices encoded[2];
+    const EngineIOPacket* pending = nullptr;
+    int current = 0;
+    for (size_t i = 0; i < count; i++)
     {
-        Value encodedPacket = engineio::parser::encodePacket(packet, _supportsBinary, false);
-        _ws->send(encodedPacket);
+        if (!engineio::parser::encodePacket(packets[i], _supportsBinary, encoded[current]))
+            continue;
+
+        if (pending)
+            sendEncoded(*pending, encoded[current ^ 1], true);
+        pending = &packets[i];
+        current ^= 1;
     }
+    if (pending)
+        sendEncoded(*pending, encoded[current ^ 1], false);
 
-    if (!packets.empty())
+    if (count > 0)
     {
         done();
     }
@@ -138,6 +179,29 @@ bool EngineIOWebSocket::write(const std::vector<EngineIOPacket>& packets)
     return true;
 }
 
+void EngineIOWebSocket::drain()
+{
+    // defer to next tick to allow Socket to clear writeBuffer
+    _drainTimer = setTimeout([this]() {
+        _drainTimer = INVALID_TIMER_HANDLE;
+        _writable = true;
+        emit(EventId::DRAIN);
+    }, 0);
+}
+
+void EngineIOWebSocket::sendEncoded(const EngineIOPacket& packet, const engineio::parser::PacketSlices& encoded, bool more)
+{
+    bool compress = false;
+    if (_perMessageDeflate)
+    {
+        auto option = packet.options.find("compress");
+        compress = encoded.length() >= _threshold && (option == packet.options.end() || option->second.asBool());
+    }
+
+    IOVec slices[2] = { { &encoded.header, 1 }, encoded.data };
+    _ws->sendv(slices, encoded.data.length > 0 ? 2 : 1, encoded.binary, compress, more);
+}
+
 void EngineIOWebSocket::onClose()
 {
     EngineIOTransport::onClose();
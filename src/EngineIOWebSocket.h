@@ -1,6 +1,7 @@
 #pragma once
 
 #include "EngineIOTransport.h"
+#include "EngineIOParser.h"
 
 class IWebSocket;
 
@@ -12,7 +13,7 @@ public:
 
     virtual const std::string& getName() const override;
     virtual void pause(const std::function<void()>& fn) override;
-    virtual bool write(const std::vector<EngineIOPacket>& packets) override;
+    virtual bool write(const EngineIOPacket* packets, size_t count) override;
     virtual void onClose() override;
     virtual bool doOpen() override;
     virtual void doClose() override;
@@ -26,8 +27,26 @@ private:
      */
     void addEventListeners();
 
+    /**
+     * Sends one packet encoded by `write`, `more` if others follow.
+     *
+     * @api private
+     */
+    void sendEncoded(const EngineIOPacket& packet, const engineio::parser::PacketSlices& encoded, bool more);
+
+    /**
+     * Emits `drain` on the next tick.
+     *
+     * @api private
+     */
+    void drain();
+
     std::shared_ptr<IWebSocket> _ws;
 
     bool _supportsBinary;
     bool _perMessageDeflate;
+    size_t _threshold;
+    TimerHandle _drainTimer;
+    // the last write is still in the websocket's buffer
+    bool _waitingDrain;
 };
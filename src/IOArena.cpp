@@ -0,0 +1,131 @@
+#include "IOArena.h"
+#include "IOTypes.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <algorithm>
+
+namespace {
+
+class NewDeleteResource : public MemoryResource
+{
+public:
+    virtual void* allocate(size_t bytes, size_t alignment) override
+    {
+        // operator new aligns for any scalar type, and no Value asks more
+        assert(alignment <= alignof(max_align_t));
+        (void)alignment;
+        return ::operator new(bytes);
+    }
+
+    virtual void deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        (void)bytes;
+        (void)alignment;
+        ::operator delete(p);
+    }
+};
+
+} // namespace {
+
+MemoryResource* getDefaultMemoryResource()
+{
+    static NewDeleteResource __resource;
+    return &__resource;
+}
+
+///
+
+Arena::Arena(size_t initialSize)
+: _blocks(nullptr)
+, _cursor(nullptr)
+, _end(nullptr)
+, _initialSize(std::max(initialSize, (size_t)64))
+, _nextSize(_initialSize)
+, _bytesUsed(0)
+, _live(0)
+, _holding(false)
+{
+
+}
+
+Arena::~Arena()
+{
+    while (_blocks)
+    {
+        Block* next = _blocks->next;
+        free(_blocks);
+        _blocks = next;
+    }
+}
+
+void Arena::addBlock(size_t minSize)
+{
+    size_t size = std::max(_nextSize, minSize + sizeof(Block) + alignof(max_align_t));
+    Block* block = (Block*) malloc(size);
+    block->next = _blocks;
+    block->size = size;
+    _blocks = block;
+
+    _cursor = (uint8_t*)(block + 1);
+    _end = (uint8_t*)block + size;
+
+    // grow geometrically so big trees need few blocks
+    _nextSize = size * 2;
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t p = ((uintptr_t)_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (_cursor == nullptr || p + bytes > (uintptr_t)_end)
+    {
+        addBlock(bytes + alignment);
+        p = ((uintptr_t)_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    _cursor = (uint8_t*)(p + bytes);
+    _bytesUsed += bytes;
+    ++_live;
+    return (void*)p;
+}
+
+void Arena::deallocate(void* p, size_t bytes, size_t alignment)
+{
+    // monotonic, memory comes back on release()
+    (void)p;
+    (void)bytes;
+    (void)alignment;
+    --_live;
+}
+
+bool Arena::release()
+{
+    if (_live != 0)
+    {
+        if (!_holding)
+            debug("arena not released, %zu allocations outlived their packet; copy what you keep\n", _live);
+        _holding = true;
+        return false;
+    }
+    _holding = false;
+
+    if (_blocks == nullptr)
+        return true;
+
+    // keep the newest (largest) block so the next packet of a similar size
+    // fits in a single block
+    Block* block = _blocks->next;
+    while (block)
+    {
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+    _blocks->next = nullptr;
+
+    _cursor = (uint8_t*)(_blocks + 1);
+    _end = (uint8_t*)_blocks + _blocks->size;
+    _nextSize = _blocks->size * 2;
+    _bytesUsed = 0;
+    return true;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <new>
+
+class Value;
+
+/**
+ * Source of memory for Value trees, modelled after
+ * std::pmr::memory_resource.
+ */
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() {}
+
+    virtual void* allocate(size_t bytes, size_t alignment) = 0;
+    virtual void deallocate(void* p, size_t bytes, size_t alignment) = 0;
+};
+
+/**
+ * The resource used when nothing else is requested (plain new/delete).
+ */
+MemoryResource* getDefaultMemoryResource();
+
+/**
+ * Monotonic bump allocator. Every allocation is carved out of a few large
+ * blocks and `deallocate` is a no-op; everything is freed in one shot by
+ * `release()`, which keeps the first block around for the next round.
+ *
+ * Typical use is one arena per decoded packet: build the whole tree in it,
+ * hand it to the listeners, then release.
+ */
+class Arena : public MemoryResource
+{
+public:
+    explicit Arena(size_t initialSize = 4096);
+    virtual ~Arena();
+
+    virtual void* allocate(size_t bytes, size_t alignment) override;
+    virtual void deallocate(void* p, size_t bytes, size_t alignment) override;
+
+    /**
+     * Frees everything allocated so far, provided the Values built in the
+     * arena were all destroyed. A tree moved out of the arena (a plain move
+     * keeps its nodes where they are) and kept would be left pointing into
+     * reused memory, so while any is alive nothing is freed: the arena
+     * logs, keeps growing and gives everything back on the first release
+     * after the last of them is gone.
+     *
+     * The arena itself must outlive every Value built in it.
+     *
+     * @return {Boolean} false if Values built in the arena are still alive
+     */
+    bool release();
+
+    size_t getBytesUsed() const { return _bytesUsed; }
+
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    struct Block
+    {
+        Block* next;
+        size_t size;
+    };
+
+    void addBlock(size_t minSize);
+
+    Block* _blocks;
+    uint8_t* _cursor;
+    uint8_t* _end;
+    size_t _initialSize;
+    size_t _nextSize;
+    size_t _bytesUsed;
+    // allocations not deallocated yet
+    size_t _live;
+    // release refused since the last one that went through, logged once
+    bool _holding;
+};
+
+/**
+ * Allocator used by ValueArray and ValueObject. Like
+ * std::pmr::polymorphic_allocator it forwards to a MemoryResource and
+ * constructs nested Values in the same resource, while copies of a
+ * container fall back to the default resource so they can safely outlive
+ * an arena.
+ */
+template<class T>
+class ValueAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ValueAllocator()
+    : _resource(getDefaultMemoryResource())
+    {}
+
+    ValueAllocator(MemoryResource* resource)
+    : _resource(resource ? resource : getDefaultMemoryResource())
+    {}
+
+    template<class U>
+    ValueAllocator(const ValueAllocator<U>& o)
+    : _resource(o.resource())
+    {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(_resource->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        _resource->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template<class U, class... Args>
+    void construct(U* p, Args&&... args)
+    {
+        construct(std::integral_constant<bool, UsesResource<U, Args...>::value>(), p, std::forward<Args>(args)...);
+    }
+
+    template<class U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+
+    ValueAllocator select_on_container_copy_construction() const
+    {
+        return ValueAllocator();
+    }
+
+    MemoryResource* resource() const { return _resource; }
+
+private:
+    template<class U, class... Args>
+    struct UsesResource : std::false_type {};
+
+    template<class U, class Arg>
+    struct UsesResource<U, Arg> : std::integral_constant<bool,
+        std::is_same<U, Value>::value && std::is_same<typename std::decay<Arg>::type, Value>::value> {};
+
+    template<class U, class... Args>
+    void construct(std::true_type, U* p, Args&&... args)
+    {
+        ::new((void*)p) U(std::forward<Args>(args)..., _resource);
+    }
+
+    template<class U, class... Args>
+    void construct(std::false_type, U* p, Args&&... args)
+    {
+        ::new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    MemoryResource* _resource;
+};
+
+template<class T, class U>
+bool operator==(const ValueAllocator<T>& a, const ValueAllocator<U>& b)
+{
+    return a.resource() == b.resource();
+}
+
+template<class T, class U>
+bool operator!=(const ValueAllocator<T>& a, const ValueAllocator<U>& b)
+{
+    return a.resource() != b.resource();
+}
@@ -0,0 +1,337 @@
+#include "IOBase64.h"
+#include "IOSimd.h"
+
+#include <string.h>
+
+#if IO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace base64 {
+
+namespace {
+
+const char __alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// sextet value of each character, 0xff for anything outside of the alphabet
+struct DecodeTable
+{
+    uint8_t values[256];
+
+    DecodeTable()
+    {
+        memset(values, 0xff, sizeof(values));
+        for (int i = 0; i < 64; ++i)
+            values[(uint8_t)__alphabet[i]] = (uint8_t)i;
+    }
+};
+
+const DecodeTable __decodeTable;
+
+/**
+ * Kernels handle the bulk of the input and return how much of it they
+ * consumed; the scalar loops below finish the rest.
+ */
+
+typedef size_t (*EncodeFunc)(const uint8_t* src, size_t len, char* out);
+
+// returns false on an invalid character, `consumed`/`produced` tell how far
+// it got otherwise
+typedef bool (*DecodeFunc)(const char* src, size_t len, uint8_t* out, size_t outLen, size_t& consumed, size_t& produced);
+
+size_t encodeScalar(const uint8_t*, size_t, char*)
+{
+    return 0;
+}
+
+bool decodeScalar(const char*, size_t, uint8_t*, size_t, size_t& consumed, size_t& produced)
+{
+    consumed = 0;
+    produced = 0;
+    return true;
+}
+
+#if IO_SIMD_X86
+
+// The SIMD kernels follow Wojciech Muła's and Daniel Lemire's "Faster
+// Base64 Encoding and Decoding using AVX2 Instructions": bytes are spread
+// into 6-bit fields with multiplies, and characters are classified with
+// nibble-indexed pshufb tables instead of range compares.
+
+IO_SIMD_TARGET("ssse3")
+inline __m128i encodeSplitSSSE3(__m128i in)
+{
+    // 12 bytes -> 16 sextets, one per byte
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+IO_SIMD_TARGET("ssse3")
+inline __m128i encodeLookupSSSE3(__m128i sextets)
+{
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12; the
+    // table then holds the offset from the sextet to its character
+    __m128i index = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), sextets);
+    index = _mm_or_si128(index, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, index), sextets);
+}
+
+IO_SIMD_TARGET("ssse3")
+size_t encodeSSSE3(const uint8_t* src, size_t len, char* out)
+{
+    size_t i = 0;
+    // 16 bytes are loaded for every 12 consumed
+    for (; i + 16 <= len; i += 12, out += 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)out, encodeLookupSSSE3(encodeSplitSSSE3(in)));
+    }
+    return i;
+}
+
+IO_SIMD_TARGET("ssse3")
+inline bool decodeLookupSSSE3(__m128i in, __m128i& sextets)
+{
+    // a character is valid when the bit of its high nibble is set in the
+    // mask of its low nibble
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    const __m128i masks = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                        (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bits = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(masks, lo), _mm_shuffle_epi8(bits, hi)), _mm_setzero_si128());
+    if (_mm_movemask_epi8(invalid) != 0)
+        return false;
+
+    // offset by high nibble; '+' and '/' share one, '/' needs 3 less
+    const __m128i offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i shift = _mm_shuffle_epi8(offsets, hi);
+    shift = _mm_add_epi8(shift, _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_set1_epi8(-3)));
+    sextets = _mm_add_epi8(in, shift);
+    return true;
+}
+
+IO_SIMD_TARGET("ssse3")
+inline __m128i decodePackSSSE3(__m128i sextets)
+{
+    // 16 sextets -> 12 bytes at the front
+    const __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+IO_SIMD_TARGET("ssse3")
+bool decodeSSSE3(const char* src, size_t len, uint8_t* out, size_t outLen, size_t& consumed, size_t& produced)
+{
+    size_t i = 0, o = 0;
+    // 16 bytes are stored for every 12 produced
+    for (; i + 16 <= len && o + 16 <= outLen; i += 16, o += 12)
+    {
+        __m128i sextets;
+        if (!decodeLookupSSSE3(_mm_loadu_si128((const __m128i*)(src + i)), sextets))
+            return false;
+        _mm_storeu_si128((__m128i*)(out + o), decodePackSSSE3(sextets));
+    }
+    consumed = i;
+    produced = o;
+    return true;
+}
+
+IO_SIMD_TARGET("avx2")
+size_t encodeAVX2(const uint8_t* src, size_t len, char* out)
+{
+    const __m256i split = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // each lane takes 12 of the 24 bytes consumed; the upper load reads 4
+    // bytes past them
+    for (; i + 28 <= len; i += 24, out += 32)
+    {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + i))),
+                                             _mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, split);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i sextets = _mm256_or_si256(t1, t3);
+
+        __m256i index = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets);
+        index = _mm256_or_si256(index, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)out, _mm256_add_epi8(_mm256_shuffle_epi8(offsets, index), sextets));
+    }
+    return i;
+}
+
+IO_SIMD_TARGET("avx2")
+bool decodeAVX2(const char* src, size_t len, uint8_t* out, size_t outLen, size_t& consumed, size_t& produced)
+{
+    const __m256i masks = _mm256_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+                                           (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m256i bits = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+                                          0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i offsets = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0, o = 0;
+    // 32 bytes are stored for every 24 produced
+    for (; i + 32 <= len && o + 32 <= outLen; i += 32, o += 24)
+    {
+        const __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+        const __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+        const __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(masks, lo), _mm256_shuffle_epi8(bits, hi)),
+                                                  _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(invalid) != 0)
+            return false;
+
+        __m256i shift = _mm256_shuffle_epi8(offsets, hi);
+        shift = _mm256_add_epi8(shift, _mm256_and_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), _mm256_set1_epi8(-3)));
+        const __m256i sextets = _mm256_add_epi8(in, shift);
+
+        const __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+        const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        // 12 bytes at the front of each lane, then the lanes joined
+        const __m256i bytes = _mm256_shuffle_epi8(words, pack);
+        _mm256_storeu_si256((__m256i*)(out + o), _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)));
+    }
+    consumed = i;
+    produced = o;
+    return true;
+}
+
+#endif // IO_SIMD_X86
+
+EncodeFunc selectEncode()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return encodeAVX2;
+    if (simd::hasSSSE3())
+        return encodeSSSE3;
+#endif
+    return encodeScalar;
+}
+
+DecodeFunc selectDecode()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return decodeAVX2;
+    if (simd::hasSSSE3())
+        return decodeSSSE3;
+#endif
+    return decodeScalar;
+}
+
+const EncodeFunc __encode = selectEncode();
+const DecodeFunc __decode = selectDecode();
+
+} // namespace {
+
+size_t encodedLength(size_t len)
+{
+    return (len + 2) / 3 * 4;
+}
+
+void encode(const uint8_t* src, size_t len, char* out)
+{
+    size_t i = __encode(src, len, out);
+    out += i / 3 * 4;
+
+    for (; i + 3 <= len; i += 3, out += 4)
+    {
+        uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i + 1] << 8 | src[i + 2];
+        out[0] = __alphabet[v >> 18];
+        out[1] = __alphabet[(v >> 12) & 0x3f];
+        out[2] = __alphabet[(v >> 6) & 0x3f];
+        out[3] = __alphabet[v & 0x3f];
+    }
+
+    if (i < len)
+    {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < len)
+            v |= (uint32_t)src[i + 1] << 8;
+        out[0] = __alphabet[v >> 18];
+        out[1] = __alphabet[(v >> 12) & 0x3f];
+        out[2] = i + 1 < len ? __alphabet[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+}
+
+void encode(const uint8_t* src, size_t len, std::string& out)
+{
+    size_t offset = out.size();
+    out.resize(offset + encodedLength(len));
+    encode(src, len, &out[offset]);
+}
+
+bool decode(const char* src, size_t len, Buffer& out)
+{
+    out = Buffer();
+
+    // padding only ever completes the last group
+    if (len % 4 == 0 && len > 0 && src[len - 1] == '=')
+        len -= src[len - 2] == '=' ? 2 : 1;
+    if (len % 4 == 1)
+        return false;
+
+    size_t outLen = len / 4 * 3 + (len % 4 == 0 ? 0 : len % 4 - 1);
+    if (outLen == 0)
+        return true;
+
+    Buffer decoded(nullptr, outLen);
+    uint8_t* dst = decoded.mutableData();
+
+    size_t i = 0, o = 0;
+    if (!__decode(src, len, dst, outLen, i, o))
+        return false;
+
+    const uint8_t* table = __decodeTable.values;
+    for (; i + 4 <= len; i += 4, o += 3)
+    {
+        uint32_t a = table[(uint8_t)src[i]], b = table[(uint8_t)src[i + 1]];
+        uint32_t c = table[(uint8_t)src[i + 2]], d = table[(uint8_t)src[i + 3]];
+        if ((a | b | c | d) & 0x80)
+            return false;
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        dst[o] = (uint8_t)(v >> 16);
+        dst[o + 1] = (uint8_t)(v >> 8);
+        dst[o + 2] = (uint8_t)v;
+    }
+
+    if (i < len)
+    {
+        // 2 or 3 characters left
+        uint32_t a = table[(uint8_t)src[i]], b = table[(uint8_t)src[i + 1]];
+        uint32_t c = i + 2 < len ? table[(uint8_t)src[i + 2]] : 0;
+        if ((a | b | c) & 0x80)
+            return false;
+        uint32_t v = a << 18 | b << 12 | c << 6;
+        dst[o] = (uint8_t)(v >> 16);
+        if (i + 2 < len)
+            dst[o + 1] = (uint8_t)(v >> 8);
+    }
+
+    out = std::move(decoded);
+    return true;
+}
+
+} // namespace base64 {
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "IOTypes.h"
+
+/**
+ * Standard base64 (RFC 4648, `+/` alphabet, `=` padding), used for binary
+ * packets sent over text-only transports.
+ *
+ * Both directions run 12/24 bytes at a time with SSSE3/AVX2 table lookups
+ * when the CPU has them and fall back to a scalar loop otherwise.
+ */
+
+namespace base64 {
+
+/**
+ * Number of characters `encode` writes for `len` bytes.
+ *
+ * @api public
+ */
+
+size_t encodedLength(size_t len);
+
+/**
+ * Encodes `len` bytes into `out`, which must have room for
+ * encodedLength(len) characters. No NUL is written.
+ *
+ * @api public
+ */
+
+void encode(const uint8_t* src, size_t len, char* out);
+
+/**
+ * Appends the base64 form of `len` bytes to `out`.
+ *
+ * @api public
+ */
+
+void encode(const uint8_t* src, size_t len, std::string& out);
+
+/**
+ * Decodes `len` characters into `out`, replacing its content. The buffer is
+ * sized exactly once and written in place.
+ *
+ * Padding is optional; whitespace and any character outside of the
+ * alphabet are errors.
+ *
+ * @return {Boolean} false if `src` is not base64, `out` is left empty then
+ * @api public
+ */
+
+bool decode(const char* src, size_t len, Buffer& out);
+
+} // namespace base64 {
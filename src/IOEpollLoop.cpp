@@ -0,0 +1,99 @@
+#include "IOEpollLoop.h"
+
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const int MAX_EVENTS = 256;
+
+EpollEventLoop::EpollEventLoop()
+: _epoll(epoll_create1(EPOLL_CLOEXEC))
+, _wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+, _generation(0)
+{
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)(uint32_t)_wakeFd;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeFd, &ev);
+}
+
+EpollEventLoop::~EpollEventLoop()
+{
+    close(_wakeFd);
+    close(_epoll);
+}
+
+bool EpollEventLoop::add(int fd, uint32_t events, const IoHandler& handler)
+{
+    Watch& watch = _watches[fd];
+    watch.handler = std::make_shared<IoHandler>(handler);
+    // tells events of a closed descriptor from those of its reuse
+    watch.generation = ++_generation;
+
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = ((uint64_t)watch.generation << 32) | (uint32_t)fd;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        _watches.erase(fd);
+        return false;
+    }
+    return true;
+}
+
+bool EpollEventLoop::modify(int fd, uint32_t events)
+{
+    auto iter = _watches.find(fd);
+    if (iter == _watches.end())
+        return false;
+
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = ((uint64_t)iter->second.generation << 32) | (uint32_t)fd;
+    return epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EpollEventLoop::remove(int fd)
+{
+    if (_watches.erase(fd) > 0)
+        epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EpollEventLoop::wait(long timeout)
+{
+    epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(_epoll, events, MAX_EVENTS, timeout < 0 ? -1 : (int)timeout);
+
+    for (int i = 0; i < n; ++i)
+    {
+        int fd = (int)(uint32_t)events[i].data.u64;
+        uint32_t generation = (uint32_t)(events[i].data.u64 >> 32);
+
+        if (fd == _wakeFd && generation == 0)
+        {
+            uint64_t count;
+            while (read(_wakeFd, &count, sizeof(count)) > 0) {}
+            continue;
+        }
+
+        // handlers may remove or replace any descriptor, this one included
+        auto iter = _watches.find(fd);
+        if (iter == _watches.end() || iter->second.generation != generation)
+            continue;
+
+        std::shared_ptr<IoHandler> handler = iter->second.handler;
+        (*handler)(events[i].events);
+    }
+}
+
+void EpollEventLoop::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t r = write(_wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,61 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include "IOEventLoop.h"
+
+#include <unordered_map>
+
+/**
+ * Event loop waiting on file descriptors with epoll as well as on timers
+ * and posted tasks, so one thread can serve thousands of sockets.
+ *
+ * Handlers run on the loop thread with the ready epoll events.
+ */
+
+class EpollEventLoop : public EventLoop
+{
+public:
+    typedef std::function<void(uint32_t events)> IoHandler;
+
+    EpollEventLoop();
+    virtual ~EpollEventLoop();
+
+    /**
+     * Calls `handler` whenever `fd` is ready for `events` (EPOLLIN,
+     * EPOLLOUT...), level triggered.
+     *
+     * @return {Boolean} false if epoll refused the descriptor
+     * @api public
+     */
+
+    bool add(int fd, uint32_t events, const IoHandler& handler);
+    bool modify(int fd, uint32_t events);
+
+    /**
+     * Stops watching `fd`, before it gets closed. Events already read for
+     * it are dropped.
+     *
+     * @api public
+     */
+
+    void remove(int fd);
+
+protected:
+    virtual void wait(long timeout) override;
+    virtual void wakeup() override;
+
+private:
+    struct Watch
+    {
+        std::shared_ptr<IoHandler> handler;
+        uint32_t generation;
+    };
+
+    int _epoll;
+    int _wakeFd;
+    uint32_t _generation;
+    std::unordered_map<int, Watch> _watches;
+};
+
+#endif // defined(__linux__)
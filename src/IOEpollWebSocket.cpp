@@ -0,0 +1,931 @@
+#include "IOEpollWebSocket.h"
+
+#if defined(__linux__)
+
+#include "IOEpollLoop.h"
+#include "IOBase64.h"
+#include "IOUtf8.h"
+
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const size_t MAX_HANDSHAKE_SIZE = 16 * 1024;
+static const size_t READ_CHUNK = 64 * 1024;
+// read per readable event at most, the loop reports the rest again
+static const size_t MAX_READ_PER_EVENT = 4 * READ_CHUNK;
+static const long CLOSE_TIMEOUT = 5000;
+// scratch and connection buffers grown past this are freed once empty
+static const size_t MAX_SCRATCH_SIZE = 1024 * 1024;
+
+/**
+ * SHA-1 of `len` bytes, only used for Sec-WebSocket-Accept.
+ */
+
+static void sha1(const uint8_t* data, size_t len, uint8_t digest[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+    std::vector<uint8_t> msg(data, data + len);
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56)
+        msg.push_back(0);
+    uint64_t bits = (uint64_t)len * 8;
+    for (int shift = 56; shift >= 0; shift -= 8)
+        msg.push_back((uint8_t)(bits >> shift));
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            const uint8_t* p = &msg[chunk + i * 4];
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+            else { f = b ^ c ^ d; k = 0xca62c1d6; }
+
+            uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[i * 4] = (uint8_t)(h[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(h[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(h[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)h[i];
+    }
+}
+
+static std::string acceptKey(const std::string& key)
+{
+    std::string s = key + WEBSOCKET_GUID;
+    uint8_t digest[20];
+    sha1((const uint8_t*)s.data(), s.length(), digest);
+
+    std::string accept;
+    base64::encode(digest, sizeof(digest), accept);
+    return accept;
+}
+
+static void releaseScratch(std::vector<uint8_t>& scratch)
+{
+    if (scratch.capacity() > MAX_SCRATCH_SIZE)
+        std::vector<uint8_t>().swap(scratch);
+}
+
+/**
+ * Splits `ws://host[:port][/path][?query]`.
+ */
+
+static bool parseUri(const std::string& uri, std::string& host, std::string& port, std::string& resource)
+{
+    static const char scheme[] = "ws://";
+    if (uri.length() < sizeof(scheme) - 1 || strncasecmp(uri.c_str(), scheme, sizeof(scheme) - 1) != 0)
+        return false;
+
+    size_t start = sizeof(scheme) - 1;
+    size_t end = uri.find_first_of("/?", start);
+    if (end == std::string::npos)
+        end = uri.length();
+
+    std::string authority = uri.substr(start, end - start);
+    size_t colon;
+    if (!authority.empty() && authority[0] == '[')
+    {
+        size_t close = authority.find(']');
+        if (close == std::string::npos)
+            return false;
+        host = authority.substr(1, close - 1);
+        colon = authority.find(':', close);
+    }
+    else
+    {
+        colon = authority.find(':');
+        host = authority.substr(0, colon);
+    }
+    port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+
+    resource = uri.substr(end);
+    if (resource.empty() || resource[0] != '/')
+        resource.insert(0, "/");
+
+    return !host.empty() && !port.empty();
+}
+
+static bool headerEquals(const std::string& value, const char* expected)
+{
+    return strcasecmp(value.c_str(), expected) == 0;
+}
+
+static bool headerHasToken(const std::string& value, const char* token)
+{
+    size_t len = strlen(token);
+    size_t pos = 0;
+    while (pos < value.length())
+    {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos)
+            end = value.length();
+
+        size_t b = value.find_first_not_of(" \t", pos);
+        size_t e = end;
+        while (e > b && (value[e - 1] == ' ' || value[e - 1] == '\t'))
+            --e;
+        if (b < e && e - b == len && strncasecmp(value.c_str() + b, token, len) == 0)
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+EpollWebSocket::EpollWebSocket(std::shared_ptr<EpollEventLoop> loop)
+: _loop(std::move(loop))
+, _fd(-1)
+, _state(State::CLOSED)
+, _inOffset(0)
+, _outOffset(0)
+, _wantWrite(false)
+, _messageOpcode(websocket::CONTINUATION)
+, _inMessage(false)
+, _messageCompressed(false)
+, _closeSent(false)
+, _closeReceived(false)
+, _closeTimer(INVALID_TIMER_HANDLE)
+, _maskPoolUsed(sizeof(_maskPool))
+{
+    timeout = 0;
+}
+
+EpollWebSocket::~EpollWebSocket()
+{
+    teardown();
+}
+
+bool EpollWebSocket::open(const std::string& uri, const std::vector<std::string>& protocols, const std::string& caFilePath)
+{
+    // no TLS, wss:// is refused by parseUri, so there is no CA to load
+    (void)caFilePath;
+
+    if (_state != State::CLOSED)
+        return false;
+
+    std::string host, port, resource;
+    if (!parseUri(uri, host, port, resource))
+        return false;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0 || !addrs)
+        return false;
+
+    _fd = socket(addrs->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd >= 0)
+    {
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(_fd, addrs->ai_addr, addrs->ai_addrlen) != 0 && errno != EINPROGRESS)
+        {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+
+    if (_fd < 0)
+        return false;
+
+    std::weak_ptr<EpollWebSocket> weak = shared_from_this();
+    if (!_loop->add(_fd, EPOLLIN | EPOLLOUT, [weak](uint32_t events) {
+        if (auto self = weak.lock())
+            self->onEvents(events);
+    }))
+    {
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    _wantWrite = true;
+    _state = State::CONNECTING;
+    _closeSent = false;
+    _closeReceived = false;
+    _closeReason.clear();
+
+    uint8_t nonce[16];
+    for (size_t i = 0; i < sizeof(nonce); i += 4)
+        nextMaskKey(nonce + i);
+    _key.clear();
+    base64::encode(nonce, sizeof(nonce), _key);
+
+    bool ipv6 = host.find(':') != std::string::npos;
+    std::string request = "GET " + resource + " HTTP/1.1\r\n";
+    request += "Host: " + (ipv6 ? "[" + host + "]" : host) + (port == "80" ? "" : ":" + port) + "\r\n";
+    request += "Upgrade: websocket\r\n";
+    request += "Connection: Upgrade\r\n";
+    request += "Sec-WebSocket-Key: " + _key + "\r\n";
+    request += "Sec-WebSocket-Version: 13\r\n";
+    if (perMessageDeflate)
+        request += std::string("Sec-WebSocket-Extensions: ") + websocket::PerMessageDeflate::offer() + "\r\n";
+    if (!protocols.empty())
+    {
+        request += "Sec-WebSocket-Protocol: ";
+        for (size_t i = 0; i < protocols.size(); ++i)
+            request += (i ? ", " : "") + protocols[i];
+        request += "\r\n";
+    }
+    request += "\r\n";
+
+    // goes out once connected
+    _out.assign(request.begin(), request.end());
+    _outOffset = 0;
+
+    return true;
+}
+
+void EpollWebSocket::close()
+{
+    if (_state == State::OPEN)
+    {
+        sendClose(1000, "");
+        return;
+    }
+
+    if (_state == State::CONNECTING || _state == State::HANDSHAKE)
+        finish("closed before open");
+}
+
+void EpollWebSocket::send(const Buffer& data, bool compress)
+{
+    IOVec slice = { data.data(), data.length() };
+    sendFrame(websocket::BINARY, &slice, 1, compress, false);
+}
+
+void EpollWebSocket::send(const std::string& text, bool compress)
+{
+    IOVec slice = { (const uint8_t*)text.data(), text.length() };
+    sendFrame(websocket::TEXT, &slice, 1, compress, false);
+}
+
+void EpollWebSocket::sendv(const IOVec* slices, size_t count, bool binary, bool compress, bool more)
+{
+    sendFrame(binary ? websocket::BINARY : websocket::TEXT, slices, count, compress, more);
+}
+
+void EpollWebSocket::onEvents(uint32_t events)
+{
+    // callbacks may drop the last reference
+    std::shared_ptr<EpollWebSocket> self = shared_from_this();
+
+    if (_state == State::CONNECTING)
+    {
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+            onConnected();
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        onReadable();
+
+    if (_state != State::CLOSED && (events & EPOLLOUT))
+        flush();
+}
+
+void EpollWebSocket::onConnected()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+        err = errno;
+    if (err != 0)
+    {
+        fail(1006, strerror(err));
+        return;
+    }
+
+    _state = State::HANDSHAKE;
+    flush();
+}
+
+void EpollWebSocket::onReadable()
+{
+    // shared by the sockets of the thread, so idle ones hold no read buffer
+    static thread_local uint8_t chunk[READ_CHUNK];
+
+    // epoll is level triggered: stopping early just leaves the rest for
+    // the next turn, so a busy socket neither starves the others nor piles
+    // up unparsed bytes in _in
+    bool eof = false;
+    size_t budget = MAX_READ_PER_EVENT;
+    while (budget > 0)
+    {
+        size_t want = std::min(sizeof(chunk), budget);
+        ssize_t n = recv(_fd, chunk, want, 0);
+        if (n > 0)
+        {
+            budget -= n;
+            _in.insert(_in.end(), chunk, chunk + n);
+
+            // frames are consumed as they complete
+            if (!readAvailable())
+                return;
+            if ((size_t)n < want)
+                break;
+            continue;
+        }
+        if (n == 0)
+        {
+            eof = true;
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        fail(1006, strerror(errno));
+        return;
+    }
+
+    if (eof && _state != State::CLOSED)
+    {
+        if (_closeReceived)
+            finish(_closeReason);
+        else
+            fail(1006, "connection closed");
+    }
+}
+
+/**
+ * Handles what _in holds so far.
+ *
+ * @return false once the connection is closed
+ */
+bool EpollWebSocket::readAvailable()
+{
+    if (_state == State::HANDSHAKE && !readHandshake())
+        return false;
+
+    if (_state == State::OPEN || _state == State::CLOSING)
+        readFrames();
+
+    return _state != State::CLOSED;
+}
+
+bool EpollWebSocket::readHandshake()
+{
+    static const char terminator[] = "\r\n\r\n";
+    const char* begin = (const char*)_in.data();
+    const char* end = begin + _in.size();
+    const char* headersEnd = std::search(begin, end, terminator, terminator + 4);
+    if (headersEnd == end)
+    {
+        if (_in.size() > MAX_HANDSHAKE_SIZE)
+        {
+            fail(1002, "handshake too long");
+            return false;
+        }
+        return true;
+    }
+
+    std::string response(begin, headersEnd);
+    _inOffset = headersEnd + 4 - begin;
+
+    size_t lineEnd = response.find("\r\n");
+    std::string status = response.substr(0, lineEnd);
+    if (status.compare(0, 9, "HTTP/1.1 ") != 0 || status.compare(9, 3, "101") != 0)
+    {
+        fail(1002, "unexpected handshake response: " + status);
+        return false;
+    }
+
+    std::string upgrade, connection, accept, extensions;
+    size_t pos = lineEnd == std::string::npos ? response.length() : lineEnd + 2;
+    while (pos < response.length())
+    {
+        size_t eol = response.find("\r\n", pos);
+        if (eol == std::string::npos)
+            eol = response.length();
+
+        size_t colon = response.find(':', pos);
+        if (colon < eol)
+        {
+            std::string name = response.substr(pos, colon - pos);
+            size_t v = response.find_first_not_of(" \t", colon + 1);
+            std::string value = v < eol ? response.substr(v, eol - v) : "";
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                value.pop_back();
+
+            if (headerEquals(name, "Upgrade"))
+                upgrade = value;
+            else if (headerEquals(name, "Connection"))
+                connection = value;
+            else if (headerEquals(name, "Sec-WebSocket-Accept"))
+                accept = value;
+            else if (headerEquals(name, "Sec-WebSocket-Extensions"))
+                extensions = value;
+        }
+        pos = eol + 2;
+    }
+
+    if (!headerEquals(upgrade, "websocket") || !headerHasToken(connection, "upgrade") || accept != acceptKey(_key))
+    {
+        fail(1002, "invalid handshake response");
+        return false;
+    }
+
+    if (!extensions.empty())
+    {
+        websocket::PerMessageDeflate::Params params;
+        if (!perMessageDeflate || !websocket::PerMessageDeflate::negotiate(extensions, params))
+        {
+            fail(1002, "unexpected extension: " + extensions);
+            return false;
+        }
+        _deflate.reset(new websocket::PerMessageDeflate(params));
+    }
+
+    _state = State::OPEN;
+    if (onopen)
+        onopen();
+    return _state != State::CLOSED;
+}
+
+void EpollWebSocket::readFrames()
+{
+    while (_state == State::OPEN || _state == State::CLOSING)
+    {
+        uint8_t* data = _in.data() + _inOffset;
+        size_t available = _in.size() - _inOffset;
+
+        websocket::FrameHeader header;
+        size_t headerSize = websocket::readHeader(data, available, header);
+        if (headerSize == 0)
+            break;
+
+        // RSV1 starts compressed messages when deflate was negotiated,
+        // and servers never mask
+        bool compressed = header.rsv == websocket::RSV1 && _deflate
+            && (header.opcode == websocket::TEXT || header.opcode == websocket::BINARY);
+        if ((header.rsv != 0 && !compressed) || header.masked)
+        {
+            fail(1002, "invalid frame header");
+            return;
+        }
+
+        if (header.length > MAX_MESSAGE_SIZE)
+        {
+            fail(1009, "message too big");
+            return;
+        }
+
+        if (available - headerSize < header.length)
+            break;
+
+        _inOffset += headerSize + (size_t)header.length;
+        if (!onFrame(header, data + headerSize))
+            return;
+    }
+
+    if (_inOffset == _in.size())
+    {
+        // a large message shouldn't keep its buffer for the connection's life
+        _in.clear();
+        _inOffset = 0;
+        releaseScratch(_in);
+    }
+    else if (_inOffset > _in.size() / 2)
+    {
+        _in.erase(_in.begin(), _in.begin() + _inOffset);
+        _inOffset = 0;
+    }
+}
+
+bool EpollWebSocket::onFrame(const websocket::FrameHeader& header, uint8_t* payload)
+{
+    size_t len = (size_t)header.length;
+
+    if (websocket::isControl(header.opcode))
+    {
+        if (!header.fin || len > websocket::MAX_CONTROL_PAYLOAD)
+        {
+            fail(1002, "invalid control frame");
+            return false;
+        }
+
+        switch (header.opcode)
+        {
+            case websocket::CLOSE:
+                onCloseFrame(payload, len);
+                break;
+            case websocket::PING:
+                if (_state == State::OPEN)
+                    sendFrame(websocket::PONG, payload, len);
+                break;
+            case websocket::PONG:
+                break;
+            default:
+                fail(1002, "unknown opcode");
+                return false;
+        }
+        return _state != State::CLOSED;
+    }
+
+    switch (header.opcode)
+    {
+        case websocket::CONTINUATION:
+            if (!_inMessage)
+            {
+                fail(1002, "unexpected continuation frame");
+                return false;
+            }
+            if (_message.size() + len > MAX_MESSAGE_SIZE)
+            {
+                fail(1009, "message too big");
+                return false;
+            }
+            _message.insert(_message.end(), payload, payload + len);
+            if (header.fin)
+            {
+                std::vector<uint8_t> message;
+                message.swap(_message);
+                _inMessage = false;
+                deliver(_messageOpcode, message.data(), message.size(), _messageCompressed);
+            }
+            break;
+        case websocket::TEXT:
+        case websocket::BINARY:
+            if (_inMessage)
+            {
+                fail(1002, "expected continuation frame");
+                return false;
+            }
+            if (header.fin)
+            {
+                deliver(header.opcode, payload, len, header.rsv == websocket::RSV1);
+            }
+            else
+            {
+                _inMessage = true;
+                _messageOpcode = header.opcode;
+                _messageCompressed = header.rsv == websocket::RSV1;
+                _message.assign(payload, payload + len);
+            }
+            break;
+        default:
+            fail(1002, "unknown opcode");
+            return false;
+    }
+
+    return _state != State::CLOSED;
+}
+
+void EpollWebSocket::deliver(websocket::Opcode opcode, const uint8_t* data, size_t len, bool compressed)
+{
+    // messages still arriving after our close frame are dropped
+    if (_state != State::OPEN)
+        return;
+
+    // shared by the sockets of the thread, the message is copied out below
+    static thread_local std::vector<uint8_t> inflated;
+    if (compressed)
+    {
+        if (!_deflate->decompress(data, len, MAX_MESSAGE_SIZE, inflated))
+        {
+            bool tooBig = inflated.size() > MAX_MESSAGE_SIZE;
+            releaseScratch(inflated);
+            if (tooBig)
+                fail(1009, "message too big");
+            else
+                fail(1007, "invalid compressed message");
+            return;
+        }
+        data = inflated.data();
+        len = inflated.size();
+    }
+
+    bool valid = opcode != websocket::TEXT || utf8::validate((const char*)data, len);
+    Value message;
+    if (valid && onmessage)
+        message = opcode == websocket::TEXT ? Value(std::string((const char*)data, len)) : Value(Buffer(data, len));
+    releaseScratch(inflated);
+
+    if (!valid)
+    {
+        fail(1007, "invalid UTF-8 in text message");
+        return;
+    }
+    if (onmessage)
+        onmessage(message);
+}
+
+void EpollWebSocket::onCloseFrame(const uint8_t* payload, size_t len)
+{
+    uint16_t code = 1005;
+    std::string reason;
+    if (len == 1)
+    {
+        fail(1002, "invalid close frame");
+        return;
+    }
+    if (len >= 2)
+    {
+        code = ((uint16_t)payload[0] << 8) | payload[1];
+        reason.assign((const char*)payload + 2, len - 2);
+        if (!utf8::validate(reason.data(), reason.length()))
+        {
+            fail(1007, "invalid UTF-8 in close reason");
+            return;
+        }
+    }
+
+    _closeReceived = true;
+    _closeReason = reason.empty() ? "closed with code " + toString(code) : reason;
+
+    if (!_closeSent)
+    {
+        // echo the code, the connection is dropped once it is out
+        sendClose(code == 1005 ? 1000 : code, "");
+    }
+    else if (_outOffset == _out.size())
+    {
+        finish(_closeReason);
+    }
+}
+
+void EpollWebSocket::sendFrame(websocket::Opcode opcode, const uint8_t* data, size_t len)
+{
+    IOVec slice = { data, len };
+    sendFrame(opcode, &slice, 1, false, false);
+}
+
+void EpollWebSocket::sendFrame(websocket::Opcode opcode, const IOVec* slices, size_t count, bool compress, bool more)
+{
+    if (_state != State::OPEN)
+        return;
+
+    if (compress && _deflate)
+    {
+        // shared by the sockets of the thread, copied into _out right away
+        static thread_local std::vector<uint8_t> deflated;
+        if (!_deflate->compress(slices, count, deflated))
+        {
+            fail(1011, "compression failed");
+            return;
+        }
+        appendFrame(opcode, deflated.data(), deflated.size(), websocket::RSV1);
+        releaseScratch(deflated);
+    }
+    else
+    {
+        appendFrame(opcode, slices, count);
+    }
+
+    // frames of a batch pile up in _out and leave in one send
+    if (!more && !_wantWrite)
+        flush();
+}
+
+void EpollWebSocket::appendFrame(websocket::Opcode opcode, const uint8_t* data, size_t len, uint8_t rsv)
+{
+    IOVec slice = { data, len };
+    appendFrame(opcode, &slice, 1, rsv);
+}
+
+void EpollWebSocket::appendFrame(websocket::Opcode opcode, const IOVec* slices, size_t count, uint8_t rsv)
+{
+    uint8_t maskKey[4];
+    nextMaskKey(maskKey);
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i)
+        len += slices[i].length;
+
+    uint8_t header[websocket::MAX_HEADER_SIZE];
+    size_t headerSize = websocket::writeHeader(header, opcode, true, len, maskKey, rsv);
+
+    size_t start = _out.size();
+    _out.resize(start + headerSize + len);
+    memcpy(&_out[start], header, headerSize);
+
+    // masking needs a pass over the payload anyway, so each slice is masked
+    // straight into place rather than gathered first
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (slices[i].length > 0)
+            websocket::maskCopy(&_out[start + headerSize + offset], slices[i].data, slices[i].length, maskKey, offset);
+        offset += slices[i].length;
+    }
+}
+
+void EpollWebSocket::sendClose(uint16_t code, const std::string& reason)
+{
+    std::string payload;
+    payload += (char)(code >> 8);
+    payload += (char)(code & 0xff);
+    payload.append(reason, 0, websocket::MAX_CONTROL_PAYLOAD - 2);
+
+    appendFrame(websocket::CLOSE, (const uint8_t*)payload.data(), payload.length());
+    _closeSent = true;
+    _state = State::CLOSING;
+
+    // answering the server's close, done once it is out
+    if (_closeReceived)
+    {
+        if (!_wantWrite)
+            flush();
+        return;
+    }
+
+    if (!_wantWrite)
+        flush();
+    if (_state == State::CLOSED)
+        return;
+
+    // don't wait forever for the server's close frame
+    std::weak_ptr<EpollWebSocket> weak = shared_from_this();
+    _closeTimer = _loop->setTimeout([weak]() {
+        if (auto self = weak.lock())
+        {
+            self->_closeTimer = INVALID_TIMER_HANDLE;
+            self->finish("close timeout");
+        }
+    }, CLOSE_TIMEOUT);
+}
+
+void EpollWebSocket::flush()
+{
+    if (_state == State::CONNECTING || _state == State::CLOSED)
+        return;
+
+    while (_outOffset < _out.size())
+    {
+        ssize_t n = ::send(_fd, &_out[_outOffset], _out.size() - _outOffset, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            _outOffset += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            setWantWrite(true);
+            return;
+        }
+
+        fail(1006, strerror(errno));
+        return;
+    }
+
+    // the socket had filled up, so a sender is waiting on `ondrain`
+    bool drained = _wantWrite;
+
+    _out.clear();
+    _outOffset = 0;
+    releaseScratch(_out);
+    setWantWrite(false);
+
+    if (_closeSent && _closeReceived)
+        finish(_closeReason);
+    else if (drained && _state == State::OPEN && ondrain)
+        ondrain();
+}
+
+void EpollWebSocket::setWantWrite(bool want)
+{
+    if (want == _wantWrite || _fd < 0)
+        return;
+
+    _wantWrite = want;
+    _loop->modify(_fd, EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u));
+}
+
+void EpollWebSocket::fail(uint16_t code, const std::string& reason)
+{
+    if (_state == State::CLOSED)
+        return;
+
+    // best effort, the connection is dropped right after
+    if (_state == State::OPEN && code != 1006)
+    {
+        uint8_t payload[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+        appendFrame(websocket::CLOSE, payload, sizeof(payload));
+        ssize_t n = ::send(_fd, &_out[_outOffset], _out.size() - _outOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        (void)n;
+    }
+
+    teardown();
+    if (onerror)
+        onerror(reason);
+    if (onclose)
+        onclose(reason);
+}
+
+void EpollWebSocket::finish(const std::string& reason)
+{
+    if (_state == State::CLOSED)
+        return;
+
+    teardown();
+    if (onclose)
+        onclose(reason);
+}
+
+void EpollWebSocket::teardown()
+{
+    if (_closeTimer != INVALID_TIMER_HANDLE)
+    {
+        _loop->clearTimeout(_closeTimer);
+        _closeTimer = INVALID_TIMER_HANDLE;
+    }
+
+    if (_fd >= 0)
+    {
+        _loop->remove(_fd);
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    _state = State::CLOSED;
+    _wantWrite = false;
+    _in.clear();
+    _inOffset = 0;
+    releaseScratch(_in);
+    _out.clear();
+    _outOffset = 0;
+    releaseScratch(_out);
+    _message.clear();
+    releaseScratch(_message);
+    _inMessage = false;
+    _messageCompressed = false;
+
+    // hands the zlib state back to the pool
+    _deflate.reset();
+}
+
+void EpollWebSocket::nextMaskKey(uint8_t key[4])
+{
+    // keys must be unpredictable (RFC 6455 10.3), refilled from the kernel
+    // a pool at a time
+    if (_maskPoolUsed + 4 > sizeof(_maskPool))
+    {
+        size_t filled = 0;
+        while (filled < sizeof(_maskPool))
+        {
+            ssize_t n = getrandom(_maskPool + filled, sizeof(_maskPool) - filled, 0);
+            if (n > 0)
+                filled += n;
+            else if (errno != EINTR)
+                break;
+        }
+        _maskPoolUsed = 0;
+    }
+
+    memcpy(key, _maskPool + _maskPoolUsed, 4);
+    _maskPoolUsed += 4;
+}
+
+EpollWebSocketFactory::EpollWebSocketFactory(std::shared_ptr<EpollEventLoop> loop)
+: _loop(std::move(loop))
+{
+}
+
+std::shared_ptr<IWebSocket> EpollWebSocketFactory::create()
+{
+    return std::make_shared<EpollWebSocket>(_loop);
+}
+
+#endif // defined(__linux__)
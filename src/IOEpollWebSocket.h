@@ -0,0 +1,118 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include "IOUtils.h"
+#include "IOWebSocketFrame.h"
+#include "IOWebSocketDeflate.h"
+
+class EpollEventLoop;
+
+/**
+ * RFC 6455 client on a non-blocking socket driven by an EpollEventLoop.
+ *
+ * Handles the opening handshake, masking, fragmented messages, ping/pong,
+ * the closing handshake and permessage-deflate (offered when
+ * `perMessageDeflate` is set before `open`); callbacks run on the loop
+ * thread. Only `ws://` URIs are supported, there is no TLS, and host names
+ * are resolved synchronously in `open`.
+ */
+
+class EpollWebSocket : public IWebSocket, public std::enable_shared_from_this<EpollWebSocket>
+{
+public:
+    explicit EpollWebSocket(std::shared_ptr<EpollEventLoop> loop);
+    virtual ~EpollWebSocket();
+
+    virtual bool open(const std::string& uri, const std::vector<std::string>& protocols, const std::string& caFilePath) override;
+    virtual void close() override;
+    virtual void send(const Buffer& data, bool compress = false) override;
+    virtual void send(const std::string& text, bool compress = false) override;
+    virtual void sendv(const IOVec* slices, size_t count, bool binary, bool compress = false, bool more = false) override;
+    virtual size_t getBufferedAmount() const override { return _out.size() - _outOffset; }
+
+    /**
+     * Largest message accepted, bigger ones fail the connection with 1009.
+     *
+     * @api public
+     */
+
+    static const size_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+private:
+    enum class State
+    {
+        CLOSED,
+        CONNECTING,
+        HANDSHAKE,
+        OPEN,
+        CLOSING
+    };
+
+    void onEvents(uint32_t events);
+    void onConnected();
+    void onReadable();
+    bool readAvailable();
+    bool readHandshake();
+    void readFrames();
+    bool onFrame(const websocket::FrameHeader& header, uint8_t* payload);
+    void onCloseFrame(const uint8_t* payload, size_t len);
+    void deliver(websocket::Opcode opcode, const uint8_t* data, size_t len, bool compressed);
+
+    void sendFrame(websocket::Opcode opcode, const uint8_t* data, size_t len);
+    void sendFrame(websocket::Opcode opcode, const IOVec* slices, size_t count, bool compress, bool more);
+    void appendFrame(websocket::Opcode opcode, const uint8_t* data, size_t len, uint8_t rsv = 0);
+    void appendFrame(websocket::Opcode opcode, const IOVec* slices, size_t count, uint8_t rsv = 0);
+    void sendClose(uint16_t code, const std::string& reason);
+    void flush();
+    void setWantWrite(bool want);
+
+    void fail(uint16_t code, const std::string& reason);
+    void finish(const std::string& reason);
+    void teardown();
+
+    void nextMaskKey(uint8_t key[4]);
+
+    std::shared_ptr<EpollEventLoop> _loop;
+    int _fd;
+    State _state;
+
+    std::string _key;
+
+    std::vector<uint8_t> _in;
+    size_t _inOffset;
+
+    std::vector<uint8_t> _out;
+    size_t _outOffset;
+    bool _wantWrite;
+
+    // fragments of the message being received
+    std::vector<uint8_t> _message;
+    websocket::Opcode _messageOpcode;
+    bool _inMessage;
+    bool _messageCompressed;
+
+    // set when the server accepted permessage-deflate
+    std::unique_ptr<websocket::PerMessageDeflate> _deflate;
+
+    bool _closeSent;
+    bool _closeReceived;
+    std::string _closeReason;
+    TimerHandle _closeTimer;
+
+    uint8_t _maskPool[256];
+    size_t _maskPoolUsed;
+};
+
+class EpollWebSocketFactory : public IWebSocketFactory
+{
+public:
+    explicit EpollWebSocketFactory(std::shared_ptr<EpollEventLoop> loop);
+
+    virtual std::shared_ptr<IWebSocket> create() override;
+
+private:
+    std::shared_ptr<EpollEventLoop> _loop;
+};
+
+#endif // defined(__linux__)
@@ -0,0 +1,108 @@
+#include "IOEventLoop.h"
+
+EventLoop::EventLoop()
+: _wheel(0)
+, _start(std::chrono::steady_clock::now())
+, _woken(false)
+, _stopped(false)
+{
+}
+
+EventLoop::~EventLoop()
+{
+}
+
+uint64_t EventLoop::now() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+TimerHandle EventLoop::setTimeout(const std::function<void()>& cb, long milliseconds)
+{
+    // the wheel's clock stops between runs, count from now instead
+    uint64_t elapsed = now() - _wheel.now();
+    return _wheel.add(cb, (milliseconds > 0 ? milliseconds : 0) + elapsed);
+}
+
+void EventLoop::clearTimeout(TimerHandle handle)
+{
+    _wheel.cancel(handle);
+}
+
+void EventLoop::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+size_t EventLoop::runPending()
+{
+    size_t ran = _wheel.advance(now());
+
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        tasks.swap(_tasks);
+    }
+
+    for (auto& task : tasks)
+        task();
+    return ran + tasks.size();
+}
+
+size_t EventLoop::runOnce(long timeout)
+{
+    size_t ran = runPending();
+    if (ran > 0)
+        timeout = 0;
+
+    int64_t next = timeout != 0 ? _wheel.nextTimeout() : -1;
+    if (next > 0)
+    {
+        uint64_t elapsed = now() - _wheel.now();
+        next = (uint64_t)next > elapsed ? next - elapsed : 0;
+    }
+
+    if (next >= 0 && (timeout < 0 || next < timeout))
+        timeout = (long)next;
+
+    // even without waiting, subclasses poll their descriptors
+    wait(timeout);
+
+    return ran + runPending();
+}
+
+void EventLoop::run()
+{
+    while (!_stopped.load())
+        runOnce(-1);
+    _stopped = false;
+}
+
+void EventLoop::stop()
+{
+    _stopped = true;
+    wakeup();
+}
+
+void EventLoop::wait(long timeout)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (timeout < 0)
+        _cond.wait(lock, [this]() { return _woken; });
+    else
+        _cond.wait_for(lock, std::chrono::milliseconds(timeout), [this]() { return _woken; });
+    _woken = false;
+}
+
+void EventLoop::wakeup()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _woken = true;
+    }
+    _cond.notify_one();
+}
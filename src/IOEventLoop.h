@@ -0,0 +1,102 @@
+#pragma once
+
+#include "IOTimerWheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Runs the timers and tasks of the library on one thread.
+ *
+ * Everything but `post` and `stop` must be called from the thread running
+ * the loop, which is also where timers fire. Either hand that thread to
+ * `run`, or call `runOnce(0)` from an existing loop (a frame callback for
+ * example) to fire what is due without blocking.
+ *
+ * The default loop sleeps on a condition variable; subclasses waiting on
+ * sockets override `wait` and `wakeup`.
+ */
+
+class EventLoop
+{
+public:
+    EventLoop();
+    virtual ~EventLoop();
+
+    /**
+     * Calls `cb` once after `milliseconds`, from the loop thread.
+     *
+     * @return {TimerHandle} for clearTimeout, never INVALID_TIMER_HANDLE
+     * @api public
+     */
+
+    TimerHandle setTimeout(const std::function<void()>& cb, long milliseconds);
+
+    /**
+     * Cancels a timer that hasn't fired. Handles that already fired or
+     * were cleared are ignored, even if their slot got reused since.
+     *
+     * @api public
+     */
+
+    void clearTimeout(TimerHandle handle);
+
+    /**
+     * Queues `task` to run on the loop thread, called from any thread.
+     *
+     * @api public
+     */
+
+    void post(std::function<void()> task);
+
+    /**
+     * Fires the timers due and runs the tasks posted so far. If there was
+     * nothing to do, waits up to `timeout` ms (-1 for as long as it takes)
+     * for the next timer or task and runs what is due then.
+     *
+     * @return {Number} timers and tasks run
+     * @api public
+     */
+
+    size_t runOnce(long timeout);
+
+    /**
+     * Runs until `stop`, called from any thread.
+     *
+     * @api public
+     */
+
+    void run();
+    void stop();
+
+    /**
+     * Milliseconds since the loop was created.
+     *
+     * @api public
+     */
+
+    uint64_t now() const;
+
+protected:
+    /**
+     * Blocks up to `timeout` ms, -1 for no limit, or until `wakeup`. Called
+     * with 0 to poll without blocking.
+     */
+
+    virtual void wait(long timeout);
+    virtual void wakeup();
+
+private:
+    size_t runPending();
+
+    TimerWheel _wheel;
+    std::chrono::steady_clock::time_point _start;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::vector<std::function<void()>> _tasks;
+    bool _woken;
+    std::atomic<bool> _stopped;
+};
@@ -0,0 +1,161 @@
+#include "IOHeartbeatMonitor.h"
+#include "IOEventLoop.h"
+#include "IOUtils.h"
+
+static const uint32_t GENERATION_MASK = 0x7fffffffu;
+
+const uint64_t HeartbeatMonitor::NO_CHECK;
+
+HeartbeatMonitor::HeartbeatMonitor(std::shared_ptr<EventLoop> loop)
+: _loop(std::move(loop))
+, _count(0)
+, _timer(INVALID_TIMER_HANDLE)
+, _timerAt(NO_CHECK)
+{
+}
+
+HeartbeatMonitor::~HeartbeatMonitor()
+{
+    if (_timer != INVALID_TIMER_HANDLE)
+        _loop->clearTimeout(_timer);
+}
+
+std::shared_ptr<HeartbeatMonitor> HeartbeatMonitor::get()
+{
+    static std::shared_ptr<HeartbeatMonitor> __monitor;
+
+    std::shared_ptr<EventLoop> loop = getEventLoop();
+    if (!__monitor || __monitor->_loop != loop)
+        __monitor = std::make_shared<HeartbeatMonitor>(loop);
+    return __monitor;
+}
+
+TimerHandle HeartbeatMonitor::watch(const std::function<void()>& onTimeout)
+{
+    uint32_t index;
+    if (_free.empty())
+    {
+        index = (uint32_t)_entries.size();
+        _entries.emplace_back();
+        _entries.back().generation = 1;
+    }
+    else
+    {
+        index = _free.back();
+        _free.pop_back();
+    }
+
+    Entry& e = _entries[index];
+    e.onTimeout = onTimeout;
+    e.deadline = NO_CHECK;
+    e.checkAt = NO_CHECK;
+    e.active = true;
+    ++_count;
+
+    return ((TimerHandle)(e.generation & GENERATION_MASK) << 32) | index;
+}
+
+HeartbeatMonitor::Entry* HeartbeatMonitor::find(TimerHandle handle)
+{
+    if (handle < 0)
+        return nullptr;
+
+    uint32_t index = (uint32_t)(handle & 0xffffffff);
+    if (index >= _entries.size())
+        return nullptr;
+
+    Entry& e = _entries[index];
+    if (!e.active || (e.generation & GENERATION_MASK) != (uint32_t)(handle >> 32))
+        return nullptr;
+    return &e;
+}
+
+void HeartbeatMonitor::touch(TimerHandle handle, long timeout)
+{
+    Entry* e = find(handle);
+    if (!e)
+        return;
+
+    e->deadline = _loop->now() + (timeout > 0 ? timeout : 0);
+
+    // later deadlines are picked up when the current bucket comes due
+    if (e->deadline >= e->checkAt)
+        return;
+
+    e->checkAt = e->deadline;
+    _buckets[e->deadline].push_back(handle);
+    if (e->deadline < _timerAt)
+        arm();
+}
+
+void HeartbeatMonitor::unwatch(TimerHandle handle)
+{
+    if (find(handle))
+        release((uint32_t)(handle & 0xffffffff));
+}
+
+void HeartbeatMonitor::release(uint32_t index)
+{
+    Entry& e = _entries[index];
+    e.onTimeout = nullptr;
+    e.active = false;
+    ++e.generation;
+    _free.push_back(index);
+    --_count;
+}
+
+void HeartbeatMonitor::arm()
+{
+    uint64_t first = _buckets.empty() ? NO_CHECK : _buckets.begin()->first;
+    if (first == _timerAt)
+        return;
+
+    if (_timer != INVALID_TIMER_HANDLE)
+        _loop->clearTimeout(_timer);
+    _timer = INVALID_TIMER_HANDLE;
+    _timerAt = first;
+
+    if (first == NO_CHECK)
+        return;
+
+    uint64_t now = _loop->now();
+    _timer = _loop->setTimeout([this]() {
+        _timer = INVALID_TIMER_HANDLE;
+        _timerAt = NO_CHECK;
+        sweep();
+    }, first > now ? (long)(first - now) : 0);
+}
+
+void HeartbeatMonitor::sweep()
+{
+    uint64_t now = _loop->now();
+
+    while (!_buckets.empty() && _buckets.begin()->first <= now)
+    {
+        uint64_t tick = _buckets.begin()->first;
+        std::vector<TimerHandle> handles = std::move(_buckets.begin()->second);
+        _buckets.erase(_buckets.begin());
+
+        for (TimerHandle handle : handles)
+        {
+            Entry* e = find(handle);
+            // unwatched, or moved to an earlier bucket since
+            if (!e || e->checkAt != tick)
+                continue;
+
+            if (e->deadline > now)
+            {
+                e->checkAt = e->deadline;
+                _buckets[e->deadline].push_back(handle);
+                continue;
+            }
+
+            // may watch, touch or unwatch, don't hold on to _entries
+            std::function<void()> onTimeout = std::move(e->onTimeout);
+            release((uint32_t)(handle & 0xffffffff));
+            onTimeout();
+        }
+    }
+
+    arm();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "IOTypes.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * Liveness deadlines of many connections on a single timer.
+ *
+ * `touch` only stores the new deadline, so a busy connection costs no
+ * timer work per packet. Each watched connection sits in the bucket of the
+ * tick it was last checked for; one loop timer sweeps the earliest bucket,
+ * times out whoever is past its deadline and moves the others to the tick
+ * of their current deadline. A deadline is therefore checked again at
+ * most once per timeout period, and expires exactly on its tick.
+ *
+ * Not thread safe, a monitor belongs to its loop's thread.
+ */
+
+class HeartbeatMonitor
+{
+public:
+    explicit HeartbeatMonitor(std::shared_ptr<EventLoop> loop);
+    ~HeartbeatMonitor();
+
+    /**
+     * The monitor of the current event loop (getEventLoop), shared by all
+     * the sockets of that loop.
+     *
+     * @api public
+     */
+
+    static std::shared_ptr<HeartbeatMonitor> get();
+
+    /**
+     * Starts watching a connection; it has no deadline until `touch`.
+     *
+     * @param {Function} called once the deadline passes, the connection is
+     * no longer watched then
+     * @return {TimerHandle} for touch and unwatch
+     * @api public
+     */
+
+    TimerHandle watch(const std::function<void()>& onTimeout);
+
+    /**
+     * Sets the deadline to `timeout` ms from now, earlier or later than
+     * the current one.
+     *
+     * @api public
+     */
+
+    void touch(TimerHandle handle, long timeout);
+
+    /**
+     * Stops watching, stale handles are ignored.
+     *
+     * @api public
+     */
+
+    void unwatch(TimerHandle handle);
+
+    size_t size() const { return _count; }
+
+private:
+    static const uint64_t NO_CHECK = ~0ull;
+
+    struct Entry
+    {
+        std::function<void()> onTimeout;
+        uint64_t deadline;
+        // tick of the bucket holding the entry, NO_CHECK if in none
+        uint64_t checkAt;
+        uint32_t generation;
+        bool active;
+    };
+
+    Entry* find(TimerHandle handle);
+    void release(uint32_t index);
+    void arm();
+    void sweep();
+
+    std::shared_ptr<EventLoop> _loop;
+
+    std::vector<Entry> _entries;
+    std::vector<uint32_t> _free;
+    size_t _count;
+
+    // handles by the tick they are checked at; stale ones are skipped
+    std::map<uint64_t, std::vector<TimerHandle>> _buckets;
+
+    TimerHandle _timer;
+    uint64_t _timerAt;
+};
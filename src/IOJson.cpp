@@ -0,0 +1,1089 @@
+#include "IOJson.h"
+#include "IOSimd.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if IO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace json {
+
+namespace {
+
+const char __hexDigits[] = "0123456789abcdef";
+
+const char __digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * For every byte: 0 if it is copied as is, 'u' if it needs a \u00XX
+ * escape, otherwise the character that follows the backslash.
+ */
+struct EscapeTable
+{
+    char escapes[256];
+
+    EscapeTable()
+    {
+        memset(escapes, 0, sizeof(escapes));
+        for (int c = 0; c < 0x20; ++c)
+            escapes[c] = 'u';
+        escapes[(unsigned char)'\b'] = 'b';
+        escapes[(unsigned char)'\f'] = 'f';
+        escapes[(unsigned char)'\n'] = 'n';
+        escapes[(unsigned char)'\r'] = 'r';
+        escapes[(unsigned char)'\t'] = 't';
+        escapes[(unsigned char)'"'] = '"';
+        escapes[(unsigned char)'\\'] = '\\';
+    }
+};
+
+const EscapeTable __escapeTable;
+
+/**
+ * Whether any of the 8 bytes in `x` is a control character, a quote or a
+ * backslash. Plain text (UTF-8 included) is skipped a word at a time.
+ */
+inline bool needsEscape(uint64_t x)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+
+    uint64_t quote = x ^ (ones * '"');
+    uint64_t backslash = x ^ (ones * '\\');
+
+    uint64_t t = ((x - ones * 0x20) & ~x)
+               | ((quote - ones) & ~quote)
+               | ((backslash - ones) & ~backslash);
+    return (t & highs) != 0;
+}
+
+void write(const Value& value, std::string& out);
+
+void writeArray(const ValueArray& arr, std::string& out)
+{
+    out.push_back('[');
+    bool first = true;
+    for (const auto& e : arr)
+    {
+        if (!first)
+            out.push_back(',');
+        first = false;
+
+        if (e.getType() == Value::Type::FUNCTION)
+            out.append("null", 4);
+        else
+            write(e, out);
+    }
+    out.push_back(']');
+}
+
+void writeObject(const ValueObject& obj, std::string& out)
+{
+    out.push_back('{');
+    bool first = true;
+    for (const auto& e : obj)
+    {
+        if (e.second.getType() == Value::Type::FUNCTION)
+            continue;
+
+        if (!first)
+            out.push_back(',');
+        first = false;
+
+        appendString(out, e.first.data(), e.first.size());
+        out.push_back(':');
+        write(e.second, out);
+    }
+    out.push_back('}');
+}
+
+void write(const Value& value, std::string& out)
+{
+    // still the text it was decoded from
+    if (value.isLazy())
+    {
+        const Buffer& text = value.getLazyText();
+        out.append((const char*)text.data(), text.length());
+        return;
+    }
+
+    switch (value.getType())
+    {
+        case Value::Type::STRING:
+        {
+            const std::string& str = value.asString();
+            appendString(out, str.data(), str.size());
+        }
+            break;
+        case Value::Type::BOOLEAN:
+            if (value.asBool())
+                out.append("true", 4);
+            else
+                out.append("false", 5);
+            break;
+        case Value::Type::INTEGER:
+            appendInt(out, value.asInt());
+            break;
+        case Value::Type::FLOAT:
+            appendFloat(out, value.asFloat());
+            break;
+        case Value::Type::ARRAY:
+            writeArray(value.asArray(), out);
+            break;
+        case Value::Type::OBJECT:
+            writeObject(value.asObject(), out);
+            break;
+        default:
+            out.append("null", 4);
+            break;
+    }
+}
+
+} // namespace {
+
+void stringify(const Value& value, std::string& out)
+{
+    write(value, out);
+}
+
+std::string stringify(const Value& value)
+{
+    std::string out;
+    out.reserve(estimateSize(value));
+    write(value, out);
+    return out;
+}
+
+size_t estimateSize(const Value& value)
+{
+    if (value.isLazy())
+        return value.getLazyText().length();
+
+    switch (value.getType())
+    {
+        case Value::Type::STRING:
+            return value.asString().size() + 2;
+        case Value::Type::BINARY:
+            return value.asBuffer().length();
+        case Value::Type::BOOLEAN:
+            return 5;
+        case Value::Type::INTEGER:
+            return 11;
+        case Value::Type::FLOAT:
+            return 16;
+        case Value::Type::ARRAY:
+        {
+            size_t size = 2;
+            for (const auto& e : value.asArray())
+                size += estimateSize(e) + 1;
+            return size;
+        }
+        case Value::Type::OBJECT:
+        {
+            size_t size = 2;
+            for (const auto& e : value.asObject())
+                size += e.first.size() + 4 + estimateSize(e.second);
+            return size;
+        }
+        default:
+            return 4;
+    }
+}
+
+void appendString(std::string& out, const char* str, size_t len)
+{
+    const unsigned char* p = (const unsigned char*)str;
+    const unsigned char* end = p + len;
+    const unsigned char* run = p;
+
+    out.push_back('"');
+
+    while (p < end)
+    {
+        while (end - p >= 8)
+        {
+            uint64_t x;
+            memcpy(&x, p, 8);
+            if (needsEscape(x))
+                break;
+            p += 8;
+        }
+
+        const unsigned char* stop = end - p > 8 ? p + 8 : end;
+        while (p < stop && __escapeTable.escapes[*p] == 0)
+            ++p;
+        if (p == stop)
+            continue;
+
+        out.append((const char*)run, p - run);
+
+        char escape = __escapeTable.escapes[*p];
+        if (escape == 'u')
+        {
+            char buf[6] = { '\\', 'u', '0', '0', __hexDigits[*p >> 4], __hexDigits[*p & 0xf] };
+            out.append(buf, 6);
+        }
+        else
+        {
+            char buf[2] = { '\\', escape };
+            out.append(buf, 2);
+        }
+
+        run = ++p;
+    }
+
+    out.append((const char*)run, end - run);
+    out.push_back('"');
+}
+
+void appendInt(std::string& out, int v)
+{
+    char buf[16];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+
+    unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+    while (u >= 100)
+    {
+        unsigned int r = u % 100;
+        u /= 100;
+        p -= 2;
+        memcpy(p, __digitPairs + r * 2, 2);
+    }
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, __digitPairs + u * 2, 2);
+    }
+    else
+    {
+        *--p = (char)('0' + u);
+    }
+
+    if (v < 0)
+        *--p = '-';
+
+    out.append(p, end - p);
+}
+
+void appendFloat(std::string& out, float v)
+{
+    if (!isfinite(v))
+    {
+        out.append("null", 4);
+        return;
+    }
+
+    // whole numbers are common (and exact) below 2^24
+    if (fabsf(v) < 16777216.0f && v == (float)(int)v)
+    {
+        appendInt(out, (int)v);
+        return;
+    }
+
+    // most other values are short decimals: find the fewest fraction
+    // digits that read back as `v` without going through printf
+    static const double __pow10[] = { 1, 10, 100, 1e3, 1e4, 1e5, 1e6 };
+    double d = fabs((double)v);
+    if (d >= 1e-3 && d < 1e7)
+    {
+        for (int k = 1; k <= 6; ++k)
+        {
+            long long m = (long long)(d * __pow10[k] + 0.5);
+            if ((float)(m / __pow10[k]) != (float)d)
+                continue;
+
+            long long scale = (long long)__pow10[k];
+            long long frac = m % scale;
+            if (v < 0)
+                out.push_back('-');
+            appendInt(out, (int)(m / scale));
+            out.push_back('.');
+
+            char digits[8];
+            for (int i = k - 1; i >= 0; --i)
+            {
+                digits[i] = (char)('0' + frac % 10);
+                frac /= 10;
+            }
+            while (k > 1 && digits[k - 1] == '0')
+                --k;
+            out.append(digits, k);
+            return;
+        }
+    }
+
+    char buf[32];
+    for (int precision = 6; precision <= 9; ++precision)
+    {
+        int n = snprintf(buf, sizeof(buf), "%.*g", precision, (double)v);
+        if (precision == 9 || strtof(buf, nullptr) == v)
+        {
+            out.append(buf, n);
+            return;
+        }
+    }
+}
+
+///
+
+namespace {
+
+enum
+{
+    CLASS_QUOTE = 1,
+    CLASS_BACKSLASH = 2,
+    CLASS_OP = 4,
+    CLASS_WS = 8
+};
+
+struct ClassTable
+{
+    uint8_t classes[256];
+
+    ClassTable()
+    {
+        memset(classes, 0, sizeof(classes));
+        classes[(unsigned char)'"'] = CLASS_QUOTE;
+        classes[(unsigned char)'\\'] = CLASS_BACKSLASH;
+        classes[(unsigned char)'{'] = CLASS_OP;
+        classes[(unsigned char)'}'] = CLASS_OP;
+        classes[(unsigned char)'['] = CLASS_OP;
+        classes[(unsigned char)']'] = CLASS_OP;
+        classes[(unsigned char)':'] = CLASS_OP;
+        classes[(unsigned char)','] = CLASS_OP;
+        classes[(unsigned char)' '] = CLASS_WS;
+        classes[(unsigned char)'\t'] = CLASS_WS;
+        classes[(unsigned char)'\n'] = CLASS_WS;
+        classes[(unsigned char)'\r'] = CLASS_WS;
+    }
+};
+
+const ClassTable __classTable;
+
+/**
+ * One bit per byte of a 64 byte block.
+ */
+struct BlockMasks
+{
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t ws;
+};
+
+void classifyScalar(const uint8_t* block, BlockMasks& masks)
+{
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        uint64_t c = __classTable.classes[block[i]];
+        quote |= (c & CLASS_QUOTE) << i;
+        backslash |= ((c & CLASS_BACKSLASH) >> 1) << i;
+        op |= ((c & CLASS_OP) >> 2) << i;
+        ws |= ((c & CLASS_WS) >> 3) << i;
+    }
+    masks.quote = quote;
+    masks.backslash = backslash;
+    masks.op = op;
+    masks.ws = ws;
+}
+
+#if IO_SIMD_X86
+
+// '[' and ']' are '{' and '}' with bit 5 cleared, so or-ing 0x20 folds
+// all four brackets into two compares
+
+IO_SIMD_TARGET("sse2")
+void classifySSE2(const uint8_t* block, BlockMasks& masks)
+{
+    const __m128i quoteChar = _mm_set1_epi8('"');
+    const __m128i backslashChar = _mm_set1_epi8('\\');
+    const __m128i openChar = _mm_set1_epi8('{');
+    const __m128i closeChar = _mm_set1_epi8('}');
+    const __m128i colonChar = _mm_set1_epi8(':');
+    const __m128i commaChar = _mm_set1_epi8(',');
+    const __m128i spaceChar = _mm_set1_epi8(' ');
+    const __m128i tabChar = _mm_set1_epi8('\t');
+    const __m128i lfChar = _mm_set1_epi8('\n');
+    const __m128i crChar = _mm_set1_epi8('\r');
+    const __m128i fold = _mm_set1_epi8(0x20);
+
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i * 16));
+        __m128i folded = _mm_or_si128(v, fold);
+
+        __m128i o = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, openChar), _mm_cmpeq_epi8(folded, closeChar)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, colonChar), _mm_cmpeq_epi8(v, commaChar)));
+        __m128i w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, spaceChar), _mm_cmpeq_epi8(v, tabChar)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, lfChar), _mm_cmpeq_epi8(v, crChar)));
+
+        quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quoteChar)) << (i * 16);
+        backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslashChar)) << (i * 16);
+        op |= (uint64_t)(uint16_t)_mm_movemask_epi8(o) << (i * 16);
+        ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(w) << (i * 16);
+    }
+    masks.quote = quote;
+    masks.backslash = backslash;
+    masks.op = op;
+    masks.ws = ws;
+}
+
+IO_SIMD_TARGET("avx2")
+void classifyAVX2(const uint8_t* block, BlockMasks& masks)
+{
+    const __m256i quoteChar = _mm256_set1_epi8('"');
+    const __m256i backslashChar = _mm256_set1_epi8('\\');
+    const __m256i openChar = _mm256_set1_epi8('{');
+    const __m256i closeChar = _mm256_set1_epi8('}');
+    const __m256i colonChar = _mm256_set1_epi8(':');
+    const __m256i commaChar = _mm256_set1_epi8(',');
+    const __m256i spaceChar = _mm256_set1_epi8(' ');
+    const __m256i tabChar = _mm256_set1_epi8('\t');
+    const __m256i lfChar = _mm256_set1_epi8('\n');
+    const __m256i crChar = _mm256_set1_epi8('\r');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i * 32));
+        __m256i folded = _mm256_or_si256(v, fold);
+
+        __m256i o = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, openChar), _mm256_cmpeq_epi8(folded, closeChar)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, colonChar), _mm256_cmpeq_epi8(v, commaChar)));
+        __m256i w = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, spaceChar), _mm256_cmpeq_epi8(v, tabChar)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, lfChar), _mm256_cmpeq_epi8(v, crChar)));
+
+        quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quoteChar)) << (i * 32);
+        backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslashChar)) << (i * 32);
+        op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(o) << (i * 32);
+        ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(w) << (i * 32);
+    }
+    masks.quote = quote;
+    masks.backslash = backslash;
+    masks.op = op;
+    masks.ws = ws;
+}
+
+#endif // IO_SIMD_X86
+
+typedef void (*ClassifyFunc)(const uint8_t* block, BlockMasks& masks);
+
+ClassifyFunc selectClassify()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return classifyAVX2;
+    if (simd::hasSSE2())
+        return classifySSE2;
+#endif
+    return classifyScalar;
+}
+
+const ClassifyFunc __classify = selectClassify();
+
+/**
+ * Bits of the characters escaped by a backslash, carrying odd backslash
+ * runs over to the next block in `prevEscaped`.
+ */
+inline uint64_t findEscaped(uint64_t backslash, uint64_t& prevEscaped)
+{
+    const uint64_t evenBits = 0x5555555555555555ULL;
+
+    backslash &= ~prevEscaped;
+    uint64_t followsEscape = (backslash << 1) | prevEscaped;
+
+    // runs of backslashes starting on an odd bit, added to the run itself,
+    // carry out past the run's end exactly when the run is odd in length
+    uint64_t oddStarts = backslash & ~evenBits & ~followsEscape;
+    uint64_t evenStartRuns = oddStarts + backslash;
+    prevEscaped = evenStartRuns < oddStarts ? 1 : 0;
+
+    uint64_t invert = evenStartRuns << 1;
+    return (evenBits ^ invert) & followsEscape;
+}
+
+/**
+ * Bit i is set when an odd number of bits at or below i are set; with
+ * quote bits that marks the inside of strings.
+ */
+inline uint64_t prefixXor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+inline int countTrailingZeros(uint64_t x)
+{
+    return __builtin_ctzll(x);
+}
+
+inline bool isDigit(uint8_t c)
+{
+    return (uint8_t)(c - '0') < 10;
+}
+
+inline bool isDelimiter(uint8_t c)
+{
+    return (__classTable.classes[c] & (CLASS_OP | CLASS_WS)) != 0;
+}
+
+inline int hexValue(uint8_t c)
+{
+    if (isDigit(c))
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+bool parseHex4(const char* p, uint32_t& out)
+{
+    out = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        int v = hexValue((uint8_t)p[i]);
+        if (v < 0)
+            return false;
+        out = (out << 4) | (uint32_t)v;
+    }
+    return true;
+}
+
+void appendUtf8(std::string& out, uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        out.push_back((char)cp);
+    }
+    else if (cp < 0x800)
+    {
+        char buf[2] = { (char)(0xc0 | (cp >> 6)), (char)(0x80 | (cp & 0x3f)) };
+        out.append(buf, 2);
+    }
+    else if (cp < 0x10000)
+    {
+        char buf[3] = { (char)(0xe0 | (cp >> 12)), (char)(0x80 | ((cp >> 6) & 0x3f)), (char)(0x80 | (cp & 0x3f)) };
+        out.append(buf, 3);
+    }
+    else
+    {
+        char buf[4] = { (char)(0xf0 | (cp >> 18)), (char)(0x80 | ((cp >> 12) & 0x3f)),
+                        (char)(0x80 | ((cp >> 6) & 0x3f)), (char)(0x80 | (cp & 0x3f)) };
+        out.append(buf, 4);
+    }
+}
+
+// powers of ten that are exact in a double
+const double __exactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const int MAX_DEPTH = 512;
+
+} // namespace {
+
+Parser::Parser()
+: _count(0)
+, _next(0)
+, _json(nullptr)
+, _len(0)
+, _resource(nullptr)
+, _shallowText(nullptr)
+{
+}
+
+bool Parser::parse(const char* json, size_t len, Value& out, MemoryResource* resource)
+{
+    out.reset();
+    if (len == 0 || len >= UINT32_MAX)
+        return false;
+
+    _json = (const uint8_t*)json;
+    _len = len;
+    _resource = resource;
+    _next = 0;
+
+    if (!index())
+        return false;
+
+    Value value;
+    bool ok = parseValue(value, 0) && _next == _count;
+
+    // drop what a failed parse left behind while `resource` is still alive
+    _values.clear();
+    _keys.clear();
+
+    if (ok)
+        out = std::move(value);
+    return ok;
+}
+
+bool Parser::parseShallow(const Buffer& text, Value& out, MemoryResource* resource)
+{
+    _shallowText = &text;
+    bool ok = parse((const char*)text.data(), text.length(), out, resource);
+    _shallowText = nullptr;
+    return ok;
+}
+
+bool Parser::index()
+{
+    // there can't be more structural positions than bytes
+    if (_structurals.size() < _len)
+        _structurals.resize(_len);
+    uint32_t* out = &_structurals[0];
+
+    uint64_t prevEscaped = 0;
+    uint64_t prevInString = 0;
+    uint64_t prevScalar = 0;
+    BlockMasks masks;
+    uint8_t tail[64];
+
+    for (size_t offset = 0; offset < _len; offset += 64)
+    {
+        const uint8_t* block = _json + offset;
+        if (_len - offset < 64)
+        {
+            // pad the last block with whitespace
+            memcpy(tail, block, _len - offset);
+            memset(tail + (_len - offset), ' ', 64 - (_len - offset));
+            block = tail;
+        }
+
+        __classify(block, masks);
+
+        uint64_t escaped = findEscaped(masks.backslash, prevEscaped);
+        uint64_t quote = masks.quote & ~escaped;
+        uint64_t inString = prefixXor(quote) ^ prevInString;
+        prevInString = (uint64_t)((int64_t)inString >> 63);
+
+        // first byte of every number or literal
+        uint64_t scalar = ~(masks.op | masks.ws) & ~quote;
+        uint64_t followsScalar = (scalar << 1) | prevScalar;
+        prevScalar = scalar >> 63;
+        uint64_t scalarStart = scalar & ~followsScalar;
+
+        uint64_t structural = ((masks.op | scalarStart) & ~inString) | quote;
+        while (structural)
+        {
+            *out++ = (uint32_t)(offset + countTrailingZeros(structural));
+            structural &= structural - 1;
+        }
+    }
+
+    _count = out - &_structurals[0];
+
+    // an unterminated string
+    return prevInString == 0;
+}
+
+bool Parser::parseValue(Value& out, int depth)
+{
+    if (_next >= _count)
+        return false;
+
+    uint32_t pos = _structurals[_next++];
+    switch (_json[pos])
+    {
+        case '{':
+        case '[':
+            if (_shallowText != nullptr && depth > 0)
+            {
+                uint32_t end;
+                if (!skipContainer(end))
+                    return false;
+                out = Value::lazyJson(_shallowText->slice(pos, end + 1 - pos),
+                                      _json[pos] == '{' ? Value::Type::OBJECT : Value::Type::ARRAY,
+                                      _resource);
+                return true;
+            }
+            if (_json[pos] == '{')
+                return parseObject(out, depth + 1);
+            return parseArray(out, depth + 1);
+        case '"':
+        {
+            std::string str;
+            if (!parseString(pos, str))
+                return false;
+            out = std::move(str);
+            return true;
+        }
+        case 't':
+            if (!parseLiteral(pos, "true", 4))
+                return false;
+            out = true;
+            return true;
+        case 'f':
+            if (!parseLiteral(pos, "false", 5))
+                return false;
+            out = false;
+            return true;
+        case 'n':
+            if (!parseLiteral(pos, "null", 4))
+                return false;
+            out.reset();
+            return true;
+        default:
+            return parseNumber(pos, out);
+    }
+}
+
+bool Parser::parseObject(Value& out, int depth)
+{
+    if (depth > MAX_DEPTH || _next >= _count)
+        return false;
+
+    // members are collected on the parser's stacks first so the object is
+    // allocated once, at its final size
+    size_t mark = _values.size();
+    if (_json[_structurals[_next]] == '}')
+    {
+        ++_next;
+    }
+    else
+    {
+        for (;;)
+        {
+            if (_next + 2 >= _count)
+                return false;
+
+            uint32_t pos = _structurals[_next++];
+            if (_json[pos] != '"')
+                return false;
+
+            _keys.emplace_back();
+            if (!parseString(pos, _keys.back()) || _json[_structurals[_next++]] != ':')
+                return false;
+
+            Value value;
+            if (!parseValue(value, depth))
+                return false;
+            _values.push_back(std::move(value));
+
+            if (_next >= _count)
+                return false;
+
+            uint8_t c = _json[_structurals[_next++]];
+            if (c == '}')
+                break;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    size_t count = _values.size() - mark;
+    size_t keyMark = _keys.size() - count;
+
+    ValueObject obj(_resource);
+    obj.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Value& value = _values[mark + i];
+
+        // the last duplicate wins, like JSON.parse
+        auto ret = obj.emplace(std::move(_keys[keyMark + i]), std::move(value));
+        if (!ret.second)
+            ret.first->second = std::move(value);
+    }
+
+    _values.resize(mark);
+    _keys.resize(keyMark);
+
+    out = std::move(obj);
+    return true;
+}
+
+bool Parser::parseArray(Value& out, int depth)
+{
+    if (depth > MAX_DEPTH || _next >= _count)
+        return false;
+
+    size_t mark = _values.size();
+    if (_json[_structurals[_next]] == ']')
+    {
+        ++_next;
+    }
+    else
+    {
+        for (;;)
+        {
+            Value value;
+            if (!parseValue(value, depth))
+                return false;
+            _values.push_back(std::move(value));
+
+            if (_next >= _count)
+                return false;
+
+            uint8_t c = _json[_structurals[_next++]];
+            if (c == ']')
+                break;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    ValueArray arr(_resource);
+    arr.reserve(_values.size() - mark);
+    for (size_t i = mark; i < _values.size(); ++i)
+        arr.push_back(std::move(_values[i]));
+
+    _values.resize(mark);
+
+    out = std::move(arr);
+    return true;
+}
+
+bool Parser::parseString(uint32_t begin, std::string& out)
+{
+    // stage one put the closing quote right after the opening one
+    if (_next >= _count)
+        return false;
+    uint32_t close = _structurals[_next++];
+    if (_json[close] != '"')
+        return false;
+
+    const char* p = (const char*)_json + begin + 1;
+    const char* end = (const char*)_json + close;
+
+    const char* backslash = (const char*)memchr(p, '\\', end - p);
+    if (backslash == nullptr)
+    {
+        out.assign(p, end - p);
+        return true;
+    }
+
+    out.reserve(end - p);
+    while (backslash != nullptr)
+    {
+        out.append(p, backslash - p);
+
+        // a backslash can't be last, it would have escaped the quote
+        p = backslash + 2;
+        switch (backslash[1])
+        {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u':
+            {
+                uint32_t cp;
+                if (end - p < 4 || !parseHex4(p, cp))
+                    return false;
+                p += 4;
+
+                if (cp >= 0xd800 && cp < 0xdc00)
+                {
+                    // high surrogate, must be followed by \uDC00-\uDFFF
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parseHex4(p + 2, low)
+                        || low < 0xdc00 || low >= 0xe000)
+                        return false;
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (cp >= 0xdc00 && cp < 0xe000)
+                {
+                    return false;
+                }
+                appendUtf8(out, cp);
+            }
+                break;
+            default:
+                return false;
+        }
+
+        backslash = (const char*)memchr(p, '\\', end - p);
+    }
+
+    out.append(p, end - p);
+    return true;
+}
+
+bool Parser::parseNumber(uint32_t begin, Value& out)
+{
+    const uint8_t* p = _json + begin;
+    const uint8_t* end = _json + _len;
+
+    bool negative = false;
+    if (*p == '-')
+    {
+        negative = true;
+        ++p;
+    }
+    if (p == end || !isDigit(*p))
+        return false;
+
+    // up to 19 significant digits, the rest only moves the exponent
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool integer = true;
+
+    if (*p == '0')
+    {
+        ++p;
+    }
+    else
+    {
+        for (; p < end && isDigit(*p); ++p)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                ++digits;
+            }
+            else
+            {
+                ++exponent;
+            }
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        integer = false;
+        ++p;
+        if (p == end || !isDigit(*p))
+            return false;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    ++digits;
+                --exponent;
+            }
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        integer = false;
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            negativeExponent = *p == '-';
+            ++p;
+        }
+        if (p == end || !isDigit(*p))
+            return false;
+
+        int e = 0;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            if (e < 100000)
+                e = e * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if (p < end && !isDelimiter(*p))
+        return false;
+
+    if (integer && exponent == 0 && mantissa <= (negative ? 2147483648ULL : 2147483647ULL))
+    {
+        out = negative ? (int)(-(int64_t)mantissa) : (int)mantissa;
+        return true;
+    }
+
+    double value = (double)mantissa;
+    if (mantissa != 0 && exponent != 0)
+    {
+        // exact when both the mantissa and the power of ten fit a double
+        // (Clinger's fast path); otherwise still far more precise than
+        // the float we store
+        if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+            value = exponent < 0 ? value / __exactPow10[-exponent] : value * __exactPow10[exponent];
+        else
+            value *= pow(10.0, exponent);
+    }
+
+    out = (float)(negative ? -value : value);
+    return true;
+}
+
+bool Parser::skipContainer(uint32_t& end)
+{
+    // _next is just past the opening bracket
+    int depth = 1;
+    while (_next < _count)
+    {
+        uint32_t pos = _structurals[_next++];
+        switch (_json[pos])
+        {
+            case '{':
+            case '[':
+                ++depth;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0)
+                {
+                    end = pos;
+                    return true;
+                }
+                break;
+            case '"':
+                // and its closing quote
+                ++_next;
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+bool Parser::parseLiteral(uint32_t begin, const char* literal, size_t len)
+{
+    if (_len - begin < len || memcmp(_json + begin, literal, len) != 0)
+        return false;
+    return _len - begin == len || isDelimiter(_json[begin + len]);
+}
+
+bool parse(const char* json, size_t len, Value& out, MemoryResource* resource)
+{
+    Parser parser;
+    return parser.parse(json, len, out, resource);
+}
+
+bool parse(const std::string& json, Value& out, MemoryResource* resource)
+{
+    Parser parser;
+    return parser.parse(json.data(), json.size(), out, resource);
+}
+
+} // namespace json {
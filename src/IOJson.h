@@ -0,0 +1,135 @@
+#pragma once
+
+#include "IOTypes.h"
+
+namespace json {
+
+/**
+ * Serializes `value` as JSON and appends it to `out`, the same way
+ * JSON.stringify would: functions are skipped inside objects and become
+ * null inside arrays, non finite floats become null.
+ *
+ * Binary data has no JSON form; it is expected to be replaced by
+ * placeholders (see binary::deconstructPacket) before getting here and is
+ * written as null otherwise.
+ *
+ * `out` is not reserved here; callers writing more than the JSON text
+ * reserve once with estimateSize.
+ *
+ * @param {Value} value
+ * @param {String} out - buffer to append to, reused by the caller
+ * @api public
+ */
+
+void stringify(const Value& value, std::string& out);
+
+std::string stringify(const Value& value);
+
+/**
+ * Number of bytes `stringify` will most likely need for `value`. It does
+ * not look for characters that need escaping, so it is a hint for
+ * reserve() rather than an exact size.
+ *
+ * Binary data counts its length, the size it takes on the wire as an
+ * attachment, which makes this the encoded size of emitted arguments too.
+ *
+ * @api public
+ */
+
+size_t estimateSize(const Value& value);
+
+/**
+ * Appends `str` as a quoted, escaped JSON string.
+ *
+ * @api public
+ */
+
+void appendString(std::string& out, const char* str, size_t len);
+
+/**
+ * Appends the decimal form of `v` without going through a stream.
+ *
+ * @api public
+ */
+
+void appendInt(std::string& out, int v);
+
+/**
+ * Appends the shortest decimal form of `v` that reads back as the same
+ * float.
+ *
+ * @api public
+ */
+
+void appendFloat(std::string& out, float v);
+
+/**
+ * JSON parser producing Value trees.
+ *
+ * Stage one classifies the text 64 bytes at a time (AVX2 or SSE2 when the
+ * CPU has them, a lookup table otherwise) and records the position of
+ * every quote, every structural character outside of strings and the
+ * first byte of each number or literal. Stage two walks those positions,
+ * so whitespace is never looked at again and strings are copied in bulk
+ * between escapes.
+ *
+ * Keep a parser around to reuse its position buffer between calls.
+ */
+class Parser
+{
+public:
+    Parser();
+
+    /**
+     * Parses `len` bytes of JSON text into `out`. Arrays and objects are
+     * allocated from `resource` (default heap when null).
+     *
+     * Numbers that fit an int become INTEGER, everything else FLOAT; null
+     * becomes an empty Value.
+     *
+     * @return {Boolean} false if the text is not valid JSON, `out` is left
+     *   empty then
+     * @api public
+     */
+    bool parse(const char* json, size_t len, Value& out, MemoryResource* resource = nullptr);
+
+    /**
+     * Like parse, but only the first level of `text` is decoded: arrays
+     * and objects nested in it become lazy values holding slices of
+     * `text` (see Value::lazyJson). Nested text is only checked for
+     * balanced brackets until it is looked into.
+     *
+     * @api public
+     */
+    bool parseShallow(const Buffer& text, Value& out, MemoryResource* resource = nullptr);
+
+private:
+    Parser(const Parser&);
+    Parser& operator=(const Parser&);
+
+    bool index();
+    bool parseValue(Value& out, int depth);
+    bool parseObject(Value& out, int depth);
+    bool parseArray(Value& out, int depth);
+    bool parseString(uint32_t begin, std::string& out);
+    bool parseNumber(uint32_t begin, Value& out);
+    bool parseLiteral(uint32_t begin, const char* literal, size_t len);
+    bool skipContainer(uint32_t& end);
+
+    std::vector<uint32_t> _structurals;
+    std::vector<Value> _values; // array elements and object members being parsed
+    std::vector<std::string> _keys;
+    size_t _count;
+    size_t _next;
+
+    const uint8_t* _json;
+    size_t _len;
+    MemoryResource* _resource;
+    const Buffer* _shallowText; // set while parsing shallow
+};
+
+bool parse(const char* json, size_t len, Value& out, MemoryResource* resource = nullptr);
+
+bool parse(const std::string& json, Value& out, MemoryResource* resource = nullptr);
+
+} // namespace json {
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+/**
+ * FIFO queue over a growable ring of slots.
+ *
+ * Pushing and popping are O(1) and never shift the queued elements. The
+ * capacity is a power of two and doubles when the ring is full. Popped
+ * slots are not destroyed; the next push hands them out again, so the
+ * strings and containers inside an element keep their capacity from one
+ * use to the next. A caller that mustn't hold on to what a popped element
+ * references (a large payload, say) releases it before popping.
+ *
+ * Not thread safe.
+ */
+
+template <typename T>
+class RingBuffer
+{
+public:
+    RingBuffer()
+    : _head(0)
+    , _size(0)
+    {}
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+    size_t capacity() const { return _slots.size(); }
+
+    T& operator[](size_t i) { return _slots[(_head + i) & (_slots.size() - 1)]; }
+    const T& operator[](size_t i) const { return _slots[(_head + i) & (_slots.size() - 1)]; }
+
+    T& front() { return _slots[_head]; }
+    const T& front() const { return _slots[_head]; }
+
+    /**
+     * Appends a slot and returns it, still holding whatever element last
+     * used it, so the caller assigns every field.
+     *
+     * @api public
+     */
+
+    T& push()
+    {
+        if (_size == _slots.size())
+            grow();
+        return (*this)[_size++];
+    }
+
+    void push(T&& value) { push() = std::move(value); }
+    void push(const T& value) { push() = value; }
+
+    /**
+     * Removes the first `n` elements, leaving their slots for reuse.
+     *
+     * @api public
+     */
+
+    void pop(size_t n = 1)
+    {
+        n = std::min(n, _size);
+        _size -= n;
+        // an empty ring starts over at slot 0, which keeps the elements
+        // contiguous for `linearize` as long as the queue drains
+        _head = _size == 0 ? 0 : (_head + n) & (_slots.size() - 1);
+    }
+
+    /**
+     * Removes every element, releasing what they hold but keeping the
+     * slots.
+     *
+     * @api public
+     */
+
+    void clear()
+    {
+        for (size_t i = 0; i < _size; ++i)
+            (*this)[i] = T();
+        _head = 0;
+        _size = 0;
+    }
+
+    /**
+     * Returns the elements as one array, rotating the slots first if the
+     * queue wraps around the end of the ring.
+     *
+     * @api public
+     */
+
+    T* linearize()
+    {
+        if (_slots.empty())
+            return nullptr;
+        if (_head + _size > _slots.size())
+        {
+            std::rotate(_slots.begin(), _slots.begin() + _head, _slots.end());
+            _head = 0;
+        }
+        return &_slots[_head];
+    }
+
+private:
+    void grow()
+    {
+        std::vector<T> slots(std::max(_slots.size() * 2, (size_t)8));
+        for (size_t i = 0; i < _size; ++i)
+            slots[i] = std::move((*this)[i]);
+        _slots.swap(slots);
+        _head = 0;
+    }
+
+    std::vector<T> _slots;
+    size_t _head;
+    size_t _size;
+};
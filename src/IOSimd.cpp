@@ -0,0 +1,50 @@
+#include "IOSimd.h"
+
+namespace simd {
+
+namespace {
+
+struct Features
+{
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+
+    Features()
+    : sse2(false)
+    , ssse3(false)
+    , avx2(false)
+    {
+#if IO_SIMD_X86
+        __builtin_cpu_init();
+        sse2 = __builtin_cpu_supports("sse2");
+        ssse3 = __builtin_cpu_supports("ssse3");
+        avx2 = __builtin_cpu_supports("avx2");
+#endif
+    }
+};
+
+const Features& getFeatures()
+{
+    static Features __features;
+    return __features;
+}
+
+} // namespace {
+
+bool hasSSE2()
+{
+    return getFeatures().sse2;
+}
+
+bool hasSSSE3()
+{
+    return getFeatures().ssse3;
+}
+
+bool hasAVX2()
+{
+    return getFeatures().avx2;
+}
+
+} // namespace simd {
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * Runtime CPU feature detection for the vectorized kernels (JSON scanning,
+ * base64, UTF-8 validation, WebSocket masking).
+ *
+ * Kernels are compiled with per-function target attributes, so the rest of
+ * the library keeps the baseline instruction set and the best kernel is
+ * picked once at startup.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define IO_SIMD_X86 1
+#define IO_SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IO_SIMD_X86 0
+#define IO_SIMD_TARGET(isa)
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define IO_SIMD_NEON 1
+#else
+#define IO_SIMD_NEON 0
+#endif
+
+namespace simd {
+
+bool hasSSE2();
+bool hasSSSE3();
+bool hasAVX2();
+
+} // namespace simd {
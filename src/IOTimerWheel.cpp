@@ -0,0 +1,245 @@
+#include "IOTimerWheel.h"
+
+#include <assert.h>
+
+static const uint64_t MAX_DELAY = 0xffffffffull;
+static const uint32_t GENERATION_MASK = 0x7fffffffu;
+
+TimerWheel::TimerWheel(uint64_t now)
+: _count(0)
+, _base(now)
+, _now(now)
+{
+    for (auto& head : _heads)
+        head = NIL;
+    for (auto& tail : _tails)
+        tail = NIL;
+    for (auto& count : _levelCounts)
+        count = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+}
+
+TimerHandle TimerWheel::add(const std::function<void()>& cb, uint64_t delay)
+{
+    uint32_t index;
+    if (_free.empty())
+    {
+        index = (uint32_t)_timers.size();
+        _timers.emplace_back();
+        _timers.back().generation = 1;
+    }
+    else
+    {
+        index = _free.back();
+        _free.pop_back();
+    }
+
+    Timer& t = _timers[index];
+    t.cb = cb;
+    t.expires = _now + (delay < MAX_DELAY ? delay : MAX_DELAY);
+    if (t.expires < _base)
+        t.expires = _base;
+
+    schedule(index);
+    ++_count;
+
+    return ((TimerHandle)(t.generation & GENERATION_MASK) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerHandle handle)
+{
+    if (handle < 0)
+        return false;
+
+    uint32_t index = (uint32_t)(handle & 0xffffffff);
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (index >= _timers.size())
+        return false;
+
+    const Timer& t = _timers[index];
+    if ((t.generation & GENERATION_MASK) != generation || t.list == NIL)
+        return false;
+
+    unlink(index);
+    release(index);
+    return true;
+}
+
+void TimerWheel::schedule(uint32_t index)
+{
+    const Timer& t = _timers[index];
+    assert(t.expires >= _base);
+
+    uint64_t delta = t.expires - _base;
+    uint32_t level = 0;
+    while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1))))
+        ++level;
+
+    uint32_t slot = (uint32_t)(t.expires >> (SLOT_BITS * level)) & SLOT_MASK;
+    link(index, level * SLOTS + slot);
+}
+
+void TimerWheel::link(uint32_t index, uint32_t list)
+{
+    Timer& t = _timers[index];
+    t.list = list;
+    t.next = NIL;
+    t.prev = _tails[list];
+
+    if (t.prev == NIL)
+        _heads[list] = index;
+    else
+        _timers[t.prev].next = index;
+    _tails[list] = index;
+
+    if (list != FIRING)
+        ++_levelCounts[list / SLOTS];
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+    Timer& t = _timers[index];
+
+    if (t.prev == NIL)
+        _heads[t.list] = t.next;
+    else
+        _timers[t.prev].next = t.next;
+
+    if (t.next == NIL)
+        _tails[t.list] = t.prev;
+    else
+        _timers[t.next].prev = t.prev;
+
+    if (t.list != FIRING)
+        --_levelCounts[t.list / SLOTS];
+    t.list = NIL;
+}
+
+void TimerWheel::release(uint32_t index)
+{
+    Timer& t = _timers[index];
+    t.cb = nullptr;
+    ++t.generation;
+    _free.push_back(index);
+    --_count;
+}
+
+void TimerWheel::cascade(uint32_t level, uint32_t slot)
+{
+    uint32_t list = level * SLOTS + slot;
+    uint32_t index = _heads[list];
+    _heads[list] = NIL;
+    _tails[list] = NIL;
+
+    while (index != NIL)
+    {
+        uint32_t next = _timers[index].next;
+        --_levelCounts[level];
+        schedule(index);
+        index = next;
+    }
+}
+
+size_t TimerWheel::advance(uint64_t now)
+{
+    if (now > _now)
+        _now = now;
+
+    size_t fired = 0;
+    while (_base <= _now)
+    {
+        if (_count == 0)
+        {
+            _base = _now + 1;
+            break;
+        }
+
+        uint32_t slot = (uint32_t)_base & SLOT_MASK;
+        if (slot == 0)
+        {
+            for (uint32_t level = 1; level < LEVELS; ++level)
+            {
+                uint32_t s = (uint32_t)(_base >> (SLOT_BITS * level)) & SLOT_MASK;
+                if (_levelCounts[level] > 0)
+                    cascade(level, s);
+                if (s != 0)
+                    break;
+            }
+        }
+        else if (_levelCounts[0] == 0)
+        {
+            // nothing due before level 0 wraps and the levels above cascade
+            uint64_t wrap = (_base | SLOT_MASK) + 1;
+            _base = wrap < _now + 1 ? wrap : _now + 1;
+            continue;
+        }
+
+        uint32_t index = _heads[slot];
+        ++_base;
+        if (index == NIL)
+            continue;
+
+        // park the slot so callbacks can cancel timers not fired yet
+        _heads[slot] = NIL;
+        _tails[slot] = NIL;
+        while (index != NIL)
+        {
+            uint32_t next = _timers[index].next;
+            --_levelCounts[0];
+            link(index, FIRING);
+            index = next;
+        }
+
+        while (_heads[FIRING] != NIL)
+        {
+            index = _heads[FIRING];
+            std::function<void()> cb = std::move(_timers[index].cb);
+            unlink(index);
+            release(index);
+
+            // may add or cancel timers, don't hold on to _timers
+            cb();
+            ++fired;
+        }
+    }
+
+    return fired;
+}
+
+int64_t TimerWheel::nextTimeout() const
+{
+    if (_count == 0)
+        return -1;
+
+    uint64_t next = 0;
+    bool found = false;
+
+    if (_levelCounts[0] > 0)
+    {
+        for (uint32_t i = 0; i < SLOTS; ++i)
+        {
+            if (_heads[(uint32_t)(_base + i) & SLOT_MASK] != NIL)
+            {
+                next = _base + i;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    // the levels above only come down when level 0 wraps
+    if (_count > _levelCounts[0])
+    {
+        uint64_t wrap = (_base + SLOT_MASK) & ~(uint64_t)SLOT_MASK;
+        if (!found || wrap < next)
+        {
+            next = wrap;
+            found = true;
+        }
+    }
+
+    return next > _now ? (int64_t)(next - _now) : 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "IOTypes.h"
+
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Hierarchical timing wheel with millisecond ticks.
+ *
+ * Four levels of 256 slots: level 0 holds the timers due in the next 256
+ * ticks one slot per tick, each level above covers 256 times the range
+ * of the one below and is cascaded down when the level below wraps
+ * around. Adding and cancelling are O(1) whatever the number of timers,
+ * which is what re-arming a ping timer on every packet of thousands of
+ * connections needs. Delays are capped at 2^32 - 1 ms, about 49 days.
+ *
+ * Timers live in a slab and are found by index; a handle carries the
+ * index together with the generation of the slot, bumped every time the
+ * slot is freed, so a stale handle never cancels the timer that reused
+ * its slot.
+ *
+ * Not thread safe, a wheel belongs to the thread driving it.
+ */
+
+class TimerWheel
+{
+public:
+    explicit TimerWheel(uint64_t now = 0);
+    ~TimerWheel();
+
+    /**
+     * Schedules `cb` at `now + delay` ticks, where `now` is the time of
+     * the last `advance`. Timers added while firing run at the earliest on
+     * the next tick.
+     *
+     * @api public
+     */
+
+    TimerHandle add(const std::function<void()>& cb, uint64_t delay);
+
+    /**
+     * Cancels a pending timer.
+     *
+     * @return {Boolean} false if `handle` already fired, was cancelled or
+     * is not from this wheel
+     * @api public
+     */
+
+    bool cancel(TimerHandle handle);
+
+    /**
+     * Fires every timer due at or before `now`, in expiry order.
+     *
+     * @return {Number} timers fired
+     * @api public
+     */
+
+    size_t advance(uint64_t now);
+
+    /**
+     * Ticks from the last `advance` until the wheel has something to do:
+     * a timer to fire, or a higher level to cascade, which may be earlier
+     * than the first timer but never later. -1 when there are no timers.
+     *
+     * @api public
+     */
+
+    int64_t nextTimeout() const;
+
+    size_t size() const { return _count; }
+    uint64_t now() const { return _now; }
+
+private:
+    static const uint32_t LEVELS = 4;
+    static const uint32_t SLOT_BITS = 8;
+    static const uint32_t SLOTS = 1 << SLOT_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const uint32_t NIL = 0xffffffffu;
+
+    // timers being fired, so callbacks can cancel the ones still pending
+    static const uint32_t FIRING = LEVELS * SLOTS;
+
+    struct Timer
+    {
+        std::function<void()> cb;
+        uint64_t expires;
+        uint32_t generation;
+        uint32_t list;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    void schedule(uint32_t index);
+    void link(uint32_t index, uint32_t list);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(uint32_t level, uint32_t slot);
+
+    std::vector<Timer> _timers;
+    std::vector<uint32_t> _free;
+
+    // lists of timers by slot, LEVELS * SLOTS of them then FIRING;
+    // appended at the tail so timers due on the same tick fire in order
+    uint32_t _heads[LEVELS * SLOTS + 1];
+    uint32_t _tails[LEVELS * SLOTS + 1];
+    size_t _levelCounts[LEVELS];
+    size_t _count;
+
+    // next tick to process; every tick before it has fired
+    uint64_t _base;
+    uint64_t _now;
+};
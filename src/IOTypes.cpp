@@ -1,91 +1,132 @@
 #include "IOTypes.h"
+#include "IOJson.h"
+#include "IOBase64.h"
 
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stddef.h>
+#include <new>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+
+const size_t Buffer::INLINE_CAPACITY;
 
 Buffer::Buffer()
 : _data(nullptr)
 , _len(0)
+, _storage(nullptr)
 , _isBinary(false)
 {
 
 }
 
 Buffer::Buffer(const uint8_t* data, size_t len)
-: _len(len)
+: _data(nullptr)
+, _len(0)
+, _storage(nullptr)
 , _isBinary(true)
 {
-    if (_len > 0)
-    {
-        _data = (uint8_t*) malloc(_len);
-        if (data) {
-            memcpy(_data, data, _len);
-        } else {
-            memset(_data, 0, _len);
-        }
-    }
+    assign(data, len, true);
 }
 
 Buffer::Buffer(const char* str)
-: _isBinary(false)
+: _data(nullptr)
+, _len(0)
+, _storage(nullptr)
+, _isBinary(false)
 {
-    _len = strlen(str);
-    _data = (uint8_t*) malloc(_len + 1);
-    _data[_len] = '\0';
-    strcpy((char*)_data, str);
+    assign((const uint8_t*)str, strlen(str), false);
 }
 
 Buffer::Buffer(const std::string& str)
-: _isBinary(false)
+: _data(nullptr)
+, _len(0)
+, _storage(nullptr)
+, _isBinary(false)
 {
-    _len = str.length();
-    _data = (uint8_t*) malloc(_len + 1);
-    _data[_len] = '\0';
-    strcpy((char*)_data, str.c_str());
+    assign((const uint8_t*)str.data(), str.length(), false);
 }
 
 Buffer::Buffer(const Buffer& o)
+: _data(nullptr)
+, _len(0)
+, _storage(nullptr)
+, _isBinary(false)
 {
-    _isBinary = o._isBinary;
-    _len = o._len;
-    _data = (uint8_t*) malloc(_len);
-    memcpy(_data, o._data, _len);
+    *this = o;
 }
 
-Buffer::Buffer(Buffer&& o)
+Buffer::Buffer(Buffer&& o) noexcept
+: _data(nullptr)
+, _len(0)
+, _storage(nullptr)
+, _isBinary(false)
 {
-    _isBinary = o._isBinary;
-    _len = o._len;
-    _data = o._data;
-    o._len = 0;
-    o._data = nullptr;
-    o._isBinary = false;
+    *this = std::move(o);
 }
 
 Buffer::~Buffer()
 {
-    free(_data);
+    release();
+}
+
+void Buffer::assign(const uint8_t* data, size_t len, bool isBinary)
+{
+    release();
+
+    _isBinary = isBinary;
+    _len = len;
+
+    // text buffers keep a trailing NUL so c_str() is always usable
+    size_t capacity = isBinary ? len : len + 1;
+    if (capacity == 0)
+        return;
+
+    uint8_t* bytes = _inline;
+    if (capacity > INLINE_CAPACITY)
+    {
+        _storage = (Storage*) malloc(offsetof(Storage, bytes) + capacity);
+        new (&_storage->refs) std::atomic<int>(1);
+        bytes = _storage->bytes;
+    }
+
+    if (data) {
+        memcpy(bytes, data, len);
+    } else {
+        memset(bytes, 0, len);
+    }
+
+    if (!isBinary)
+        bytes[len] = '\0';
+
+    _data = bytes;
+}
+
+void Buffer::release()
+{
+    if (_data != nullptr && !isInline())
+    {
+        if (_storage->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            free(_storage);
+    }
+    _data = nullptr;
+    _len = 0;
+    _storage = nullptr;
 }
 
 Buffer& Buffer::operator=(const char* str)
 {
-    _isBinary = false;
-    _len = strlen(str);
-    _data = (uint8_t*) malloc(_len + 1);
-    _data[_len] = '\0';
-    strcpy((char*)_data, str);
+    assign((const uint8_t*)str, strlen(str), false);
     return *this;
 }
 
 Buffer& Buffer::operator=(const std::string& str)
 {
-    _isBinary = false;
-    _len = str.length();
-    _data = (uint8_t*) malloc(_len + 1);
-    _data[_len] = '\0';
-    strcpy((char*)_data, str.c_str());
+    assign((const uint8_t*)str.data(), str.length(), false);
     return *this;
 }
 
@@ -93,23 +134,42 @@ Buffer& Buffer::operator=(const Buffer& o)
 {
     if (this != &o)
     {
-        _isBinary = o._isBinary;
-        _len = o._len;
-        _data = (uint8_t*) malloc(_len);
-        memcpy(_data, o._data, _len);
+        if (o._data == nullptr || o.isInline())
+        {
+            assign(o._data, o._len, o._isBinary);
+        }
+        else
+        {
+            o._storage->refs.fetch_add(1, std::memory_order_relaxed);
+            release();
+            _storage = o._storage;
+            _data = o._data;
+            _len = o._len;
+            _isBinary = o._isBinary;
+        }
     }
     return *this;
 }
 
-Buffer& Buffer::operator=(Buffer&& o)
+Buffer& Buffer::operator=(Buffer&& o) noexcept
 {
     if (this != &o)
     {
-        _isBinary = o._isBinary;
-        _len = o._len;
-        _data = o._data;
-        o._len = 0;
-        o._data = nullptr;
+        if (o._data == nullptr || o.isInline())
+        {
+            assign(o._data, o._len, o._isBinary);
+        }
+        else
+        {
+            release();
+            _storage = o._storage;
+            _data = o._data;
+            _len = o._len;
+            _isBinary = o._isBinary;
+            o._data = nullptr;
+            o._storage = nullptr;
+        }
+        o.release();
         o._isBinary = false;
     }
     return *this;
@@ -145,9 +205,51 @@ bool Buffer::isBinary() const
     return _isBinary;
 }
 
+Buffer Buffer::slice(size_t offset, size_t len) const
+{
+    Buffer ret;
+    if (offset >= _len)
+        return ret;
+
+    len = std::min(len, _len - offset);
+    ret._isBinary = _isBinary;
+
+    if (isInline() || len + 1 <= INLINE_CAPACITY)
+    {
+        ret.assign(_data + offset, len, _isBinary);
+    }
+    else
+    {
+        _storage->refs.fetch_add(1, std::memory_order_relaxed);
+        ret._storage = _storage;
+        ret._data = _data + offset;
+        ret._len = len;
+    }
+    return ret;
+}
+
+Buffer Buffer::slice(size_t offset) const
+{
+    return slice(offset, offset < _len ? _len - offset : 0);
+}
+
+uint8_t* Buffer::mutableData()
+{
+    if (_data != nullptr && !isInline() && _storage->refs.load(std::memory_order_acquire) > 1)
+    {
+        // copy-on-write: detach from the shared storage
+        Buffer copy;
+        copy.assign(_data, _len, _isBinary);
+        *this = std::move(copy);
+    }
+    return const_cast<uint8_t*>(_data);
+}
+
 std::string Buffer::toBase64String() const
 {
-    return "";
+    std::string ret;
+    base64::encode(_data, _len, ret);
+    return ret;
 }
 
 void Buffer::setData(off_t offset, const uint8_t* data, size_t len)
@@ -157,11 +259,42 @@ void Buffer::setData(off_t offset, const uint8_t* data, size_t len)
         return;
     }
 
-    memcpy(_data + offset, data, len);
+    memcpy(mutableData() + offset, data, len);
 }
 
 ///
 
+namespace {
+
+/**
+ * Array and object nodes are allocated from the same resource as the
+ * container they hold, so freeing one only needs the node itself.
+ */
+template<class T, class... Args>
+T* newNode(MemoryResource* resource, Args&&... args)
+{
+    ValueAllocator<T> alloc(resource);
+    T* p = alloc.allocate(1);
+    ::new((void*)p) T(std::forward<Args>(args)...);
+    return p;
+}
+
+template<class T>
+void deleteNode(T* p)
+{
+    ValueAllocator<T> alloc(p->get_allocator());
+    p->~T();
+    alloc.deallocate(p, 1);
+}
+
+} // namespace {
+
+struct Value::LazyJson
+{
+    Buffer text;
+    MemoryResource* resource;
+};
+
 ValueObject OBJECT_NONE;
 
 Value Value::NONE = Value();
@@ -178,61 +311,45 @@ Value::Value()
 }
 
 Value::Value(const Value& o)
+: _type(Type::NONE)
 {
-    _type = o._type;
-    switch (_type)
-    {
-        case Type::STRING:
-            _u.str = new std::string(*o._u.str);
-            break;
-        case Type::BINARY:
-            _u.buf = new Buffer(*o._u.buf);
-            break;
-        case Type::BOOLEAN:
-            _u.b = o._u.b;
-            break;
-        case Type::INTEGER:
-            _u.i = o._u.i;
-            break;
-        case Type::FLOAT:
-            _u.f = o._u.f;
-            break;
-        case Type::ARRAY:
-            _u.arr = new ValueArray(*o._u.arr);
-            break;
-        case Type::OBJECT:
-            _u.obj = new ValueObject(*o._u.obj);
-            break;
-        case Type::FUNCTION:
-            _u.func = new ValueFunction(*o._u.func);
-            break;
-        case Type::ENGINEIO_PACKET:
-            _u.ep = new EngineIOPacket(*o._u.ep);
-            break;
-        case Type::SOCKETIO_PACKET:
-            _u.sp = new SocketIOPacket(*o._u.sp);
-            break;
-        default:
-            break;
-    }
+    copyFrom(o);
+}
+
+Value::Value(Value&& o) noexcept
+: _type(Type::NONE)
+{
+    moveFrom(o);
 }
 
 Value::Value(const char* str)
 {
     _type = Type::STRING;
-    _u.str = new std::string(str);
+    new (inlineString()) std::string(str);
 }
 
 Value::Value(const std::string& str)
 {
     _type = Type::STRING;
-    _u.str = new std::string(str);
+    new (inlineString()) std::string(str);
+}
+
+Value::Value(std::string&& str) noexcept
+{
+    _type = Type::STRING;
+    new (inlineString()) std::string(std::move(str));
 }
 
 Value::Value(const Buffer& buf)
 {
     _type = Type::BINARY;
-    _u.buf = new Buffer(buf);
+    new (inlineBuffer()) Buffer(buf);
+}
+
+Value::Value(Buffer&& buf) noexcept
+{
+    _type = Type::BINARY;
+    new (inlineBuffer()) Buffer(std::move(buf));
 }
 
 Value::Value(bool v)
@@ -250,19 +367,31 @@ Value::Value(int intVal)
 Value::Value(float floatVal)
 {
     _type = Type::FLOAT;
-    _u.i = floatVal;
+    _u.f = floatVal;
 }
 
 Value::Value(const ValueArray& arrVal)
 {
     _type = Type::ARRAY;
-    _u.arr = new ValueArray(arrVal);
+    _u.arr = newNode<ValueArray>(nullptr, arrVal);
+}
+
+Value::Value(ValueArray&& arrVal)
+{
+    _type = Type::ARRAY;
+    _u.arr = newNode<ValueArray>(arrVal.get_allocator().resource(), std::move(arrVal));
 }
 
 Value::Value(const ValueObject& objVal)
 {
     _type = Type::OBJECT;
-    _u.obj = new ValueObject(objVal);
+    _u.obj = newNode<ValueObject>(nullptr, objVal);
+}
+
+Value::Value(ValueObject&& objVal)
+{
+    _type = Type::OBJECT;
+    _u.obj = newNode<ValueObject>(objVal.get_allocator().resource(), std::move(objVal));
 }
 
 Value::Value(const EngineIOPacket& packet)
@@ -271,62 +400,163 @@ Value::Value(const EngineIOPacket& packet)
     _u.ep = new EngineIOPacket(packet);
 }
 
+Value::Value(EngineIOPacket&& packet)
+{
+    _type = Type::ENGINEIO_PACKET;
+    _u.ep = new EngineIOPacket(std::move(packet));
+}
+
 Value::Value(const SocketIOPacket& packet)
 {
     _type = Type::SOCKETIO_PACKET;
     _u.sp = new SocketIOPacket(packet);
 }
 
+Value::Value(SocketIOPacket&& packet)
+{
+    _type = Type::SOCKETIO_PACKET;
+    _u.sp = new SocketIOPacket(std::move(packet));
+}
+
 Value::Value(const ValueFunction& func)
 {
     _type = Type::FUNCTION;
     _u.func = new ValueFunction(func);
 }
 
+Value::Value(const Value& o, MemoryResource* resource)
+: _type(Type::NONE)
+{
+    copyFrom(o, resource ? resource : getDefaultMemoryResource());
+}
+
+Value::Value(Value&& o, MemoryResource* resource)
+: _type(Type::NONE)
+{
+    if (resource == nullptr)
+        resource = getDefaultMemoryResource();
+
+    MemoryResource* current = o.getMemoryResource();
+    if (current == nullptr || current == resource)
+        moveFrom(o);
+    else
+        copyFrom(o, resource);
+}
+
 Value::~Value()
 {
     reset();
 }
 
+void Value::copyFrom(const Value& o, MemoryResource* resource)
+{
+    _type = o._type;
+    if (o._lazy)
+    {
+        // sharing the text is all a copy takes
+        _u.lazy = new LazyJson{ o._u.lazy->text, resource };
+        _lazy = true;
+        return;
+    }
+
+    switch (_type)
+    {
+        case Type::STRING:
+            new (inlineString()) std::string(*o.inlineString());
+            break;
+        case Type::BINARY:
+            new (inlineBuffer()) Buffer(*o.inlineBuffer());
+            break;
+        case Type::BOOLEAN:
+            _u.b = o._u.b;
+            break;
+        case Type::INTEGER:
+            _u.i = o._u.i;
+            break;
+        case Type::FLOAT:
+            _u.f = o._u.f;
+            break;
+        case Type::ARRAY:
+            if (resource)
+                _u.arr = newNode<ValueArray>(resource, *o._u.arr, ValueAllocator<Value>(resource));
+            else
+                _u.arr = newNode<ValueArray>(nullptr, *o._u.arr);
+            break;
+        case Type::OBJECT:
+            if (resource)
+                _u.obj = newNode<ValueObject>(resource, *o._u.obj, ValueObject::allocator_type(resource));
+            else
+                _u.obj = newNode<ValueObject>(nullptr, *o._u.obj);
+            break;
+        case Type::FUNCTION:
+            _u.func = new ValueFunction(*o._u.func);
+            break;
+        case Type::ENGINEIO_PACKET:
+            _u.ep = new EngineIOPacket(*o._u.ep);
+            break;
+        case Type::SOCKETIO_PACKET:
+            _u.sp = new SocketIOPacket(*o._u.sp);
+            break;
+        default:
+            break;
+    }
+}
+
+void Value::moveFrom(Value& o) noexcept
+{
+    _type = o._type;
+    _lazy = o._lazy;
+    o._lazy = false;
+    if (_lazy)
+    {
+        _u.lazy = o._u.lazy;
+        o._type = Type::NONE;
+        memset(&o._u, 0, sizeof(o._u));
+        return;
+    }
+
+    switch (_type)
+    {
+        case Type::STRING:
+            new (inlineString()) std::string(std::move(*o.inlineString()));
+            o.reset();
+            break;
+        case Type::BINARY:
+            new (inlineBuffer()) Buffer(std::move(*o.inlineBuffer()));
+            o.reset();
+            break;
+        default:
+            // scalars are copied, heap payloads change owner
+            memcpy(&_u, &o._u, sizeof(_u));
+            o._type = Type::NONE;
+            memset(&o._u, 0, sizeof(o._u));
+            break;
+    }
+}
+
+Value& Value::operator=(Value&& o) noexcept
+{
+    if (this != &o)
+    {
+        reset();
+        moveFrom(o);
+    }
+    return *this;
+}
+
 Value& Value::operator=(const Value& o)
 {
     if (this != &o)
     {
-        _type = o._type;
-        switch (_type)
+        if (_type == Type::STRING && o._type == Type::STRING)
         {
-            case Type::STRING:
-                _u.str = new std::string(*o._u.str);
-                break;
-            case Type::BINARY:
-                _u.buf = new Buffer(*o._u.buf);
-                break;
-            case Type::BOOLEAN:
-                _u.b = o._u.b;
-                break;
-            case Type::INTEGER:
-                _u.i = o._u.i;
-                break;
-            case Type::FLOAT:
-                _u.f = o._u.f;
-                break;
-            case Type::ARRAY:
-                _u.arr = new ValueArray(*o._u.arr);
-                break;
-            case Type::OBJECT:
-                _u.obj = new ValueObject(*o._u.obj);
-                break;
-            case Type::FUNCTION:
-                _u.func = new ValueFunction(*o._u.func);
-                break;
-            case Type::ENGINEIO_PACKET:
-                _u.ep = new EngineIOPacket(*o._u.ep);
-                break;
-            case Type::SOCKETIO_PACKET:
-                _u.sp = new SocketIOPacket(*o._u.sp);
-                break;
-            default:
-                break;
+            // reuse the existing string capacity
+            *inlineString() = *o.inlineString();
+        }
+        else
+        {
+            reset();
+            copyFrom(o);
         }
     }
     return *this;
@@ -334,35 +564,72 @@ Value& Value::operator=(const Value& o)
 
 Value& Value::operator=(const char* str)
 {
-    if (_type != Type::STRING)
-        reset();
+    if (_type == Type::STRING)
+    {
+        *inlineString() = str;
+        return *this;
+    }
+    reset();
     _type = Type::STRING;
-    _u.str = new std::string(str);
+    new (inlineString()) std::string(str);
     return *this;
 }
 
 Value& Value::operator=(const std::string& str)
 {
-    if (_type != Type::STRING)
-        reset();
+    if (_type == Type::STRING)
+    {
+        *inlineString() = str;
+        return *this;
+    }
+    reset();
     _type = Type::STRING;
-    _u.str = new std::string(str);
+    new (inlineString()) std::string(str);
+    return *this;
+}
+
+Value& Value::operator=(std::string&& str) noexcept
+{
+    if (_type == Type::STRING)
+    {
+        *inlineString() = std::move(str);
+        return *this;
+    }
+    reset();
+    _type = Type::STRING;
+    new (inlineString()) std::string(std::move(str));
+    return *this;
+}
+
+Value& Value::operator=(Buffer&& buf) noexcept
+{
+    if (_type == Type::BINARY)
+    {
+        *inlineBuffer() = std::move(buf);
+        return *this;
+    }
+    reset();
+    _type = Type::BINARY;
+    new (inlineBuffer()) Buffer(std::move(buf));
     return *this;
 }
 
 Value& Value::operator=(const Buffer& buf)
 {
-    if (_type != Type::BINARY)
-        reset();
+    if (_type == Type::BINARY)
+    {
+        *inlineBuffer() = buf;
+        return *this;
+    }
+    reset();
     _type = Type::BINARY;
-    _u.buf = new Buffer(buf);
+    new (inlineBuffer()) Buffer(buf);
     return *this;
 }
 
 Value& Value::operator=(bool v)
 {
-    if (_type != Type::BOOLEAN)
-        reset();
+    reset();
     _type = Type::BOOLEAN;
     _u.b = v;
     return *this;
@@ -370,8 +637,7 @@ Value& Value::operator=(bool v)
 
 Value& Value::operator=(int intVal)
 {
-    if (_type != Type::INTEGER)
-        reset();
+    reset();
     _type = Type::INTEGER;
     _u.i = intVal;
     return *this;
@@ -379,8 +645,7 @@ Value& Value::operator=(int intVal)
 
 Value& Value::operator=(float floatVal)
 {
-    if (_type != Type::FLOAT)
-        reset();
+    reset();
     _type = Type::FLOAT;
     _u.f = floatVal;
     return *this;
@@ -388,57 +653,93 @@ Value& Value::operator=(float floatVal)
 
 Value& Value::operator=(const ValueArray& arrVal)
 {
-    if (_type != Type::ARRAY)
-        reset();
+    ValueArray* arr = newNode<ValueArray>(nullptr, arrVal);
+    reset();
+    _type = Type::ARRAY;
+    _u.arr = arr;
+    return *this;
+}
+
+Value& Value::operator=(ValueArray&& arrVal)
+{
+    ValueArray* arr = newNode<ValueArray>(arrVal.get_allocator().resource(), std::move(arrVal));
+    reset();
     _type = Type::ARRAY;
-    _u.arr = new ValueArray(arrVal);
+    _u.arr = arr;
     return *this;
 }
 
 Value& Value::operator=(const ValueObject& objVal)
 {
-    if (_type != Type::OBJECT)
-        reset();
+    ValueObject* obj = newNode<ValueObject>(nullptr, objVal);
+    reset();
+    _type = Type::OBJECT;
+    _u.obj = obj;
+    return *this;
+}
+
+Value& Value::operator=(ValueObject&& objVal)
+{
+    ValueObject* obj = newNode<ValueObject>(objVal.get_allocator().resource(), std::move(objVal));
+    reset();
     _type = Type::OBJECT;
-    _u.obj = new ValueObject(objVal);
+    _u.obj = obj;
     return *this;
 }
 
 Value& Value::operator=(const EngineIOPacket& packet)
 {
-    if (_type != Type::ENGINEIO_PACKET)
-        reset();
+    EngineIOPacket* ep = new EngineIOPacket(packet);
+    reset();
     _type = Type::ENGINEIO_PACKET;
-    _u.ep = new EngineIOPacket(packet);
+    _u.ep = ep;
+    return *this;
+}
+
+Value& Value::operator=(EngineIOPacket&& packet)
+{
+    EngineIOPacket* ep = new EngineIOPacket(std::move(packet));
+    reset();
+    _type = Type::ENGINEIO_PACKET;
+    _u.ep = ep;
     return *this;
 }
 
 Value& Value::operator=(const SocketIOPacket& packet)
 {
-    if (_type != Type::SOCKETIO_PACKET)
-        reset();
+    SocketIOPacket* sp = new SocketIOPacket(packet);
+    reset();
     _type = Type::SOCKETIO_PACKET;
-    _u.sp = new SocketIOPacket(packet);
+    _u.sp = sp;
+    return *this;
+}
+
+Value& Value::operator=(SocketIOPacket&& packet)
+{
+    SocketIOPacket* sp = new SocketIOPacket(std::move(packet));
+    reset();
+    _type = Type::SOCKETIO_PACKET;
+    _u.sp = sp;
     return *this;
 }
 
 Value& Value::operator=(const ValueFunction& func)
 {
-    if (_type != Type::FUNCTION)
-        reset();
+    ValueFunction* fn = new ValueFunction(func);
+    reset();
     _type = Type::FUNCTION;
-    _u.func = new ValueFunction(func);
+    _u.func = fn;
     return *this;
 }
 
 const std::string& Value::asString() const
 {
-    return *_u.str;
+    return *inlineString();
 }
 
 const Buffer& Value::asBuffer() const
 {
-    return *_u.buf;
+    return *inlineBuffer();
 }
 
 bool Value::asBool() const
@@ -458,14 +759,77 @@ float Value::asFloat() const
 
 const ValueArray& Value::asArray() const
 {
+    if (_lazy)
+        materialize();
     return *_u.arr;
 }
 
 const ValueObject& Value::asObject() const
 {
+    if (_lazy)
+        materialize();
     return *_u.obj;
 }
 
+const Value& Value::at(size_t index) const
+{
+    if (_type != Type::ARRAY)
+        throw std::out_of_range("Value::at: not an array");
+    return asArray().at(index);
+}
+
+const Value& Value::at(const std::string& key) const
+{
+    if (_type != Type::OBJECT)
+        throw std::out_of_range("Value::at: not an object");
+    return asObject().at(key);
+}
+
+bool Value::isLazy() const
+{
+    return _lazy;
+}
+
+const Buffer& Value::getLazyText() const
+{
+    return _u.lazy->text;
+}
+
+Value Value::lazyJson(const Buffer& text, Type type, MemoryResource* resource)
+{
+    assert(type == Type::ARRAY || type == Type::OBJECT);
+
+    Value ret;
+    ret._type = type;
+    ret._u.lazy = new LazyJson{ text, resource };
+    ret._lazy = true;
+    return ret;
+}
+
+void Value::materialize() const
+{
+    LazyJson* lazy = _u.lazy;
+
+    // malformed nested JSON (only brackets were checked when it was
+    // skipped) ends up as an empty container
+    Value parsed;
+    json::Parser parser;
+    if (!parser.parseShallow(lazy->text, parsed, lazy->resource) || parsed._type != _type)
+    {
+        if (_type == Type::ARRAY)
+            parsed = ValueArray(lazy->resource);
+        else
+            parsed = ValueObject(lazy->resource);
+    }
+
+    // steal the container node
+    _u.arr = parsed._u.arr;
+    _lazy = false;
+    parsed._type = Type::NONE;
+
+    delete lazy;
+}
+
 const SocketIOPacket& Value::asSocketIOPacket() const
 {
     return *_u.sp;
@@ -490,6 +854,10 @@ bool Value::hasBin() const
 {
     bool ret = false;
 
+    // JSON text has no binary in it
+    if (_lazy)
+        return false;
+
     if (_type == Type::BINARY) {
         ret = true;
     } else if (_type == Type::ARRAY) {
@@ -517,61 +885,79 @@ bool Value::hasBin() const
 
 void Value::reset()
 {
+    typedef std::string String;
+
+    if (_lazy)
+    {
+        delete _u.lazy;
+        _lazy = false;
+        _type = Type::NONE;
+        memset(&_u, 0, sizeof(_u));
+        return;
+    }
+
     switch (_type)
     {
         case Type::STRING:
-            delete _u.str;
-            _u.str = nullptr;
+            inlineString()->~String();
             break;
         case Type::BINARY:
-            delete _u.buf;
-            _u.buf = nullptr;
-            break;
-        case Type::BOOLEAN:
-            _u.b = false;
-            break;
-        case Type::INTEGER:
-            _u.i = 0;
-            break;
-        case Type::FLOAT:
-            _u.f = 0.0f;
+            inlineBuffer()->~Buffer();
             break;
         case Type::ARRAY:
-            delete _u.arr;
-            _u.arr = nullptr;
+            deleteNode(_u.arr);
             break;
         case Type::OBJECT:
-            delete _u.obj;
-            _u.obj = nullptr;
+            deleteNode(_u.obj);
             break;
         case Type::FUNCTION:
             delete _u.func;
-            _u.func = nullptr;
             break;
         case Type::ENGINEIO_PACKET:
             delete _u.ep;
-            _u.ep = nullptr;
             break;
         case Type::SOCKETIO_PACKET:
             delete _u.sp;
-            _u.sp = nullptr;
             break;
         default:
             break;
     }
+
+    _type = Type::NONE;
+    memset(&_u, 0, sizeof(_u));
+}
+
+MemoryResource* Value::getMemoryResource() const
+{
+    // where it will materialize
+    if (_lazy)
+        return _u.lazy->resource ? _u.lazy->resource : getDefaultMemoryResource();
+
+    switch (_type)
+    {
+        case Type::ARRAY:
+            return _u.arr->get_allocator().resource();
+        case Type::OBJECT:
+            return _u.obj->get_allocator().resource();
+        default:
+            return nullptr;
+    }
 }
 
 std::string Value::toString() const
 {
     std::stringstream ss;
 
+    if (_lazy)
+        materialize();
+
     switch (_type)
     {
         case Type::STRING:
-            ss << *_u.str;
+            ss << asString();
             break;
         case Type::BINARY:
-            ss << "(Buffer: " << _u.buf->length() << ")";
+            ss << "(Buffer: " << asBuffer().length() << ")";
             break;
         case Type::BOOLEAN:
             ss << (_u.b ? "true" : "false");
@@ -625,7 +1011,7 @@ ValueArray Value::concat(const Value& a, const Value& b)
 
     if (a.getType() == Value::Type::ARRAY)
     {
-        ValueArray aArr = a.asArray();
+        const ValueArray& aArr = a.asArray();
         ret.insert(ret.end(), aArr.begin(), aArr.end());
     }
     else
@@ -635,7 +1021,7 @@ ValueArray Value::concat(const Value& a, const Value& b)
 
     if (b.getType() == Value::Type::ARRAY)
     {
-        ValueArray bArr = b.asArray();
+        const ValueArray& bArr = b.asArray();
         ret.insert(ret.end(), bArr.begin(), bArr.end());
     }
     else
@@ -646,6 +1032,256 @@ ValueArray Value::concat(const Value& a, const Value& b)
     return ret;
 }
 
+ValueArray Value::concat(const Value& a, Value&& b)
+{
+    ValueArray ret;
+
+    if (a.getType() == Value::Type::ARRAY)
+    {
+        const ValueArray& aArr = a.asArray();
+        ret.insert(ret.end(), aArr.begin(), aArr.end());
+    }
+    else
+    {
+        ret.push_back(a);
+    }
+
+    if (b.getType() == Value::Type::ARRAY)
+    {
+        // a lazy array is still JSON text until parsed
+        if (b._lazy)
+            b.materialize();
+
+        ValueArray& bArr = *b._u.arr;
+        ret.insert(ret.end(), std::make_move_iterator(bArr.begin()), std::make_move_iterator(bArr.end()));
+        b.reset();
+    }
+    else
+    {
+        ret.push_back(std::move(b));
+    }
+
+    return ret;
+}
+
+//////
+
+ValueObject::ValueObject()
+{
+}
+
+ValueObject::ValueObject(const allocator_type& alloc)
+: _entries(alloc)
+, _index(alloc)
+{
+}
+
+ValueObject::ValueObject(std::initializer_list<value_type> init, const allocator_type& alloc)
+: _entries(alloc)
+, _index(alloc)
+{
+    _entries.reserve(init.size());
+    for (const auto& e : init)
+        emplace(e.first, e.second);
+}
+
+ValueObject::ValueObject(const ValueObject& o)
+: _entries(o._entries)
+, _index(o._index)
+{
+}
+
+ValueObject::ValueObject(const ValueObject& o, const allocator_type& alloc)
+: _entries(alloc)
+, _index(o._index.begin(), o._index.end(), alloc)
+{
+    MemoryResource* resource = alloc.resource();
+    _entries.reserve(o._entries.size());
+    for (const auto& e : o._entries)
+    {
+        _entries.emplace_back(std::piecewise_construct,
+                              std::forward_as_tuple(e.first),
+                              std::forward_as_tuple(e.second, resource));
+    }
+}
+
+ValueObject::ValueObject(ValueObject&& o) noexcept
+: _entries(std::move(o._entries))
+, _index(std::move(o._index))
+{
+}
+
+ValueObject& ValueObject::operator=(const ValueObject& o)
+{
+    if (this != &o)
+    {
+        _entries = o._entries;
+        _index = o._index;
+    }
+    return *this;
+}
+
+ValueObject& ValueObject::operator=(ValueObject&& o) noexcept
+{
+    _entries = std::move(o._entries);
+    _index = std::move(o._index);
+    return *this;
+}
+
+void ValueObject::clear()
+{
+    _entries.clear();
+    _index.clear();
+}
+
+ValueObject::iterator ValueObject::find(const std::string& key)
+{
+    size_t pos = lookup(key);
+    return pos == NPOS ? _entries.end() : _entries.begin() + pos;
+}
+
+ValueObject::const_iterator ValueObject::find(const std::string& key) const
+{
+    size_t pos = lookup(key);
+    return pos == NPOS ? _entries.end() : _entries.begin() + pos;
+}
+
+ValueObject::size_type ValueObject::count(const std::string& key) const
+{
+    return lookup(key) == NPOS ? 0 : 1;
+}
+
+Value& ValueObject::at(const std::string& key)
+{
+    size_t pos = lookup(key);
+    if (pos == NPOS)
+        throw std::out_of_range("ValueObject::at: " + key);
+    return _entries[pos].second;
+}
+
+const Value& ValueObject::at(const std::string& key) const
+{
+    size_t pos = lookup(key);
+    if (pos == NPOS)
+        throw std::out_of_range("ValueObject::at: " + key);
+    return _entries[pos].second;
+}
+
+Value& ValueObject::operator[](const std::string& key)
+{
+    size_t pos = lookup(key);
+    if (pos != NPOS)
+        return _entries[pos].second;
+    return append(std::string(key), Value())->second;
+}
+
+Value& ValueObject::operator[](std::string&& key)
+{
+    size_t pos = lookup(key);
+    if (pos != NPOS)
+        return _entries[pos].second;
+    return append(std::move(key), Value())->second;
+}
+
+std::pair<ValueObject::iterator, bool> ValueObject::insert(const value_type& v)
+{
+    return emplace(v.first, v.second);
+}
+
+std::pair<ValueObject::iterator, bool> ValueObject::insert(value_type&& v)
+{
+    return emplace(std::move(v.first), std::move(v.second));
+}
+
+ValueObject::size_type ValueObject::erase(const std::string& key)
+{
+    size_t pos = lookup(key);
+    if (pos == NPOS)
+        return 0;
+    erase(_entries.begin() + pos);
+    return 1;
+}
+
+ValueObject::iterator ValueObject::erase(const_iterator pos)
+{
+    // entries are shifted down, so positions in the index are stale
+    size_t offset = pos - _entries.cbegin();
+    _entries.erase(_entries.begin() + offset);
+    rebuildIndex();
+    return _entries.begin() + offset;
+}
+
+size_t ValueObject::lookup(const std::string& key) const
+{
+    if (_index.empty())
+    {
+        for (size_t i = 0, n = _entries.size(); i < n; ++i)
+        {
+            const std::string& k = _entries[i].first;
+            if (k.size() == key.size() && k == key)
+                return i;
+        }
+        return NPOS;
+    }
+
+    size_t mask = _index.size() - 1;
+    size_t slot = std::hash<std::string>()(key) & mask;
+    while (_index[slot] != 0)
+    {
+        size_t pos = _index[slot] - 1;
+        if (_entries[pos].first == key)
+            return pos;
+        slot = (slot + 1) & mask;
+    }
+    return NPOS;
+}
+
+ValueObject::iterator ValueObject::append(std::string&& key, Value&& v)
+{
+    // build the nested value in this object's resource
+    _entries.emplace_back(std::piecewise_construct,
+                          std::forward_as_tuple(std::move(key)),
+                          std::forward_as_tuple(std::move(v), _entries.get_allocator().resource()));
+
+    size_t n = _entries.size();
+    if (n > LINEAR_LIMIT)
+    {
+        // keep the load factor at or below 1/2
+        if (n * 2 > _index.size())
+            rebuildIndex();
+        else
+            indexEntry(n - 1);
+    }
+    return _entries.end() - 1;
+}
+
+void ValueObject::rebuildIndex()
+{
+    size_t n = _entries.size();
+    if (n <= LINEAR_LIMIT)
+    {
+        _index.clear();
+        return;
+    }
+
+    size_t capacity = 32;
+    while (capacity < n * 2)
+        capacity <<= 1;
+
+    _index.assign(capacity, 0);
+    for (size_t i = 0; i < n; ++i)
+        indexEntry(i);
+}
+
+void ValueObject::indexEntry(size_t pos)
+{
+    size_t mask = _index.size() - 1;
+    size_t slot = std::hash<std::string>()(_entries[pos].first) & mask;
+    while (_index[slot] != 0)
+        slot = (slot + 1) & mask;
+    _index[slot] = (uint32_t)(pos + 1);
+}
+
 //////
 
 SocketIOPacket::SocketIOPacket()
@@ -656,26 +1292,25 @@ SocketIOPacket::SocketIOPacket()
 }
 
 SocketIOPacket::SocketIOPacket(const SocketIOPacket& o)
+: id(o.id)
+, nsp(o.nsp)
+, type(o.type)
+, query(o.query)
+, attachments(o.attachments)
+, data(o.data)
+, options(o.options)
 {
-    id = o.id;
-    nsp = o.nsp;
-    type = o.type;
-    query = o.query;
-    attachments = o.attachments;
-    data = o.data;
-    options = o.options;
 }
 
-SocketIOPacket::SocketIOPacket(SocketIOPacket&& o)
+SocketIOPacket::SocketIOPacket(SocketIOPacket&& o) noexcept
+: id(o.id)
+, nsp(std::move(o.nsp))
+, type(o.type)
+, query(std::move(o.query))
+, attachments(o.attachments)
+, data(std::move(o.data))
+, options(std::move(o.options))
 {
-    id = o.id;
-    nsp = o.nsp;
-    type = o.type;
-    query = o.query;
-    attachments = o.attachments;
-    data = o.data;
-    options = o.options;
-
     o.reset();
 }
 
@@ -699,17 +1334,17 @@ SocketIOPacket& SocketIOPacket::operator=(const SocketIOPacket& o)
     return *this;
 }
 
-SocketIOPacket& SocketIOPacket::operator=(SocketIOPacket&& o)
+SocketIOPacket& SocketIOPacket::operator=(SocketIOPacket&& o) noexcept
 {
     if (this != &o)
     {
         id = o.id;
-        nsp = o.nsp;
+        nsp = std::move(o.nsp);
         type = o.type;
-        query = o.query;
+        query = std::move(o.query);
         attachments = o.attachments;
-        data = o.data;
-        options = o.options;
+        data = std::move(o.data);
+        options = std::move(o.options);
 
         o.reset();
     }
@@ -736,6 +1371,52 @@ std::string SocketIOPacket::toString() const
     return data.toString();
 }
 
+EngineIOPacket::EngineIOPacket()
+{
+}
+
+EngineIOPacket::EngineIOPacket(const std::string& type_, const Value& data_)
+: type(type_)
+, data(data_)
+{
+}
+
+EngineIOPacket::EngineIOPacket(const EngineIOPacket& o)
+: type(o.type)
+, data(o.data)
+, options(o.options)
+{
+}
+
+EngineIOPacket::EngineIOPacket(EngineIOPacket&& o) noexcept
+: type(std::move(o.type))
+, data(std::move(o.data))
+, options(std::move(o.options))
+{
+}
+
+EngineIOPacket& EngineIOPacket::operator=(const EngineIOPacket& o)
+{
+    if (this != &o)
+    {
+        type = o.type;
+        data = o.data;
+        options = o.options;
+    }
+    return *this;
+}
+
+EngineIOPacket& EngineIOPacket::operator=(EngineIOPacket&& o) noexcept
+{
+    if (this != &o)
+    {
+        type = std::move(o.type);
+        data = std::move(o.data);
+        options = std::move(o.options);
+    }
+    return *this;
+}
+
 /**
  * Premade error packet.
  */
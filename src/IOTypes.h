@@ -1,27 +1,38 @@
 #pragma once
 
 #include <vector>
+#include <initializer_list>
 #include <unordered_map>
 #include <functional>
 #include <string>
+#include <type_traits>
+#include <atomic>
 
 #include <stdint.h>
 
+#include "IOArena.h"
+
 class Buffer
 {
 public:
+    /**
+     * Buffers whose storage (including the terminating NUL of text buffers)
+     * fits in this many bytes live inside the object and never touch the heap.
+     */
+    static const size_t INLINE_CAPACITY = 15;
+
     Buffer();
     Buffer(const uint8_t* data, size_t len);
     Buffer(const char* str);
     Buffer(const std::string& str);
     Buffer(const Buffer& o);
-    Buffer(Buffer&& o);
+    Buffer(Buffer&& o) noexcept;
     ~Buffer();
 
     Buffer& operator=(const char* str);
     Buffer& operator=(const std::string& str);
     Buffer& operator=(const Buffer& o);
-    Buffer& operator=(Buffer&& o);
+    Buffer& operator=(Buffer&& o) noexcept;
     uint8_t operator[](int index) const;
 
     bool isValid() const;
@@ -30,22 +41,64 @@ public:
     const char* c_str() const;
     bool isBinary() const;
 
+    /**
+     * Returns a view of `len` bytes starting at `offset` that shares this
+     * buffer's storage, so no bytes are copied. A slice of a text buffer is
+     * only NUL terminated if it runs to the end of the original buffer.
+     */
+    Buffer slice(size_t offset, size_t len) const;
+    Buffer slice(size_t offset) const;
+
+    /**
+     * Writable access to the bytes. Storage shared with other buffers or
+     * slices is copied first, so writes are never visible through them.
+     */
+    uint8_t* mutableData();
+
     void setData(off_t offset, const uint8_t* data, size_t len);
 
     std::string toBase64String() const;
 
 private:
-    uint8_t* _data;
+    /**
+     * Heap block shared by every copy and slice of a large buffer.
+     */
+    struct Storage
+    {
+        std::atomic<int> refs;
+        uint8_t bytes[1];
+    };
+
+    void assign(const uint8_t* data, size_t len, bool isBinary);
+    void release();
+    bool isInline() const { return _data == _inline; }
+
+    const uint8_t* _data; // points to _inline or into _storage->bytes
     size_t _len;
+    union {
+        Storage* _storage;
+        uint8_t _inline[INLINE_CAPACITY];
+    };
     bool _isBinary;
 };
 
+/**
+ * A piece of a message for gather writes, like POSIX `iovec`. The bytes are
+ * borrowed for the duration of the call only.
+ */
+
+struct IOVec
+{
+    const uint8_t* data;
+    size_t length;
+};
+
 class Value;
 class EngineIOPacket;
 class SocketIOPacket;
 
-using ValueArray = std::vector<Value>;
-using ValueObject = std::unordered_map<std::string, Value>;
+using ValueArray = std::vector<Value, ValueAllocator<Value>>;
+class ValueObject;
 using ValueFunction = std::function<void(const Value&)>;
 
 extern ValueObject OBJECT_NONE;
@@ -74,32 +127,69 @@ public:
 
     Value();
     Value(const Value& o);
+    Value(Value&& o) noexcept;
     Value(const char* cstr);
     Value(const std::string& str);
+    Value(std::string&& str) noexcept;
     Value(const Buffer& buf);
+    Value(Buffer&& buf) noexcept;
     explicit Value(bool v);
     explicit Value(int intVal);
     explicit Value(float floatVal);
     Value(const ValueArray& arrVal);
+    Value(ValueArray&& arrVal);
     Value(const ValueObject& objVal);
+    Value(ValueObject&& objVal);
     Value(const ValueFunction& func);
     Value(const EngineIOPacket& packet);
+    Value(EngineIOPacket&& packet);
     Value(const SocketIOPacket& packet);
+    Value(SocketIOPacket&& packet);
+
+    /**
+     * Allocator-extended copy/move: arrays and objects of the result are
+     * allocated from `resource` (nested ones too). Strings and other payloads
+     * still use the default heap. Moving keeps the source's nodes when they
+     * already live in `resource`.
+     *
+     * A plain move always keeps them, so a tree moved out of an Arena
+     * still lives there; `Value(std::move(v), nullptr)` or a copy takes it
+     * out. Containers pass their own resource when an element is
+     * constructed, but not when one is assigned.
+     */
+    Value(const Value& o, MemoryResource* resource);
+    Value(Value&& o, MemoryResource* resource);
+
+    /**
+     * A lazy ARRAY or OBJECT: only `text` (its JSON) is kept until
+     * asArray(), asObject() or at() first look inside. It is then parsed
+     * one level deep, nested arrays and objects staying lazy slices of the
+     * same text. Looking inside changes the value, so a lazy value must not
+     * be read from several threads at once.
+     */
+    static Value lazyJson(const Buffer& text, Type type, MemoryResource* resource = nullptr);
 
     ~Value();
 
     Value& operator=(const Value& o);
+    Value& operator=(Value&& o) noexcept;
     Value& operator=(const char* o);
     Value& operator=(const std::string& o);
+    Value& operator=(std::string&& o) noexcept;
     Value& operator=(const Buffer& buf);
+    Value& operator=(Buffer&& buf) noexcept;
     Value& operator=(bool v);
     Value& operator=(int intVal);
     Value& operator=(float floatVal);
     Value& operator=(const ValueArray& arrVal);
+    Value& operator=(ValueArray&& arrVal);
     Value& operator=(const ValueObject& objVal);
+    Value& operator=(ValueObject&& objVal);
     Value& operator=(const ValueFunction& func);
     Value& operator=(const EngineIOPacket& packet);
+    Value& operator=(EngineIOPacket&& packet);
     Value& operator=(const SocketIOPacket& packet);
+    Value& operator=(SocketIOPacket&& packet);
 
     const std::string& asString() const;
     const Buffer& asBuffer() const;
@@ -112,18 +202,52 @@ public:
     const SocketIOPacket& asSocketIOPacket() const;
     const ValueFunction& asFunction() const;
 
+    /**
+     * Checked element/member access, throws std::out_of_range like the
+     * containers do.
+     */
+    const Value& at(size_t index) const;
+    const Value& at(const std::string& key) const;
+
+    bool isLazy() const;
+
+    /**
+     * The JSON text of a lazy value that has not been looked into yet.
+     */
+    const Buffer& getLazyText() const;
+
     bool isValid() const;
     bool hasBin() const;
     void reset();
 
+    /**
+     * The resource the array/object node of this value lives in, or nullptr
+     * for every other type.
+     */
+    MemoryResource* getMemoryResource() const;
+
     std::string toString() const;
 
     static ValueArray concat(const Value& a, const Value& b);
+    static ValueArray concat(const Value& a, Value&& b);
 
 private:
-    union {
-        std::string* str;
-        Buffer* buf;
+    void copyFrom(const Value& o, MemoryResource* resource = nullptr);
+    void moveFrom(Value& o) noexcept;
+
+    struct LazyJson;
+    void materialize() const;
+
+    std::string* inlineString() { return reinterpret_cast<std::string*>(&_u.str); }
+    const std::string* inlineString() const { return reinterpret_cast<const std::string*>(&_u.str); }
+    Buffer* inlineBuffer() { return reinterpret_cast<Buffer*>(&_u.buf); }
+    const Buffer* inlineBuffer() const { return reinterpret_cast<const Buffer*>(&_u.buf); }
+
+    // Strings and buffers are constructed in place so short event names and
+    // small binaries (see Buffer::INLINE_CAPACITY) don't allocate at all.
+    mutable union {
+        std::aligned_storage<sizeof(std::string), alignof(std::string)>::type str;
+        std::aligned_storage<sizeof(Buffer), alignof(Buffer)>::type buf;
         bool b;
         int i;
         float f;
@@ -132,19 +256,124 @@ private:
         ValueFunction* func;
         EngineIOPacket* ep;
         SocketIOPacket* sp;
+        LazyJson* lazy;
     } _u;
 
     Type _type;
+    mutable bool _lazy = false; // ARRAY/OBJECT still held as JSON text in _u.lazy
 };
 
 using Args = ValueArray;
 
+/**
+ * Insertion-ordered string -> Value map kept in one contiguous vector.
+ * The JSON objects we exchange rarely have more than a handful of keys,
+ * so lookups scan the keys linearly; once the map grows past
+ * LINEAR_LIMIT entries an open addressing index of entry positions is
+ * kept alongside.
+ *
+ * Unlike std::unordered_map, inserting may move existing entries and
+ * erasing shifts the ones after it, so both invalidate iterators and
+ * references.
+ */
+class ValueObject
+{
+public:
+    typedef std::string key_type;
+    typedef Value mapped_type;
+    typedef std::pair<std::string, Value> value_type;
+    typedef ValueAllocator<value_type> allocator_type;
+    typedef size_t size_type;
+
+private:
+    typedef std::vector<value_type, allocator_type> Entries;
+    typedef std::vector<uint32_t, ValueAllocator<uint32_t>> Index;
+
+public:
+    typedef Entries::iterator iterator;
+    typedef Entries::const_iterator const_iterator;
+
+    static const size_t LINEAR_LIMIT = 8;
+
+    ValueObject();
+    explicit ValueObject(const allocator_type& alloc);
+    ValueObject(std::initializer_list<value_type> init, const allocator_type& alloc = allocator_type());
+    ValueObject(const ValueObject& o);
+    ValueObject(const ValueObject& o, const allocator_type& alloc);
+    ValueObject(ValueObject&& o) noexcept;
+
+    ValueObject& operator=(const ValueObject& o);
+    ValueObject& operator=(ValueObject&& o) noexcept;
+
+    iterator begin() { return _entries.begin(); }
+    iterator end() { return _entries.end(); }
+    const_iterator begin() const { return _entries.begin(); }
+    const_iterator end() const { return _entries.end(); }
+    const_iterator cbegin() const { return _entries.cbegin(); }
+    const_iterator cend() const { return _entries.cend(); }
+
+    bool empty() const { return _entries.empty(); }
+    size_type size() const { return _entries.size(); }
+    void reserve(size_type n) { _entries.reserve(n); }
+    void clear();
+
+    iterator find(const std::string& key);
+    const_iterator find(const std::string& key) const;
+    size_type count(const std::string& key) const;
+
+    /**
+     * Throws std::out_of_range when the key is missing, like
+     * std::unordered_map::at.
+     */
+    Value& at(const std::string& key);
+    const Value& at(const std::string& key) const;
+
+    Value& operator[](const std::string& key);
+    Value& operator[](std::string&& key);
+
+    template<class K, class V>
+    std::pair<iterator, bool> emplace(K&& key, V&& v)
+    {
+        size_t pos = lookup(key);
+        if (pos != NPOS)
+            return std::make_pair(_entries.begin() + pos, false);
+        return std::make_pair(append(std::string(std::forward<K>(key)), Value(std::forward<V>(v))), true);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& v);
+    std::pair<iterator, bool> insert(value_type&& v);
+
+    size_type erase(const std::string& key);
+    iterator erase(const_iterator pos);
+
+    allocator_type get_allocator() const { return _entries.get_allocator(); }
+
+private:
+    static const size_t NPOS = (size_t)-1;
+
+    size_t lookup(const std::string& key) const;
+    iterator append(std::string&& key, Value&& v);
+    void rebuildIndex();
+    void indexEntry(size_t pos);
+
+    Entries _entries;
+    Index _index; // entry position + 1 per slot, 0 when free; empty up to LINEAR_LIMIT
+};
+
 class EngineIOPacket
 {
 public:
     static EngineIOPacket NONE;
     static EngineIOPacket ERROR;
 
+    EngineIOPacket();
+    EngineIOPacket(const std::string& type, const Value& data);
+    EngineIOPacket(const EngineIOPacket& o);
+    EngineIOPacket(EngineIOPacket&& o) noexcept;
+
+    EngineIOPacket& operator=(const EngineIOPacket& o);
+    EngineIOPacket& operator=(EngineIOPacket&& o) noexcept;
+
     bool isValid() const;
 
     std::string type;
@@ -197,11 +426,11 @@ public:
 
     SocketIOPacket();
     SocketIOPacket(const SocketIOPacket& packet);
-    SocketIOPacket(SocketIOPacket&& packet);
+    SocketIOPacket(SocketIOPacket&& packet) noexcept;
     ~SocketIOPacket();
 
     SocketIOPacket& operator=(const SocketIOPacket& packet);
-    SocketIOPacket& operator=(SocketIOPacket&& packet);
+    SocketIOPacket& operator=(SocketIOPacket&& packet) noexcept;
 
     bool isValid() const;
     void reset();
@@ -245,6 +474,15 @@ struct Opts
     bool secure;
     uint16_t port;
     std::string hostname;
+    std::vector<std::string> transports;// (Array) transports to try in order, empty for the default (['polling', 'websocket'])
+    bool lazyDecoding;// (Boolean) keep arrays and objects nested in event arguments as JSON text until they are read (false)
+    bool arenaDecoding;// (Boolean) build each received packet in an arena released after its listeners return, which must copy what they keep (false)
+    bool perMessageDeflate;// (Boolean) offer permessage-deflate on websockets and compress packets of 1024 bytes or more (false)
+    bool coalesce;// (Boolean) hold packets sent in a row and write them to the transport together (false)
+    int coalesceDelay;// (Number) with coalesce, microseconds a packet may wait for others, 0 for the end of the current event loop turn (0)
+    size_t coalesceBytes;// (Number) with coalesce, write as soon as this many bytes are held, 0 for no limit (0)
+    size_t highWaterMark;// (Number) bytes queued for sending past which a socket reports it isn't writable, 0 for no limit (0)
+    size_t lowWaterMark;// (Number) a socket that wasn't writable emits `drain` once its queue is down to this many bytes (0)
 
     bool isValid() const;
 };
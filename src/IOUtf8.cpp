@@ -0,0 +1,335 @@
+#include "IOUtf8.h"
+#include "IOSimd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if IO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace utf8 {
+
+namespace {
+
+/**
+ * Length of the sequence starting at `s` (Unicode table 3-7). For an
+ * ill-formed one `valid` is cleared and the length of its longest
+ * well-formed prefix is returned instead, at least 1.
+ */
+
+size_t scanSequence(const uint8_t* s, size_t n, bool& valid)
+{
+    uint8_t c = s[0];
+    valid = true;
+    if (c < 0x80)
+        return 1;
+
+    size_t len;
+    uint8_t lo = 0x80, hi = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf)
+    {
+        len = 2;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        len = 3;
+        if (c == 0xe0)
+            lo = 0xa0; // overlong
+        else if (c == 0xed)
+            hi = 0x9f; // surrogates
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        len = 4;
+        if (c == 0xf0)
+            lo = 0x90; // overlong
+        else if (c == 0xf4)
+            hi = 0x8f; // past U+10FFFF
+    }
+    else
+    {
+        valid = false;
+        return 1;
+    }
+
+    for (size_t i = 1; i < len; ++i)
+    {
+        if (i >= n || s[i] < lo || s[i] > hi)
+        {
+            valid = false;
+            return i;
+        }
+        lo = 0x80;
+        hi = 0xbf;
+    }
+    return len;
+}
+
+bool validateScalar(const uint8_t* s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        // 8 ASCII bytes at a time
+        if (i + 8 <= len)
+        {
+            uint64_t word;
+            memcpy(&word, s + i, 8);
+            if ((word & 0x8080808080808080ull) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        bool valid;
+        i += scanSequence(s + i, len - i, valid);
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+#if IO_SIMD_X86
+
+// Every two-byte window is looked up in three 16-entry tables (high nibble
+// of the first byte, its low nibble, high nibble of the second byte); each
+// table sets the bits of the errors its nibble could belong to, so and-ing
+// them leaves the errors that are really there. What this misses, a lead
+// byte not followed by enough continuations, is checked by comparing the
+// continuations expected from 2 and 3 bytes back with the ones found.
+
+enum
+{
+    TOO_SHORT = 1 << 0, // lead byte or ASCII followed by a lead byte or ASCII
+    TOO_LONG = 1 << 1, // ASCII followed by a continuation
+    OVERLONG_3 = 1 << 2,
+    TOO_LARGE = 1 << 3,
+    SURROGATE = 1 << 4,
+    OVERLONG_2 = 1 << 5,
+    TOO_LARGE_1000 = 1 << 6,
+    OVERLONG_4 = 1 << 6,
+    TWO_CONTS = 1 << 7,
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS
+};
+
+#define UTF8_BYTE_1_HIGH \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+    TOO_SHORT | OVERLONG_2, \
+    TOO_SHORT, \
+    TOO_SHORT | OVERLONG_3 | SURROGATE, \
+    (char)(TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4)
+
+#define UTF8_BYTE_1_LOW \
+    (char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4), \
+    (char)(CARRY | OVERLONG_2), \
+    (char)CARRY, \
+    (char)CARRY, \
+    (char)(CARRY | TOO_LARGE), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000), \
+    (char)(CARRY | TOO_LARGE | TOO_LARGE_1000)
+
+#define UTF8_BYTE_2_HIGH \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+    (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4), \
+    (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE), \
+    (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+    (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+// a block ending in the first 1, 2 or 3 bytes of a longer sequence
+#define UTF8_INCOMPLETE_TAIL (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1)
+
+struct ValidatorSSSE3
+{
+    __m128i error;
+    __m128i prev;
+    __m128i prevIncomplete;
+
+    IO_SIMD_TARGET("ssse3")
+    void step(__m128i input)
+    {
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+
+        // pure ASCII: only an unfinished sequence from before can be wrong
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            error = _mm_or_si128(error, prevIncomplete);
+            prev = input;
+            prevIncomplete = _mm_setzero_si128();
+            return;
+        }
+
+        const __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+        const __m128i byte1High = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+        const __m128i byte1Low = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_LOW), _mm_and_si128(prev1, nibble));
+        const __m128i byte2High = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+        const __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+        // continuations required by a 3 or 4 byte lead, against TWO_CONTS
+        const __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+        const __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+        const __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+        const __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+        const __m128i must23 = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8((char)0x80));
+        error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+
+        const __m128i maxValue = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, UTF8_INCOMPLETE_TAIL);
+        prevIncomplete = _mm_subs_epu8(input, maxValue);
+        prev = input;
+    }
+};
+
+IO_SIMD_TARGET("ssse3")
+bool validateSSSE3(const uint8_t* s, size_t len)
+{
+    ValidatorSSSE3 v;
+    v.error = _mm_setzero_si128();
+    v.prev = _mm_setzero_si128();
+    v.prevIncomplete = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+        v.step(_mm_loadu_si128((const __m128i*)(s + i)));
+
+    if (i < len)
+    {
+        // zero padding is ASCII
+        uint8_t tail[16] = {0};
+        memcpy(tail, s + i, len - i);
+        v.step(_mm_loadu_si128((const __m128i*)tail));
+    }
+
+    __m128i error = _mm_or_si128(v.error, v.prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+struct ValidatorAVX2
+{
+    __m256i error;
+    __m256i prev;
+    __m256i prevIncomplete;
+
+    IO_SIMD_TARGET("avx2")
+    void step(__m256i input)
+    {
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            error = _mm256_or_si256(error, prevIncomplete);
+            prev = input;
+            prevIncomplete = _mm256_setzero_si256();
+            return;
+        }
+
+        // alignr works per lane; give it the previous block's upper lane
+        // below the current lower one
+        const __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        const __m256i byte1High = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_HIGH, UTF8_BYTE_1_HIGH),
+                                                      _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        const __m256i byte1Low = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_LOW, UTF8_BYTE_1_LOW),
+                                                     _mm256_and_si256(prev1, nibble));
+        const __m256i byte2High = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_2_HIGH, UTF8_BYTE_2_HIGH),
+                                                      _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+        const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+        const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+        const __m256i isThird = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80)));
+        const __m256i isFourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+        const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8((char)0x80));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+
+        const __m256i maxValue = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, UTF8_INCOMPLETE_TAIL);
+        prevIncomplete = _mm256_subs_epu8(input, maxValue);
+        prev = input;
+    }
+};
+
+IO_SIMD_TARGET("avx2")
+bool validateAVX2(const uint8_t* s, size_t len)
+{
+    ValidatorAVX2 v;
+    v.error = _mm256_setzero_si256();
+    v.prev = _mm256_setzero_si256();
+    v.prevIncomplete = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+        v.step(_mm256_loadu_si256((const __m256i*)(s + i)));
+
+    if (i < len)
+    {
+        uint8_t tail[32] = {0};
+        memcpy(tail, s + i, len - i);
+        v.step(_mm256_loadu_si256((const __m256i*)tail));
+    }
+
+    __m256i error = _mm256_or_si256(v.error, v.prevIncomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#undef UTF8_BYTE_1_HIGH
+#undef UTF8_BYTE_1_LOW
+#undef UTF8_BYTE_2_HIGH
+#undef UTF8_INCOMPLETE_TAIL
+
+#endif // IO_SIMD_X86
+
+typedef bool (*ValidateFunc)(const uint8_t* s, size_t len);
+
+ValidateFunc selectValidate()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return validateAVX2;
+    if (simd::hasSSSE3())
+        return validateSSSE3;
+#endif
+    return validateScalar;
+}
+
+const ValidateFunc __validate = selectValidate();
+
+} // namespace {
+
+bool validate(const char* str, size_t len)
+{
+    return __validate((const uint8_t*)str, len);
+}
+
+std::string sanitize(const char* str, size_t len)
+{
+    const uint8_t* s = (const uint8_t*)str;
+    std::string ret;
+    ret.reserve(len);
+
+    size_t i = 0;
+    while (i < len)
+    {
+        bool valid;
+        size_t n = scanSequence(s + i, len - i, valid);
+        if (valid)
+            ret.append(str + i, n);
+        else
+            ret.append("\xef\xbf\xbd", 3);
+        i += n;
+    }
+    return ret;
+}
+
+} // namespace utf8 {
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * UTF-8 checks for text coming from the network.
+ *
+ * Strings are kept as UTF-8 all the way through, so unlike utf8.js there is
+ * nothing to transcode: decoding is validation, encoding only has to repair
+ * ill-formed input.
+ */
+
+namespace utf8 {
+
+/**
+ * Whether `len` bytes are well-formed UTF-8: no overlong forms, surrogates,
+ * code points past U+10FFFF or truncated sequences.
+ *
+ * Runs 16/32 bytes at a time with SSSE3/AVX2 when the CPU has them (the
+ * lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte"), skipping ASCII runs without looking up anything.
+ *
+ * @api public
+ */
+
+bool validate(const char* str, size_t len);
+
+/**
+ * Copy of `len` bytes with each ill-formed sequence replaced by U+FFFD, the
+ * way TextDecoder does.
+ *
+ * @api public
+ */
+
+std::string sanitize(const char* str, size_t len);
+
+} // namespace utf8 {
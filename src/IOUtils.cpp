@@ -1,4 +1,8 @@
 #include "IOUtils.h"
+#include "IOJson.h"
+#include "IOBase64.h"
+#include "IOUtf8.h"
+#include "IOEventLoop.h"
 
 ListenerId grabListenerId(ListenerId* id)
 {
@@ -11,37 +15,50 @@ ListenerId grabListenerId(ListenerId* id)
 
 TimerHandle setTimeout(const std::function<void()>& cb, long milliseconds)
 {
-    return 0;
+    return getEventLoop()->setTimeout(cb, milliseconds);
 }
 
-void clearTimeout(TimerHandle)
+void clearTimeout(TimerHandle handle)
 {
-
+    if (handle == INVALID_TIMER_HANDLE)
+        return;
+    getEventLoop()->clearTimeout(handle);
 }
 
 std::string utf8Encode(const std::string& str)
 {
-    return str;
+    if (utf8::validate(str.data(), str.length()))
+        return str;
+    return utf8::sanitize(str.data(), str.length());
 }
 
 std::string utf8Decode(const std::string& str)
 {
-    return str;
+    if (utf8::validate(str.data(), str.length()))
+        return str;
+    return "";
 }
 
 std::string base64Encode(const Buffer& buf)
 {
-    return "";
+    std::string ret;
+    base64::encode(buf.data(), buf.length(), ret);
+    return ret;
 }
 
 Buffer base64Decode(const std::string& str)
 {
-    return Buffer(nullptr, 0);
+    Buffer ret;
+    base64::decode(str.data(), str.length(), ret);
+    return ret;
 }
 
 ValueObject parsejson(const std::string& str)
 {
-    return ValueObject();
+    Value v;
+    if (!json::parse(str, v) || v.getType() != Value::Type::OBJECT)
+        return ValueObject();
+    return v.asObject();
 }
 
 std::string queryToString(const ValueObject& obj)
@@ -49,6 +66,33 @@ std::string queryToString(const ValueObject& obj)
     return "";
 }
 
+void IWebSocket::sendv(const IOVec* slices, size_t count, bool binary, bool compress, bool more)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i)
+        len += slices[i].length;
+
+    if (binary)
+    {
+        Buffer data(nullptr, len);
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            data.setData(offset, slices[i].data, slices[i].length);
+            offset += slices[i].length;
+        }
+        send(data, compress);
+    }
+    else
+    {
+        std::string text;
+        text.reserve(len);
+        for (size_t i = 0; i < count; ++i)
+            text.append((const char*)slices[i].data, slices[i].length);
+        send(text, compress);
+    }
+}
+
 ///
 
 static std::shared_ptr<IHttpRequestFactory> __httpFactory;
@@ -74,3 +118,16 @@ std::shared_ptr<IWebSocketFactory> getWebSocketFactory()
     return __wsFactory;
 }
 
+static std::shared_ptr<EventLoop> __eventLoop;
+
+void setEventLoop(std::shared_ptr<EventLoop> loop)
+{
+    __eventLoop = loop;
+}
+
+std::shared_ptr<EventLoop> getEventLoop()
+{
+    if (!__eventLoop)
+        __eventLoop = std::make_shared<EventLoop>();
+    return __eventLoop;
+}
@@ -3,6 +3,7 @@
 #include "IOTypes.h"
 
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <stdint.h>
 
@@ -10,6 +11,13 @@ ListenerId grabListenerId(ListenerId* id = nullptr);
 
 #define ID grabListenerId
 
+class EventLoop;
+
+/**
+ * Timers of the event loop set with setEventLoop, a default EventLoop
+ * when there is none. Call them from the thread running that loop.
+ */
+
 TimerHandle setTimeout(const std::function<void()>& cb, long milliseconds);
 void clearTimeout(TimerHandle);
 
@@ -72,19 +80,49 @@ public:
     , onmessage(nullptr)
     , onclose(nullptr)
     , onerror(nullptr)
+    , ondrain(nullptr)
+    , perMessageDeflate(false)
     {}
     virtual ~IWebSocket() {}
 
     virtual bool open(const std::string& uri, const std::vector<std::string>& protocols, const std::string& caFilePath) = 0;
     virtual void close() = 0;
-    virtual void send(const Buffer& data) = 0;
+
+    /**
+     * Sends a binary message, or a text one for `text`. `compress` asks for
+     * permessage-deflate, ignored if it wasn't negotiated.
+     */
+    virtual void send(const Buffer& data, bool compress = false) = 0;
+    virtual void send(const std::string& text, bool compress = false) = 0;
+
+    /**
+     * Sends one message made of `count` slices, without gathering them into
+     * a Buffer first where the implementation can. With `more` the message
+     * may wait for the next one so a batch goes out in one write; the last
+     * message of a batch must not set it.
+     *
+     * The default implementation copies the slices and calls `send`.
+     */
+    virtual void sendv(const IOVec* slices, size_t count, bool binary, bool compress = false, bool more = false);
+
+    /**
+     * Bytes given to `send` that haven't reached the network yet, like a
+     * browser WebSocket's bufferedAmount. When it is non-zero after a send
+     * `ondrain` is called once it is back to zero. The default
+     * implementation doesn't buffer and answers 0.
+     */
+    virtual size_t getBufferedAmount() const { return 0; }
 
     std::function<void()> onopen;
-    std::function<void(const Buffer&)> onmessage;
+    // a STRING for text messages, BINARY otherwise
+    std::function<void(const Value&)> onmessage;
     std::function<void(const std::string&)> onclose;
     std::function<void(const std::string&)> onerror;
+    std::function<void()> ondrain;
 
     long timeout;
+    // offer permessage-deflate when opening
+    bool perMessageDeflate;
 };
 
 class IWebSocketFactory
@@ -99,3 +137,6 @@ std::shared_ptr<IHttpRequestFactory> getHttpRequestFactor();
 
 void setWebSocketFactory(std::shared_ptr<IWebSocketFactory> factory);
 std::shared_ptr<IWebSocketFactory> getWebSocketFactory();
+
+void setEventLoop(std::shared_ptr<EventLoop> loop);
+std::shared_ptr<EventLoop> getEventLoop();
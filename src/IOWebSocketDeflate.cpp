@@ -0,0 +1,404 @@
+#include "IOWebSocketDeflate.h"
+
+#include <zlib.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace websocket {
+
+namespace {
+
+const int MEM_LEVEL = 8;
+
+const uint8_t TAIL[4] = { 0x00, 0x00, 0xff, 0xff };
+
+/**
+ * zlib allocates the same few block sizes for every stream (state, window,
+ * hash chains, pending buffer), so freed blocks are kept by size and handed
+ * to the next stream instead of going back to malloc, up to `limit` bytes.
+ */
+
+struct Pool
+{
+    // keeps the size in front of each block, zfree doesn't pass it
+    static const size_t HEADER = 16;
+
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<void*>> blocks;
+    size_t bytes = 0;
+    size_t limit = 8 * 1024 * 1024;
+
+    ~Pool()
+    {
+        for (auto& sized : blocks)
+        {
+            for (void* block : sized.second)
+                free(block);
+        }
+    }
+};
+
+Pool& pool()
+{
+    static Pool __pool;
+    return __pool;
+}
+
+voidpf poolAlloc(voidpf, uInt items, uInt size)
+{
+    size_t bytes = (size_t)items * size;
+
+    Pool& p = pool();
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        auto sized = p.blocks.find(bytes);
+        if (sized != p.blocks.end() && !sized->second.empty())
+        {
+            void* block = sized->second.back();
+            sized->second.pop_back();
+            p.bytes -= bytes;
+            return (uint8_t*)block + Pool::HEADER;
+        }
+    }
+
+    void* block = malloc(bytes + Pool::HEADER);
+    if (!block)
+        return Z_NULL;
+    memcpy(block, &bytes, sizeof(bytes));
+    return (uint8_t*)block + Pool::HEADER;
+}
+
+void poolFree(voidpf, voidpf address)
+{
+    void* block = (uint8_t*)address - Pool::HEADER;
+    size_t bytes;
+    memcpy(&bytes, block, sizeof(bytes));
+
+    Pool& p = pool();
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        if (p.bytes + bytes <= p.limit)
+        {
+            p.blocks[bytes].push_back(block);
+            p.bytes += bytes;
+            return;
+        }
+    }
+    free(block);
+}
+
+z_stream* newStream()
+{
+    z_stream* stream = new z_stream;
+    memset(stream, 0, sizeof(*stream));
+    stream->zalloc = poolAlloc;
+    stream->zfree = poolFree;
+    return stream;
+}
+
+bool parseWindowBits(const std::string& value, int min, int& bits)
+{
+    std::string digits = value;
+    if (digits.length() >= 2 && digits.front() == '"' && digits.back() == '"')
+        digits = digits.substr(1, digits.length() - 2);
+    if (digits.empty() || digits.length() > 2 || digits.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    bits = atoi(digits.c_str());
+    return bits >= min && bits <= 15;
+}
+
+std::string trim(const std::string& s, size_t begin, size_t end)
+{
+    while (begin < end && (s[begin] == ' ' || s[begin] == '\t'))
+        ++begin;
+    while (end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t'))
+        --end;
+    return s.substr(begin, end - begin);
+}
+
+} // namespace {
+
+PerMessageDeflate::Params::Params()
+: serverNoContextTakeover(false)
+, clientNoContextTakeover(false)
+, serverMaxWindowBits(15)
+, clientMaxWindowBits(15)
+{
+}
+
+const char* PerMessageDeflate::offer()
+{
+    return "permessage-deflate; client_max_window_bits";
+}
+
+bool PerMessageDeflate::negotiate(const std::string& header, Params& params)
+{
+    params = Params();
+
+    // we offered a single extension, so exactly one may come back
+    if (header.find(',') != std::string::npos)
+        return false;
+
+    bool seen[4] = { false, false, false, false };
+    size_t pos = 0;
+    bool first = true;
+    while (pos <= header.length())
+    {
+        size_t end = header.find(';', pos);
+        if (end == std::string::npos)
+            end = header.length();
+
+        std::string param = trim(header, pos, end);
+        pos = end + 1;
+
+        if (first)
+        {
+            if (strcasecmp(param.c_str(), "permessage-deflate") != 0)
+                return false;
+            first = false;
+            continue;
+        }
+
+        std::string name = param, value;
+        size_t eq = param.find('=');
+        if (eq != std::string::npos)
+        {
+            name = trim(param, 0, eq);
+            value = trim(param, eq + 1, param.length());
+        }
+
+        int which;
+        if (strcasecmp(name.c_str(), "server_no_context_takeover") == 0 && eq == std::string::npos)
+        {
+            which = 0;
+            params.serverNoContextTakeover = true;
+        }
+        else if (strcasecmp(name.c_str(), "client_no_context_takeover") == 0 && eq == std::string::npos)
+        {
+            which = 1;
+            params.clientNoContextTakeover = true;
+        }
+        else if (strcasecmp(name.c_str(), "server_max_window_bits") == 0)
+        {
+            which = 2;
+            if (!parseWindowBits(value, 8, params.serverMaxWindowBits))
+                return false;
+        }
+        else if (strcasecmp(name.c_str(), "client_max_window_bits") == 0)
+        {
+            // zlib can't deflate with a 256 byte window, it quietly uses 512
+            which = 3;
+            if (!parseWindowBits(value, 9, params.clientMaxWindowBits))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (seen[which])
+            return false;
+        seen[which] = true;
+    }
+
+    return !first;
+}
+
+void PerMessageDeflate::setPoolLimit(size_t bytes)
+{
+    Pool& p = pool();
+    std::vector<void*> released;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.limit = bytes;
+        for (auto& sized : p.blocks)
+        {
+            while (p.bytes > p.limit && !sized.second.empty())
+            {
+                released.push_back(sized.second.back());
+                sized.second.pop_back();
+                p.bytes -= sized.first;
+            }
+        }
+    }
+
+    for (void* block : released)
+        free(block);
+}
+
+PerMessageDeflate::PerMessageDeflate(const Params& params)
+: _params(params)
+, _deflate(nullptr)
+, _inflate(nullptr)
+{
+}
+
+PerMessageDeflate::~PerMessageDeflate()
+{
+    if (_deflate)
+    {
+        deflateEnd(_deflate);
+        delete _deflate;
+    }
+    if (_inflate)
+    {
+        inflateEnd(_inflate);
+        delete _inflate;
+    }
+}
+
+bool PerMessageDeflate::compress(const uint8_t* data, size_t len, std::vector<uint8_t>& out)
+{
+    IOVec slice = { data, len };
+    return compress(&slice, 1, out);
+}
+
+bool PerMessageDeflate::compress(const IOVec* slices, size_t count, std::vector<uint8_t>& out)
+{
+    if (!_deflate)
+    {
+        z_stream* stream = newStream();
+        if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -_params.clientMaxWindowBits, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            delete stream;
+            return false;
+        }
+        _deflate = stream;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i)
+        len += slices[i].length;
+
+    // the bound is for Z_FINISH, a sync flush adds at most a few bytes
+    out.resize(deflateBound(_deflate, (uLong)len) + 16);
+    size_t used = 0;
+    for (size_t i = 0; i < count || i == 0; ++i)
+    {
+        bool last = i + 1 >= count;
+        _deflate->next_in = count ? (Bytef*)slices[i].data : Z_NULL;
+        _deflate->avail_in = count ? (uInt)slices[i].length : 0;
+        do
+        {
+            if (used == out.size())
+                out.resize(out.size() * 2);
+
+            _deflate->next_out = out.data() + used;
+            _deflate->avail_out = (uInt)(out.size() - used);
+            int r = deflate(_deflate, last ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+            used = out.size() - _deflate->avail_out;
+            if (r != Z_OK && r != Z_BUF_ERROR)
+            {
+                deflateReset(_deflate);
+                return false;
+            }
+        } while (_deflate->avail_out == 0);
+    }
+
+    if (used >= sizeof(TAIL) && memcmp(out.data() + used - sizeof(TAIL), TAIL, sizeof(TAIL)) == 0)
+        used -= sizeof(TAIL);
+
+    // nothing came out (an empty message right after a flush), a lone 00
+    // makes a whole empty block with the tail the peer appends (7.2.3.6)
+    if (used == 0)
+        out[used++] = 0x00;
+    out.resize(used);
+
+    if (_params.clientNoContextTakeover)
+        deflateReset(_deflate);
+    return true;
+}
+
+bool PerMessageDeflate::decompress(const uint8_t* data, size_t len, size_t maxSize, std::vector<uint8_t>& out)
+{
+    if (!_inflate)
+    {
+        // a full window inflates whatever window size the server picked
+        z_stream* stream = newStream();
+        if (inflateInit2(stream, -15) != Z_OK)
+        {
+            delete stream;
+            return false;
+        }
+        _inflate = stream;
+    }
+
+    // without a block to finish the tail would be read as a new one
+    if (len == 0)
+    {
+        out.clear();
+        return true;
+    }
+
+    const uint8_t* inputs[2] = { data, TAIL };
+    size_t sizes[2] = { len, sizeof(TAIL) };
+
+    out.resize(std::min(std::max(len * 2, (size_t)4096), maxSize + 1));
+    size_t used = 0;
+    bool ended = false;
+    for (int part = 0; part < 2 && !ended; ++part)
+    {
+        _inflate->next_in = (Bytef*)inputs[part];
+        _inflate->avail_in = (uInt)sizes[part];
+
+        while (_inflate->avail_in > 0 || _inflate->avail_out == 0)
+        {
+            if (used == out.size())
+            {
+                if (used > maxSize)
+                {
+                    inflateReset(_inflate);
+                    return false;
+                }
+                out.resize(std::min(out.size() * 2, maxSize + 1));
+            }
+
+            _inflate->next_out = out.data() + used;
+            _inflate->avail_out = (uInt)(out.size() - used);
+            int r = inflate(_inflate, Z_SYNC_FLUSH);
+            used = out.size() - _inflate->avail_out;
+
+            if (r == Z_STREAM_END)
+            {
+                // the server ended the stream with a final block, a new one
+                // starts with the next message; the tail isn't a block on
+                // its own and would leave the new stream half way into one
+                inflateReset(_inflate);
+                ended = true;
+                break;
+            }
+            else if (r == Z_BUF_ERROR)
+            {
+                if (_inflate->avail_in > 0 && _inflate->avail_out > 0)
+                {
+                    inflateReset(_inflate);
+                    return false;
+                }
+            }
+            else if (r != Z_OK)
+            {
+                inflateReset(_inflate);
+                return false;
+            }
+        }
+        if (used > maxSize)
+        {
+            inflateReset(_inflate);
+            return false;
+        }
+    }
+
+    out.resize(used);
+
+    if (_params.serverNoContextTakeover)
+        inflateReset(_inflate);
+    return true;
+}
+
+} // namespace websocket {
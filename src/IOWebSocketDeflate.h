@@ -0,0 +1,98 @@
+#pragma once
+
+#include "IOTypes.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * RFC 7692 permessage-deflate, client side.
+ */
+
+typedef struct z_stream_s z_stream;
+
+namespace websocket {
+
+class PerMessageDeflate
+{
+public:
+
+    /**
+     * Parameters agreed in the opening handshake.
+     */
+
+    struct Params
+    {
+        Params();
+
+        bool serverNoContextTakeover;
+        bool clientNoContextTakeover;
+        int serverMaxWindowBits;
+        int clientMaxWindowBits;
+    };
+
+    /**
+     * Value of the Sec-WebSocket-Extensions request header.
+     *
+     * @api public
+     */
+
+    static const char* offer();
+
+    /**
+     * Parses the server's Sec-WebSocket-Extensions response header.
+     *
+     * @return {Boolean} false if it isn't a permessage-deflate response to
+     *   our offer, in which case the connection must fail
+     * @api public
+     */
+
+    static bool negotiate(const std::string& header, Params& params);
+
+    /**
+     * Caps the bytes of zlib state kept around for reuse by later streams,
+     * shared by all connections. 8 MiB by default, 0 to disable pooling.
+     *
+     * @api public
+     */
+
+    static void setPoolLimit(size_t bytes);
+
+    explicit PerMessageDeflate(const Params& params);
+    ~PerMessageDeflate();
+
+    /**
+     * Compresses one message into `out`, replacing its contents but keeping
+     * its capacity, without the trailing 00 00 ff ff.
+     *
+     * @return {Boolean} false on zlib failure
+     * @api public
+     */
+
+    bool compress(const uint8_t* data, size_t len, std::vector<uint8_t>& out);
+    bool compress(const IOVec* slices, size_t count, std::vector<uint8_t>& out);
+
+    /**
+     * Inflates one message into `out` like `compress`.
+     *
+     * @return {Boolean} false if the data is corrupt or inflates past
+     *   `maxSize` bytes, `out` being left bigger than `maxSize` then
+     * @api public
+     */
+
+    bool decompress(const uint8_t* data, size_t len, size_t maxSize, std::vector<uint8_t>& out);
+
+private:
+    PerMessageDeflate(const PerMessageDeflate&) = delete;
+    PerMessageDeflate& operator=(const PerMessageDeflate&) = delete;
+
+    Params _params;
+
+    // created on first use, most connections only ever send small packets
+    z_stream* _deflate;
+    z_stream* _inflate;
+};
+
+} // namespace websocket {
@@ -0,0 +1,235 @@
+#include "IOWebSocketFrame.h"
+#include "IOSimd.h"
+
+#include <string.h>
+
+#if IO_SIMD_X86
+#include <immintrin.h>
+#endif
+#if IO_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace websocket {
+
+namespace {
+
+/**
+ * Kernels mask whole vectors with `key` (the four key bytes already
+ * rotated to the start of `src`, as loaded from memory) and return how many
+ * bytes they did, always a multiple of 4 so the key stays in phase.
+ */
+
+typedef size_t (*MaskFunc)(uint8_t* dst, const uint8_t* src, size_t len, uint32_t key);
+
+size_t maskScalar(uint8_t* dst, const uint8_t* src, size_t len, uint32_t key)
+{
+    const uint64_t key64 = ((uint64_t)key << 32) | key;
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        v ^= key64;
+        memcpy(dst + i, &v, 8);
+    }
+    return i;
+}
+
+#if IO_SIMD_X86
+
+IO_SIMD_TARGET("sse2")
+size_t maskSSE2(uint8_t* dst, const uint8_t* src, size_t len, uint32_t key)
+{
+    const __m128i k = _mm_set1_epi32((int)key);
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 48), _mm_xor_si128(d, k));
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, k));
+    }
+    return i;
+}
+
+IO_SIMD_TARGET("avx2")
+size_t maskAVX2(uint8_t* dst, const uint8_t* src, size_t len, uint32_t key)
+{
+    const __m256i k = _mm256_set1_epi32((int)key);
+
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_xor_si256(b, k));
+        _mm256_storeu_si256((__m256i*)(dst + i + 64), _mm256_xor_si256(c, k));
+        _mm256_storeu_si256((__m256i*)(dst + i + 96), _mm256_xor_si256(d, k));
+    }
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, k));
+    }
+    return i;
+}
+
+#endif // IO_SIMD_X86
+
+#if IO_SIMD_NEON
+
+size_t maskNEON(uint8_t* dst, const uint8_t* src, size_t len, uint32_t key)
+{
+    const uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(key));
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        uint8x16_t a = vld1q_u8(src + i);
+        uint8x16_t b = vld1q_u8(src + i + 16);
+        uint8x16_t c = vld1q_u8(src + i + 32);
+        uint8x16_t d = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, veorq_u8(a, k));
+        vst1q_u8(dst + i + 16, veorq_u8(b, k));
+        vst1q_u8(dst + i + 32, veorq_u8(c, k));
+        vst1q_u8(dst + i + 48, veorq_u8(d, k));
+    }
+    for (; i + 16 <= len; i += 16)
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k));
+    return i;
+}
+
+#endif // IO_SIMD_NEON
+
+MaskFunc selectMask()
+{
+#if IO_SIMD_X86
+    if (simd::hasAVX2())
+        return maskAVX2;
+    if (simd::hasSSE2())
+        return maskSSE2;
+#endif
+#if IO_SIMD_NEON
+    return maskNEON;
+#endif
+    return maskScalar;
+}
+
+const MaskFunc __mask = selectMask();
+
+} // namespace {
+
+size_t writeHeader(uint8_t* out, Opcode opcode, bool fin, uint64_t length, const uint8_t* maskKey, uint8_t rsv)
+{
+    size_t n = 0;
+    out[n++] = (fin ? 0x80 : 0) | ((rsv & 0x7) << 4) | (opcode & 0xf);
+
+    uint8_t maskBit = maskKey ? 0x80 : 0;
+    if (length < 126)
+    {
+        out[n++] = maskBit | (uint8_t)length;
+    }
+    else if (length <= 0xffff)
+    {
+        out[n++] = maskBit | 126;
+        out[n++] = (uint8_t)(length >> 8);
+        out[n++] = (uint8_t)length;
+    }
+    else
+    {
+        out[n++] = maskBit | 127;
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out[n++] = (uint8_t)(length >> shift);
+    }
+
+    if (maskKey)
+    {
+        for (int i = 0; i < 4; ++i)
+            out[n++] = maskKey[i];
+    }
+    return n;
+}
+
+size_t readHeader(const uint8_t* data, size_t len, FrameHeader& header)
+{
+    if (len < 2)
+        return 0;
+
+    header.fin = (data[0] & 0x80) != 0;
+    header.rsv = (data[0] >> 4) & 0x7;
+    header.opcode = (Opcode)(data[0] & 0xf);
+    header.masked = (data[1] & 0x80) != 0;
+
+    size_t n = 2;
+    uint8_t length = data[1] & 0x7f;
+    if (length == 126)
+    {
+        if (len < n + 2)
+            return 0;
+        header.length = ((uint64_t)data[2] << 8) | data[3];
+        n += 2;
+    }
+    else if (length == 127)
+    {
+        if (len < n + 8)
+            return 0;
+        header.length = 0;
+        for (int i = 0; i < 8; ++i)
+            header.length = (header.length << 8) | data[n + i];
+        n += 8;
+    }
+    else
+    {
+        header.length = length;
+    }
+
+    if (header.masked)
+    {
+        if (len < n + 4)
+            return 0;
+        for (int i = 0; i < 4; ++i)
+            header.maskKey[i] = data[n + i];
+        n += 4;
+    }
+
+    header.size = n;
+    return n;
+}
+
+void mask(uint8_t* data, size_t len, const uint8_t maskKey[4], size_t offset)
+{
+    maskCopy(data, data, len, maskKey, offset);
+}
+
+void maskCopy(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t maskKey[4], size_t offset)
+{
+    uint8_t rotated[4];
+    for (size_t j = 0; j < 4; ++j)
+        rotated[j] = maskKey[(offset + j) & 3];
+
+    uint32_t key;
+    memcpy(&key, rotated, 4);
+
+    size_t i = __mask(dst, src, len, key);
+    if (len - i >= 8)
+        i += maskScalar(dst + i, src + i, len - i, key);
+    for (; i < len; ++i)
+        dst[i] = src[i] ^ rotated[i & 3];
+}
+
+} // namespace websocket {
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * RFC 6455 framing, shared by the WebSocket clients.
+ */
+
+namespace websocket {
+
+enum Opcode : uint8_t
+{
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xa
+};
+
+static const size_t MAX_HEADER_SIZE = 14;
+static const size_t MAX_CONTROL_PAYLOAD = 125;
+
+// FrameHeader::rsv bit set on the first frame of a compressed message
+static const uint8_t RSV1 = 0x4;
+
+struct FrameHeader
+{
+    bool fin;
+    // RSV1-3, in the low bits
+    uint8_t rsv;
+    Opcode opcode;
+    bool masked;
+    uint8_t maskKey[4];
+    uint64_t length;
+    size_t size;
+};
+
+/**
+ * Whether `opcode` is one of the control opcodes (close, ping, pong).
+ *
+ * @api public
+ */
+
+inline bool isControl(uint8_t opcode)
+{
+    return (opcode & 0x8) != 0;
+}
+
+/**
+ * Writes the header of a frame carrying `length` bytes into `out`, which
+ * needs MAX_HEADER_SIZE bytes. Masked if `maskKey` isn't null.
+ *
+ * @return {Number} bytes written
+ * @api public
+ */
+
+size_t writeHeader(uint8_t* out, Opcode opcode, bool fin, uint64_t length, const uint8_t* maskKey, uint8_t rsv = 0);
+
+/**
+ * Reads a frame header from the first `len` bytes of `data`.
+ *
+ * @return {Number} header size, 0 if `len` is too short to tell
+ * @api public
+ */
+
+size_t readHeader(const uint8_t* data, size_t len, FrameHeader& header);
+
+/**
+ * XORs `len` bytes with the masking key, `offset` being the position of
+ * `data[0]` in the payload so long payloads can be masked in pieces.
+ * Masking and unmasking are the same operation.
+ *
+ * Runs 32/16 bytes at a time with AVX2, SSE2 or NEON, a word at a time
+ * otherwise.
+ *
+ * @api public
+ */
+
+void mask(uint8_t* data, size_t len, const uint8_t maskKey[4], size_t offset = 0);
+
+/**
+ * Writes `len` masked bytes of `src` to `dst` in one pass, for building
+ * outgoing frames without a separate copy. `dst` may be `src` but must
+ * not otherwise overlap it.
+ *
+ * @api public
+ */
+
+void maskCopy(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t maskKey[4], size_t offset = 0);
+
+} // namespace websocket {
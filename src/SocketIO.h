@@ -2,6 +2,8 @@
 
 #include "IOTypes.h"
 
+#include <memory>
+
 class SocketIOSocket;
 
 class SocketIO
@@ -48,7 +48,7 @@ DeconstructedPacket deconstructPacket(const SocketIOPacket& packet)
   return ret;
 }
 
-SocketIOPacket reconstructPacket(const SocketIOPacket& packet, const ValueArray& buffers)
+SocketIOPacket reconstructPacket(const SocketIOPacket& packet, const ValueArray& buffers, MemoryResource* resource)
 {
 //  int curPlaceHolder = 0;
 
@@ -61,24 +61,29 @@ SocketIOPacket reconstructPacket(const SocketIOPacket& packet, const ValueArray&
       const Value& buf = buffers[num]; // appropriate buffer (should be natural order anyway)
       return buf;
     } else if (data.getType() == Value::Type::ARRAY) {
-      ValueArray arr;
       const ValueArray& originalArr = data.asArray();
+      ValueArray arr(resource);
+      arr.reserve(originalArr.size());
       for (size_t i = 0; i < originalArr.size(); i++) {
-        arr[i] = _reconstructPacket(originalArr[i]);
+        arr.push_back(_reconstructPacket(originalArr[i]));
       }
-      return arr;
+      return Value(std::move(arr));
     } else if (data.getType() == Value::Type::OBJECT) {
-      ValueObject obj;
       const ValueObject& originalObj = data.asObject();
+      ValueObject obj(resource);
+      obj.reserve(originalObj.size());
       for (const auto& e : originalObj) {
-        obj[e.first] = _reconstructPacket(e.second);
+        obj.emplace(e.first, _reconstructPacket(e.second));
       }
-      return obj;
+      return Value(std::move(obj));
     }
     return data;
   };
 
   SocketIOPacket p;
+  p.type = packet.type;
+  p.nsp = packet.nsp;
+  p.id = packet.id;
   p.data = _reconstructPacket(packet.data);
   p.attachments = -1; // no longer useful
   return p;
@@ -29,10 +29,12 @@ DeconstructedPacket deconstructPacket(const SocketIOPacket& packet);
  *
  * @param {Object} packet - event packet with placeholders
  * @param {Array} buffers - binary buffers to put in placeholder positions
+ * @param {MemoryResource} resource - where the rebuilt arrays and objects
+ *   are allocated (default heap when null)
  * @return {Object} reconstructed packet
  * @api public
  */
 
-SocketIOPacket reconstructPacket(const SocketIOPacket& packet, const ValueArray& buffers);
+SocketIOPacket reconstructPacket(const SocketIOPacket& packet, const ValueArray& buffers, MemoryResource* resource = nullptr);
 
 } // namespace binary {
@@ -5,6 +5,9 @@
 #include "Backoff.h"
 #include "IOUtils.h"
 
+// binary events with this many attachment bytes are sent as bulk
+static const size_t BULK_THRESHOLD = 64 * 1024;
+
 using namespace socketio::parser;
 
 SocketIOManager::SocketIOManager(const std::string& uri, const Opts& opts)
@@ -36,17 +39,20 @@ SocketIOManager::SocketIOManager(const std::string& uri, const Opts& opts)
   _packetBuffer.clear();
   _encoder.reset(new Encoder());
   _decoder.reset(new Decoder());
+  _decoder->setLazyEnabled(opts.lazyDecoding);
+  _decoder->setArenaEnabled(opts.arenaDecoding);
   _autoConnect = opts.autoConnect;
   if (_autoConnect)
     connect(nullptr, opts);
 }
 
-void SocketIOManager::emitAll(const std::string& eventName, const Value& args)
+void SocketIOManager::emitAll(EventId event, const Value& args)
 {
-  Emitter::emit(eventName, args);
+  Emitter::emit(event, args);
 
+  // only internal events get here, they are not sent to the server
   for (const auto& e : _nsps) {
-      e.second->emit(args);
+      e.second->Emitter::emit(event, args);
   }
 }
 
@@ -154,7 +160,7 @@ void SocketIOManager::connect(const std::function<void()>& fn, const Opts& opts)
     debug("connect_error");
     cleanup();
     _readyState = ReadyState::CLOSED;
-    emitAll("connect_error", data);
+    emitAll(EventId::CONNECT_ERROR, data);
     if (fn) {
 //cjh      var err = new Error("Connection error");
 //      err.data = data;
@@ -175,7 +181,7 @@ void SocketIOManager::connect(const std::function<void()>& fn, const Opts& opts)
       debug("connect attempt timed out after %f", timeout);
       openSub.destroy();
       socket->close();
-      socket->emit("error", "timeout");
+      socket->Emitter::emit(EventId::ERROR, "timeout");
 //cjh      emitAll("connect_timeout", timeout);
     }, timeout);
 
@@ -199,22 +205,37 @@ void SocketIOManager::onopen(const Value& unused)
 
   // mark as open
   _readyState = ReadyState::OPENED;
-  emit("open");
+  emit(EventId::OPEN);
 
   // add new subs
   auto socket = _engine;
-  _subs.push_back(gon(socket, "data", std::bind(&SocketIOManager::ondata, this, std::placeholders::_1)));
+  _subs.push_back(gon<Value>(socket, EventId::DATA, std::bind(&SocketIOManager::ondata, this, std::placeholders::_1)));
   _subs.push_back(gon(socket, "ping", std::bind(&SocketIOManager::onping, this, std::placeholders::_1)));
   _subs.push_back(gon(socket, "pong", std::bind(&SocketIOManager::onpong, this, std::placeholders::_1)));
   _subs.push_back(gon(socket, "error", std::bind(&SocketIOManager::onerror, this, std::placeholders::_1)));
   _subs.push_back(gon(socket, "close", std::bind(&SocketIOManager::onclose, this, std::placeholders::_1)));
-  _subs.push_back(gon(_decoder, "decoded", std::bind(&SocketIOManager::ondecoded, this, std::placeholders::_1)));
+  _subs.push_back(gon(socket, "writable", std::bind(&SocketIOManager::onwritable, this, std::placeholders::_1)));
+  _subs.push_back(gon<SocketIOPacket>(_decoder, EventId::DECODED, std::bind(&SocketIOManager::ondecoded, this, std::placeholders::_1)));
+}
+
+bool SocketIOManager::writable() const
+{
+  return !_engine || _engine->writable();
+}
+
+void SocketIOManager::onwritable(const Value& unused)
+{
+  emit(EventId::WRITABLE);
+
+  for (const auto& e : _nsps) {
+      e.second->ondrain();
+  }
 }
 
 void SocketIOManager::onping(const Value& unused)
 {
 //cjh  this.lastPing = new Date();
-  emitAll("ping");
+  emitAll(EventId::PING);
 };
 
 void SocketIOManager::onpong(const Value& unused)
@@ -227,15 +248,15 @@ void SocketIOManager::ondata(const Value& data)
   _decoder->add(data);
 }
 
-void SocketIOManager::ondecoded(const Value& packet)
+void SocketIOManager::ondecoded(const SocketIOPacket& packet)
 {
-  emit("packet", packet);
+  emit<SocketIOPacket>(EventId::PACKET, packet);
 };
 
 void SocketIOManager::onerror(const Value& err)
 {
   debug("error: %s", err.asString().c_str());
-  emitAll("error", err);
+  emitAll(EventId::ERROR, err);
 };
 
 std::shared_ptr<SocketIOSocket> SocketIOManager::createSocket(const std::string& nsp, const Opts& opts)
@@ -282,7 +303,12 @@ void SocketIOManager::destroySocket(std::shared_ptr<SocketIOSocket> socket)
   disconnect();
 };
 
-void SocketIOManager::sendPacket(SocketIOPacket& packet)
+void SocketIOManager::sendPacket(const SocketIOPacket& packet)
+{
+    sendPacket(SocketIOPacket(packet));
+}
+
+void SocketIOManager::sendPacket(SocketIOPacket&& packet)
 {
   debug("writing packet %s", packet.toString().c_str());
     if (!packet.query.empty() && packet.type == SocketIOPacket::Type::CONNECT)
@@ -295,24 +321,45 @@ void SocketIOManager::sendPacket(SocketIOPacket& packet)
     _encoding = true;
     ValueArray encodedPackets = _encoder->encode(packet);
 
-    for (const auto& encodedPacket : encodedPackets)
-    {
-        _engine->send(encodedPacket, packet.options);
+    if (SocketIOPacket::Type::ACK == packet.type) {
+      ValueObject options = packet.options;
+      options["priority"] = (int)EngineIOSocket::Priority::ACK;
+      _engine->send(std::move(encodedPackets[0]), options);
+    } else if (encodedPackets.size() == 1) {
+      _engine->send(std::move(encodedPackets[0]), packet.options);
+    } else {
+      // attachments follow their header, big ones go in the bulk lane
+      ValueObject options = packet.options;
+      size_t attachments = 0;
+      for (size_t i = 1; i < encodedPackets.size(); i++)
+        attachments += encodedPackets[i].asBuffer().length();
+      if (SocketIOPacket::Type::BINARY_ACK == packet.type)
+        options["priority"] = (int)EngineIOSocket::Priority::ACK;
+      else if (attachments >= BULK_THRESHOLD)
+        options["priority"] = (int)EngineIOSocket::Priority::BULK;
+
+      options["continued"] = true;
+      for (size_t i = 0; i < encodedPackets.size(); i++)
+      {
+          if (i + 1 == encodedPackets.size())
+              options.erase("continued");
+          _engine->send(std::move(encodedPackets[i]), options);
+      }
     }
     _encoding = false;
     processPacketQueue();
 
   } else { // add packet to the queue
-    _packetBuffer.push_back(packet);
+    _packetBuffer.push(std::move(packet));
   }
 };
 
 void SocketIOManager::processPacketQueue()
 {
   if (!_packetBuffer.empty() && !_encoding) {
-    auto& pack = _packetBuffer[0];
-    sendPacket(pack);
-    _packetBuffer.erase(_packetBuffer.begin());
+    SocketIOPacket pack = std::move(_packetBuffer.front());
+    _packetBuffer.pop();
+    sendPacket(std::move(pack));
   }
 };
 
@@ -357,7 +404,7 @@ void SocketIOManager::onclose(const Value& reason)
   cleanup();
   _backoff->reset();
   _readyState = ReadyState::CLOSED;
-  emit("close", reason);
+  emit(EventId::CLOSE, reason);
 
   if (_reconnection && !_skipReconnect) {
     reconnect();
@@ -372,7 +419,7 @@ void SocketIOManager::reconnect()
   if (_backoff->getAttempts() >= _reconnectionAttempts) {
     debug("reconnect failed");
     _backoff->reset();
-    emitAll("reconnect_failed");
+    emitAll(EventId::RECONNECT_FAILED);
     _reconnecting = false;
   } else {
     long delay = _backoff->getDuration();
@@ -416,5 +463,5 @@ void SocketIOManager::onreconnect()
   _reconnecting = false;
   _backoff->reset();
   updateSocketIds();
-  emitAll("reconnect", Value(attempt));
+  emitAll(EventId::RECONNECT, Value(attempt));
 }
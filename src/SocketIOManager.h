@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Emitter.h"
+#include "IORingBuffer.h"
 
 class SocketIOSocket;
 class EngineIOSocket;
@@ -104,6 +105,15 @@ public:
     void setTimeoutDelay(long v);
     long getTimeoutDelay() const;
 
+    /**
+     * Whether the engine is below its high watermark, see
+     * `EngineIOSocket::writable`.
+     *
+     * @api public
+     */
+
+    bool writable() const;
+
 private:
     /**
      * Propagate given event to sockets and emit on `this`
@@ -111,7 +121,7 @@ private:
      * @api private
      */
 
-    void emitAll(const std::string& eventName, const Value& args = Value::NONE);
+    void emitAll(EventId event, const Value& args = Value::NONE);
 
     /**
      * Starts trying to reconnect if reconnection is enabled and we have not
@@ -160,7 +170,7 @@ private:
      * @api private
      */
 
-    void ondecoded(const Value& packet);
+    void ondecoded(const SocketIOPacket& packet);
 
     /**
      * Called upon socket error.
@@ -170,6 +180,14 @@ private:
 
     void onerror(const Value& err);
 
+    /**
+     * Called when the engine write buffer is down to the low watermark.
+     *
+     * @api private
+     */
+
+    void onwritable(const Value& unused);
+
     /**
      * Writes a packet.
      *
@@ -177,7 +195,8 @@ private:
      * @api private
      */
 
-    void sendPacket(SocketIOPacket& packet);
+    void sendPacket(const SocketIOPacket& packet);
+    void sendPacket(SocketIOPacket&& packet);
 
     /**
      * If packet buffer is non-empty, begins encoding the
@@ -243,7 +262,7 @@ private:
     std::unordered_map<std::string, std::shared_ptr<SocketIOSocket>> _nsps;
     std::vector<std::shared_ptr<SocketIOSocket>> _connecting;
     std::vector<OnObj> _subs;
-    std::vector<SocketIOPacket> _packetBuffer;
+    RingBuffer<SocketIOPacket> _packetBuffer;
     std::shared_ptr<EngineIOSocket> _engine;
     std::string _uri;
 
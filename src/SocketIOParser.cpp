@@ -2,6 +2,7 @@
 
 #include "SocketIOBinary.h"
 #include "IOUtils.h"
+#include "IOJson.h"
 
 namespace socketio { namespace parser {
 
@@ -45,7 +46,7 @@ Encoder::~Encoder()
 
 ValueArray Encoder::encode(const SocketIOPacket& obj)
 {
-  debug("encoding packet %s\n", obj.toString().c_str());
+  debug("encoding packet %s\n", __types[(int)obj.type].c_str());
 
   if (SocketIOPacket::Type::BINARY_EVENT == obj.type || SocketIOPacket::Type::BINARY_ACK == obj.type) {
     return encodeAsBinary(obj);
@@ -59,15 +60,18 @@ ValueArray Encoder::encode(const SocketIOPacket& obj)
 
 std::string Encoder::encodeAsString(const SocketIOPacket& obj)
 {
-  std::string str = "";
+  std::string str;
   bool nsp = false;
 
+  // header and json data go into a single buffer
+  str.reserve(24 + obj.nsp.size() + (obj.data.isValid() ? json::estimateSize(obj.data) : 0));
+
     // first is type
-    str += toString((int)obj.type);
+    str += (char)('0' + (int)obj.type);
 
   // attachments if we have them
   if (SocketIOPacket::Type::BINARY_EVENT == obj.type || SocketIOPacket::Type::BINARY_ACK == obj.type) {
-    str += toString(obj.attachments);
+    json::appendInt(str, obj.attachments);
     str += "-";
   }
 
@@ -84,16 +88,15 @@ std::string Encoder::encodeAsString(const SocketIOPacket& obj)
       str += ",";
       nsp = false;
     }
-    str += obj.id;
+    json::appendInt(str, obj.id);
   }
 
   // json data
   if (obj.data.isValid()) {
     if (nsp) str += ",";
-//cjh    str += json.stringify(obj.data);
+    json::stringify(obj.data, str);
   }
 
-  debug("encoded %s as %s", obj.toString().c_str(), str.c_str());
   return str;
 }
 
@@ -123,19 +126,20 @@ ValueArray Encoder::encodeAsBinary(const SocketIOPacket& obj)
 class BinaryReconstructor
 {
 public:
-  BinaryReconstructor(const SocketIOPacket& packet);
+  BinaryReconstructor(SocketIOPacket&& packet, MemoryResource* resource);
 
   /**
    * Method to be called when binary data received from connection
    * after a BINARY_EVENT packet.
    *
    * @param {Buffer | ArrayBuffer} binData - the raw binary data received
-   * @return {null | Object} returns null if more binary data is expected or
-   *   a reconstructed packet object if all buffers have been received.
+   * @param {Object} packet - receives the reconstructed packet
+   * @return {Boolean} false if more binary data is expected, true
+   *   if all buffers have been received.
    * @api private
    */
 
-  SocketIOPacket takeBinaryData(const Value& binData);
+  bool takeBinaryData(const Value& binData, SocketIOPacket& packet);
 
   /**
    * Cleans up binary packet reconstruction variables.
@@ -148,22 +152,24 @@ public:
 //private:
   SocketIOPacket _reconPack;
   ValueArray _buffers;
+  MemoryResource* _resource;
 };
 
-BinaryReconstructor::BinaryReconstructor(const SocketIOPacket& packet)
-: _reconPack(packet)
+BinaryReconstructor::BinaryReconstructor(SocketIOPacket&& packet, MemoryResource* resource)
+: _reconPack(std::move(packet))
+, _resource(resource)
 {
 }
 
-SocketIOPacket BinaryReconstructor::takeBinaryData(const Value& binData)
+bool BinaryReconstructor::takeBinaryData(const Value& binData, SocketIOPacket& packet)
 {
-  SocketIOPacket packet;
   _buffers.push_back(binData);
-  if (_buffers.size() == _reconPack.attachments) { // done with buffer list
-    packet = binary::reconstructPacket(_reconPack, _buffers);
+  if (_buffers.size() == (size_t)_reconPack.attachments) { // done with buffer list
+    packet = binary::reconstructPacket(_reconPack, _buffers, _resource);
     finishedReconstruction();
+    return true;
   }
-  return packet;
+  return false;
 }
 
 void BinaryReconstructor::finishedReconstruction()
@@ -174,8 +180,18 @@ void BinaryReconstructor::finishedReconstruction()
 
 //
 
+static SocketIOPacket error()
+{
+  SocketIOPacket p;
+  p.type = SocketIOPacket::Type::ERROR;
+  p.data = "parser error";
+  return p;
+}
+
 Decoder::Decoder()
 : _reconstructor(nullptr)
+, _arena(nullptr)
+, _lazy(false)
 {
 
 }
@@ -183,22 +199,54 @@ Decoder::Decoder()
 Decoder::~Decoder()
 {
   delete _reconstructor;
+  delete _arena;
+}
+
+void Decoder::setArenaEnabled(bool enabled)
+{
+  if (enabled == (_arena != nullptr))
+    return;
+
+  // a half reconstructed packet may live in the arena
+  delete _reconstructor;
+  _reconstructor = nullptr;
+
+  delete _arena;
+  _arena = enabled ? new Arena() : nullptr;
+}
+
+void Decoder::setLazyEnabled(bool enabled)
+{
+  _lazy = enabled;
 }
 
 bool Decoder::add(const Value& obj)
+{
+  bool ret = decode(obj);
+
+  // the packet just emitted is gone; recycle its memory unless a binary
+  // packet is still waiting for buffers
+  if (_arena && !_reconstructor)
+    _arena->release();
+
+  return ret;
+}
+
+bool Decoder::decode(const Value& obj)
 {
   SocketIOPacket packet;
   if (obj.getType() == Value::Type::STRING) {
     packet = decodeString(obj.asString());
     if (SocketIOPacket::Type::BINARY_EVENT == packet.type || SocketIOPacket::Type::BINARY_ACK == packet.type) { // binary packet's json
-      _reconstructor = new BinaryReconstructor(packet);
-
       // no attachments, labeled binary but no binary data to follow
-      if (_reconstructor->_reconPack.attachments == 0) {
-        emit("decoded", packet);
+      if (packet.attachments == 0) {
+        emit<SocketIOPacket>(EventId::DECODED, packet);
+      } else {
+        delete _reconstructor;
+        _reconstructor = new BinaryReconstructor(std::move(packet), _arena);
       }
     } else { // non-binary full packet
-      emit("decoded", packet);
+      emit<SocketIOPacket>(EventId::DECODED, packet);
     }
   }
   else if (obj.getType() == Value::Type::BINARY) {// cjh || obj.base64) { // raw binary data
@@ -206,11 +254,10 @@ bool Decoder::add(const Value& obj)
 //cjh      Error("got binary data when not reconstructing a packet");
       return false;
     } else {
-      packet = _reconstructor->takeBinaryData(obj);
-      if (packet.isValid()) { // received final buffer
+      if (_reconstructor->takeBinaryData(obj, packet)) { // received final buffer
         delete _reconstructor;
         _reconstructor = nullptr;
-        emit("decoded", packet);
+        emit<SocketIOPacket>(EventId::DECODED, packet);
       }
     }
   }
@@ -222,91 +269,87 @@ bool Decoder::add(const Value& obj)
   return true;
 }
 
+// attachment counts and ids past 999999999 are no packet anyone sends, and
+// a tenth digit could overflow the int they go in
+static const size_t MAX_DIGITS = 9;
+
 SocketIOPacket Decoder::decodeString(const std::string& str)
 {
   SocketIOPacket p;
-//  size_t i = 0;
-//
-//  // look up type
-//  p.type = Number(str.charAt(0));
-//
-//  if (p.type < 0 || p.type >= __types.size())
-//    return false;
-//
-//  // look up attachments if type binary
-//  if (SocketIOPacket::Type::BINARY_EVENT == p.type || SocketIOPacket::Type::BINARY_ACK == p.type) {
-//    var buf = "";
-//    while (str.charAt(++i) != "-") {
-//      buf += str.charAt(i);
-//      if (i == str.length) break;
-//    }
-//    if (buf != Number(buf) || str.charAt(i) != "-") {
-//      throw new Error("Illegal attachments");
-//    }
-//    p.attachments = Number(buf);
-//  }
-//
-//  // look up namespace (if any)
-//  if ("/" == str.charAt(i + 1)) {
-//    p.nsp = "";
-//    while (++i) {
-//      var c = str.charAt(i);
-//      if ("," == c) break;
-//      p.nsp += c;
-//      if (i == str.length) break;
-//    }
-//  } else {
-//    p.nsp = "/";
-//  }
-//
-//  // look up id
-//  var next = str.charAt(i + 1);
-//  if ("" != next && Number(next) == next) {
-//    p.id = "";
-//    while (++i) {
-//      var c = str.charAt(i);
-//      if (null == c || Number(c) != c) {
-//        --i;
-//        break;
-//      }
-//      p.id += str.charAt(i);
-//      if (i == str.length) break;
-//    }
-//    p.id = Number(p.id);
-//  }
-//
-//  // look up json data
-//  if (str.charAt(++i)) {
-//    p = tryParse(p, str.substr(i));
-//  }
-//
-//  debug("decoded %s as %j", str, p);
+  size_t i = 0;
+  size_t len = str.size();
+
+  // look up type
+  int type = len > 0 ? str[0] - '0' : -1;
+  if (type < 0 || type >= (int)__types.size())
+    return error();
+  p.type = (SocketIOPacket::Type)type;
+
+  // look up attachments if type binary
+  if (SocketIOPacket::Type::BINARY_EVENT == p.type || SocketIOPacket::Type::BINARY_ACK == p.type) {
+    int attachments = 0;
+    size_t start = i + 1;
+    while (++i < len && str[i] != '-') {
+      if (str[i] < '0' || str[i] > '9' || i - start >= MAX_DIGITS)
+        return error();
+      attachments = attachments * 10 + (str[i] - '0');
+    }
+    if (i >= len || i == start) {
+      return error(); // Illegal attachments
+    }
+    p.attachments = attachments;
+  }
+
+  // look up namespace (if any)
+  if (i + 1 < len && '/' == str[i + 1]) {
+    size_t start = i + 1;
+    while (++i < len && str[i] != ',') {}
+    p.nsp = str.substr(start, i - start);
+  } else {
+    p.nsp = "/";
+  }
+
+  // look up id
+  if (i + 1 < len && str[i + 1] >= '0' && str[i + 1] <= '9') {
+    int id = 0;
+    size_t start = i + 1;
+    while (++i < len && str[i] >= '0' && str[i] <= '9') {
+      if (i - start >= MAX_DIGITS)
+        return error();
+      id = id * 10 + (str[i] - '0');
+    }
+    --i;
+    p.id = id;
+  }
+
+  // look up json data
+  if (++i < len) {
+    bool ok;
+    if (_lazy) {
+      // lazy values keep slices of this copy, not of `str`
+      Buffer text((const uint8_t*)str.data() + i, len - i);
+      ok = _json.parseShallow(text, p.data, _arena);
+    } else {
+      ok = _json.parse(str.data() + i, len - i, p.data, _arena);
+    }
+    if (!ok) {
+      return error();
+    }
+  }
+
   return p;
 }
 
-//function tryParse(p, str) {
-//  try {
-//    p.data = json.parse(str);
-//  } catch(e){
-//    return error();
-//  }
-//  return p; 
-//};
-
 void Decoder::destroy()
 {
   if (_reconstructor) {
     _reconstructor->finishedReconstruction();
   }
+  if (_arena) {
+    _arena->release();
+  }
 };
 
 
 
-//function error(data){
-//  return {
-//    type: exports.ERROR,
-//    data: "parser error"
-//  };
-//}
-
 }} // namespace socketio { namespace parser {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Emitter.h"
+#include "IOArena.h"
+#include "IOJson.h"
 
 namespace socketio { namespace parser {
 
@@ -73,8 +75,40 @@ public:
 
     void destroy();
 
+    /**
+     * Builds each decoded packet in a per-packet arena instead of
+     * allocating every array and object node on its own. The tree passed
+     * to "decoded" listeners is then only valid during the emit; copy it
+     * to keep it around.
+     *
+     * @param {Boolean} enabled
+     * @api public
+     */
+
+    void setArenaEnabled(bool enabled);
+
+    /**
+     * Decodes only the top level of each packet's JSON data. Arrays and
+     * objects below it stay as slices of the received text and are parsed
+     * the first time they are read, so listeners that route on the event
+     * name never pay for arguments they don't look at. Re-encoding an
+     * untouched argument copies its text back out as is.
+     *
+     * @param {Boolean} enabled
+     * @api public
+     */
+
+    void setLazyEnabled(bool enabled);
+
 private:
 
+    /**
+     * Decodes one chunk and emits "decoded" once a packet is complete.
+     *
+     * @api private
+     */
+    bool decode(const Value& obj);
+
     /**
      * Decode a packet String (JSON data)
      *
@@ -85,6 +119,9 @@ private:
     SocketIOPacket decodeString(const std::string& str);
 
     BinaryReconstructor* _reconstructor;
+    Arena* _arena;
+    json::Parser _json;
+    bool _lazy;
 };
 
 }} //namespace socketio { namespace parser {
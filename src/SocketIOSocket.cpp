@@ -1,5 +1,6 @@
 #include "SocketIOSocket.h"
 #include "SocketIOManager.h"
+#include "IOJson.h"
 #include "IOUtils.h"
 
 #include <assert.h>
@@ -11,23 +12,23 @@
  * @api private
  */
 
-static std::vector<std::string> __events = {
-  "connect",
-  "connect_error",
-  "connect_timeout",
-  "connecting",
-  "disconnect",
-  "error",
-  "reconnect",
-  "reconnect_attempt",
-  "reconnect_failed",
-  "reconnect_error",
-  "reconnecting",
-  "ping",
-  "pong"
+static const EventId __events[] = {
+  EventId::CONNECT,
+  EventId::CONNECT_ERROR,
+  EventId::CONNECT_TIMEOUT,
+  EventId::CONNECTING,
+  EventId::DISCONNECT,
+  EventId::ERROR,
+  EventId::RECONNECT,
+  EventId::RECONNECT_ATTEMPT,
+  EventId::RECONNECT_FAILED,
+  EventId::RECONNECT_ERROR,
+  EventId::RECONNECTING,
+  EventId::PING,
+  EventId::PONG,
+  EventId::DRAIN
 };
 
-
 SocketIOSocket::SocketIOSocket(std::shared_ptr<SocketIOManager> io, const std::string& nsp, const Opts& opts)
 {
   _io = io;
@@ -36,6 +37,10 @@ SocketIOSocket::SocketIOSocket(std::shared_ptr<SocketIOManager> io, const std::s
   _acks.clear();
   _receiveBuffer.clear();
   _sendBuffer.clear();
+  _sendBufferBytes = 0;
+  _highWaterMark = io->_opts.highWaterMark;
+  _lowWaterMark = _highWaterMark > 0 ? std::min(io->_opts.lowWaterMark, _highWaterMark - 1) : 0;
+  _needDrain = false;
   _connected = false;
   _disconnected = true;
   if (opts.isValid() && !opts.query.empty()) {
@@ -47,10 +52,10 @@ SocketIOSocket::SocketIOSocket(std::shared_ptr<SocketIOManager> io, const std::s
 
 void SocketIOSocket::subEvents()
 {
-  if (_subs.empty()) return;
+  if (!_subs.empty()) return;
 
   _subs.push_back(gon(_io, "open", std::bind(&SocketIOSocket::onopen, this, std::placeholders::_1)));
-  _subs.push_back(gon(_io, "packet", std::bind(&SocketIOSocket::onpacket, this, std::placeholders::_1)));
+  _subs.push_back(gon<SocketIOPacket>(_io, EventId::PACKET, std::bind(&SocketIOSocket::onpacket, this, std::placeholders::_1)));
   _subs.push_back(gon(_io, "close", std::bind(&SocketIOSocket::onclose, this, std::placeholders::_1)));
 }
 
@@ -63,7 +68,7 @@ void SocketIOSocket::open()
   _io->connect(nullptr, Opts()); // ensure open
   if (ReadyState::OPENED == _io->getReadyState())
       onopen(Value::NONE);
-  emit("connecting");
+  Emitter::emit(EventId::CONNECTING);
 }
 
 void SocketIOSocket::send(const Value& args)
@@ -76,26 +81,25 @@ void SocketIOSocket::emit(const Value& args)
     assert(args.getType() == Value::Type::ARRAY);
 
     ValueArray arguments = args.asArray();
+    emitArguments(std::move(arguments));
+}
+
+void SocketIOSocket::emitArguments(ValueArray&& arguments)
+{
     if (arguments.empty()) return;
 
     const Value& event = arguments.at(0);
     assert(event.getType() == Value::Type::STRING);
 
-    const std::string& eventName = event.asString();
+    EventId id = EventId::find(event.asString());
 
-    if (std::find(__events.begin(), __events.end(), eventName) != __events.end())
+    if (std::find(std::begin(__events), std::end(__events), id) != std::end(__events))
     {
-        Emitter::emit(eventName, args);
+        Emitter::emit(Value(std::move(arguments)));
         return;
     }
 
-    SocketIOPacket::Type parserType = SocketIOPacket::Type::EVENT; // default
-    if (args.hasBin()) {
-        parserType = SocketIOPacket::Type::BINARY_EVENT;
-    } // binary
-
     SocketIOPacket packet;
-    packet.type = parserType;
     packet.options["compress"] = _compress;
 
     // event ack callback
@@ -106,25 +110,53 @@ void SocketIOSocket::emit(const Value& args)
         arguments.pop_back();
     }
 
-    packet.data = arguments;
+    packet.data = std::move(arguments);
+
+    SocketIOPacket::Type parserType = SocketIOPacket::Type::EVENT; // default
+    if (packet.data.hasBin()) {
+        parserType = SocketIOPacket::Type::BINARY_EVENT;
+    } // binary
+    packet.type = parserType;
 
     if (_connected) {
-        sendPacket(packet);
+        sendPacket(std::move(packet));
     } else {
-        _sendBuffer.push_back(packet);
+        _sendBufferBytes += json::estimateSize(packet.data);
+        _sendBuffer.push_back(std::move(packet));
     }
+
+    // over a watermark now: `drain` once both buffers are back down
+    if (!writable())
+        _needDrain = true;
+}
+
+bool SocketIOSocket::writable() const
+{
+  return (0 == _highWaterMark || _sendBufferBytes < _highWaterMark) && _io->writable();
+}
+
+void SocketIOSocket::ondrain()
+{
+  if (!_needDrain || _sendBufferBytes > _lowWaterMark || !_io->writable()) return;
+
+  _needDrain = false;
+  Emitter::emit(EventId::DRAIN);
 }
 
 void SocketIOSocket::emit(const std::string& eventName, const Value& args)
 {
-    ValueArray arguments = Value::concat(eventName, args);
-    SocketIOSocket::emit(arguments);
+    emitArguments(Value::concat(eventName, args));
+}
+
+void SocketIOSocket::emit(const std::string& eventName, Value&& args)
+{
+    emitArguments(Value::concat(eventName, std::move(args)));
 }
 
-void SocketIOSocket::sendPacket(const SocketIOPacket& packet)
+void SocketIOSocket::sendPacket(SocketIOPacket&& packet)
 {
-  const_cast<SocketIOPacket&>(packet).nsp = _nsp;
-  _io->sendPacket(const_cast<SocketIOPacket&>(packet));
+  packet.nsp = _nsp;
+  _io->sendPacket(std::move(packet));
 }
 
 void SocketIOSocket::onopen(const Value& v)
@@ -138,9 +170,9 @@ void SocketIOSocket::onopen(const Value& v)
 
     if (!_query.empty()) {
       packet.query = _query;
-      sendPacket(packet);
+      sendPacket(std::move(packet));
     } else {
-      sendPacket(packet);
+      sendPacket(std::move(packet));
     }
   }
 }
@@ -151,12 +183,11 @@ void SocketIOSocket::onclose(const Value& reason)
   _connected = false;
   _disconnected = true;
   _id.clear();
-  emit("disconnect", reason);
+  Emitter::emit(EventId::DISCONNECT, reason);
 }
 
-void SocketIOSocket::onpacket(const Value& v)
+void SocketIOSocket::onpacket(const SocketIOPacket& packet)
 {
-  const SocketIOPacket& packet = v.asSocketIOPacket();
   if (packet.nsp != _nsp) return;
 
   switch (packet.type) {
@@ -185,7 +216,7 @@ void SocketIOSocket::onpacket(const Value& v)
       break;
 
     case SocketIOPacket::Type::ERROR:
-      emit("error", packet.data);
+      Emitter::emit(EventId::ERROR, packet.data);
       break;
   }
 }
@@ -193,18 +224,21 @@ void SocketIOSocket::onpacket(const Value& v)
 void SocketIOSocket::onevent(const SocketIOPacket& packet)
 {
     const Value& args = packet.data;
-    debug("emitting event %s", args.toString().c_str());
+    // only the name: printing the whole arguments would parse lazy ones
+    const Value* name = args.getType() == Value::Type::ARRAY && !args.asArray().empty() ? &args.asArray()[0] : nullptr;
+    debug("emitting event %s\n", name && name->getType() == Value::Type::STRING ? name->asString().c_str() : "");
 
-    ValueArray arguments;
+    Value withAck;
   if (packet.id != -1) {
     debug("attaching ack callback to event");
-    arguments = Value::concat(args, ack(packet.id));
+    withAck = Value::concat(args, ack(packet.id));
   }
+  const Value& arguments = withAck.isValid() ? withAck : args;
 
   if (_connected) {
-    emit(args);
+    Emitter::emit(arguments);
   } else {
-    _receiveBuffer.push_back(args);
+    _receiveBuffer.push_back(arguments);
   }
 }
 
@@ -224,7 +258,7 @@ ValueFunction SocketIOSocket::ack(int id)
     packet.id = id;
     packet.data = data;
 
-    sendPacket(packet);
+    sendPacket(std::move(packet));
   };
 }
 
@@ -244,7 +278,7 @@ void SocketIOSocket::onconnect()
 {
   _connected = true;
   _disconnected = false;
-  emit("connect");
+  Emitter::emit(EventId::CONNECT);
   emitBuffered();
 }
 
@@ -252,15 +286,18 @@ void SocketIOSocket::emitBuffered()
 {
   for (auto& receivedBuf : _receiveBuffer)
   {
-      emit(receivedBuf);
+      Emitter::emit(receivedBuf);
   }
 
   _receiveBuffer.clear();
 
   for (size_t i = 0; i < _sendBuffer.size(); i++) {
-    sendPacket(_sendBuffer[i]);
+    sendPacket(std::move(_sendBuffer[i]));
   }
   _sendBuffer.clear();
+  _sendBufferBytes = 0;
+
+  ondrain();
 }
 
 void SocketIOSocket::ondisconnect()
@@ -290,7 +327,7 @@ void SocketIOSocket::close()
     debug("performing disconnect (%s)", _nsp.c_str());
       SocketIOPacket packet;
       packet.type = SocketIOPacket::Type::DISCONNECT;
-      sendPacket(packet);
+      sendPacket(std::move(packet));
   }
 
   // remove socket from pool
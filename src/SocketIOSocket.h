@@ -49,11 +49,23 @@ public:
      */
     void setCompress(bool compress);
 
+    /**
+     * Whether an emit now would stay below `Opts::highWaterMark`, counting
+     * the events buffered until connect and the engine's write buffer.
+     * Once an emit has gone over the high watermark, `drain` is emitted
+     * when both are down to `Opts::lowWaterMark`.
+     *
+     * @return {Boolean}
+     * @api public
+     */
+    bool writable() const;
+
     void setId(const std::string& id) { _id = id; }
     const std::string& getId() const { return _id; }
 
     virtual void emit(const Value& args) override;
     virtual void emit(const std::string& eventName, const Value& args) override;
+    virtual void emit(const std::string& eventName, Value&& args) override;
 
 private:
 
@@ -65,6 +77,14 @@ private:
 
     void subEvents();
 
+    /**
+     * Emits `[eventName, ...args]`, taking ownership of the arguments.
+     *
+     * @api private
+     */
+
+    void emitArguments(ValueArray&& arguments);
+
     /**
      * Sends a packet.
      *
@@ -72,7 +92,7 @@ private:
      * @api private
      */
 
-    void sendPacket(const SocketIOPacket& packet);
+    void sendPacket(SocketIOPacket&& packet);
 
     /**
      * Called upon engine `open`.
@@ -97,7 +117,7 @@ private:
      * @api private
      */
 
-    void onpacket(const Value& packet);
+    void onpacket(const SocketIOPacket& packet);
 
     /**
      * Called upon a server event.
@@ -141,6 +161,13 @@ private:
 
     void emitBuffered();
 
+    /**
+     * Emits `drain` if a producer was told to wait and may go on.
+     *
+     * @api private
+     */
+    void ondrain();
+
     /**
      * Called upon server disconnect.
      *
@@ -168,6 +195,10 @@ private:
     std::unordered_map<int, ValueFunction> _acks;
     std::vector<Value> _receiveBuffer;
     std::vector<SocketIOPacket> _sendBuffer;
+    size_t _sendBufferBytes;
+    size_t _highWaterMark;
+    size_t _lowWaterMark;
+    bool _needDrain;
     std::vector<OnObj> _subs;
     bool _connected;
     bool _disconnected;
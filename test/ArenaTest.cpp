@@ -0,0 +1,64 @@
+#include "IOArena.h"
+#include "IOJson.h"
+#include "IOTypes.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Arena::release with Values built in the arena still alive: a tree moved
+ * out and kept stays readable, the arena grows meanwhile and gives its
+ * memory back once the tree is gone.
+ */
+
+static const char JSON[] = "[\"event\",{\"id\":1,\"tags\":[\"a\",\"b\"],\"name\":\"a string too long to be stored inline\"}]";
+
+static void testRelease()
+{
+    Arena arena;
+    Value kept;
+    {
+        Value packet;
+        json::Parser parser;
+        assert(parser.parse(JSON, strlen(JSON), packet, &arena));
+        assert(arena.getBytesUsed() > 0);
+        assert(!arena.release());
+    }
+    assert(arena.release());
+    assert(arena.getBytesUsed() == 0);
+
+    // a plain move keeps the nodes in the arena
+    {
+        Value packet;
+        json::Parser parser;
+        assert(parser.parse(JSON, strlen(JSON), packet, &arena));
+        kept = std::move(packet);
+    }
+    assert(kept.getMemoryResource() == &arena);
+    size_t used = arena.getBytesUsed();
+    assert(!arena.release());
+    assert(arena.getBytesUsed() == used);
+
+    // the next packets come on top, the kept tree untouched
+    for (int i = 0; i < 100; ++i)
+    {
+        Value packet;
+        json::Parser parser;
+        assert(parser.parse(JSON, strlen(JSON), packet, &arena));
+        assert(!arena.release());
+    }
+    assert(arena.getBytesUsed() > used);
+    assert(kept.asArray()[1].asObject().at("name").asString() == "a string too long to be stored inline");
+    assert(kept.asArray()[1].asObject().at("tags").asArray()[1].asString() == "b");
+
+    kept = Value();
+    assert(arena.release());
+    assert(arena.getBytesUsed() == 0);
+}
+
+int main()
+{
+    testRelease();
+    return 0;
+}
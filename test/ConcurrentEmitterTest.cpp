@@ -0,0 +1,106 @@
+#include "ConcurrentEmitter.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Emits from several threads while another one keeps adding and removing
+ * listeners, so every table the readers load gets replaced and freed
+ * under them. Meant to be run under ThreadSanitizer as well:
+ *
+ *     make -C test tsan
+ */
+
+static const int THREADS = 4;
+static const int EMITS = 20000;
+static const int CHURNS = 2000;
+
+static void testStress()
+{
+    auto emitter = std::make_shared<ConcurrentEmitter>();
+    auto executor = std::make_shared<QueueExecutor>();
+    std::thread executorThread([&]() {
+        executor->run();
+    });
+
+    std::atomic<long> inline_(0);
+    std::atomic<long> once(0);
+    long posted = 0; // only touched on the executor thread
+
+    emitter->on(EventId::MESSAGE, [&](const Value& args) {
+        assert(args.asArray().size() == 2);
+        ++inline_;
+    }, 1);
+    emitter->on(EventId::MESSAGE, [&](const Value& args) {
+        assert(args.asArray().size() == 2);
+        ++posted;
+    }, 2, executor);
+    emitter->once(EventId::OPEN, [&](const Value&) {
+        ++once;
+    }, 3);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < EMITS; ++i) {
+                emitter->emit(EventId::MESSAGE, Value(i));
+                emitter->emit(EventId::OPEN);
+            }
+        });
+    }
+
+    std::thread churn([&]() {
+        for (int i = 0; i < CHURNS; ++i) {
+            emitter->on(EventId::DATA, [](const Value&) {}, 100 + i);
+            emitter->emit("data", Value(1));
+            emitter->off(EventId::DATA, 100 + i);
+        }
+    });
+
+    for (auto& thread : threads)
+        thread.join();
+    churn.join();
+
+    executor->post([&]() {
+        executor->stop();
+    });
+    executorThread.join();
+
+    printf("  inline %ld, posted %ld, once %ld\n", inline_.load(), posted, once.load());
+    assert(inline_ == THREADS * EMITS);
+    assert(posted == THREADS * EMITS);
+    assert(once == 1);
+}
+
+static void testOffCancelsPosted()
+{
+    ConcurrentEmitter emitter;
+    auto executor = std::make_shared<QueueExecutor>();
+    int calls = 0;
+
+    emitter.on(EventId::PING, [&](const Value&) {
+        ++calls;
+    }, 9, executor);
+    emitter.emit(EventId::PING);
+    emitter.off(EventId::PING, 9);
+    emitter.emit(EventId::PING);
+
+    assert(executor->poll() == 1);
+    assert(calls == 0);
+
+    emitter.on(EventId::PING, [](const Value&) {}, 10);
+    assert(emitter.hasListeners(EventId::PING));
+    emitter.offAll();
+    assert(!emitter.hasListeners(EventId::PING));
+}
+
+int main()
+{
+    testStress();
+    testOffCancelsPosted();
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "EngineIORequest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Stands in for EngineIORequest.cpp, which doesn't compile yet, so that
+ * the tests can link the transports. The polling transport is the only
+ * one making requests and no test opens it.
+ */
+
+EngineIORequest::EngineIORequest(const ValueObject&)
+{
+    fprintf(stderr, "EngineIORequest is not available in the tests\n");
+    abort();
+}
+
+EngineIORequest::~EngineIORequest()
+{
+}
@@ -0,0 +1,317 @@
+#include "EngineIOSocket.h"
+#include "FakeWebSocket.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+/**
+ * EngineIOSocket over a FakeWebSocket that holds every write until told
+ * to let it go, so packets queue up behind it:
+ *
+ *   - `writable` is emitted once the bytes queued went past the high
+ *     watermark and came back down to the low one, never when they only
+ *     dropped below the high one, and never because `writable()` was asked
+ *   - the queue is served CONTROL, ACK, EVENT then BULK, at most
+ *     BULK_CHUNK bytes of BULK per write
+ *   - a ping queued behind a `continued` group leaves first, but no other
+ *     message gets between the parts of the group
+ *   - with `coalesce`, packets sent in a row go out in one write once
+ *     `coalesceBytes` are held or at the end of the loop turn, and
+ *     nothing is written for a socket destroyed meanwhile
+ */
+
+typedef std::vector<std::string> Strings;
+
+/**
+ * Runs the loop until a few ms go by with nothing to do; the socket's
+ * own timers are much further out.
+ */
+
+static void pump()
+{
+    while (getEventLoop()->runOnce(5) > 0)
+    {
+    }
+}
+
+/**
+ * Runs the loop for `milliseconds`, for the socket's own timers.
+ */
+
+static void wait(long milliseconds)
+{
+    uint64_t end = getEventLoop()->now() + milliseconds;
+    while (getEventLoop()->now() < end)
+        getEventLoop()->runOnce(1);
+}
+
+static std::shared_ptr<EngineIOSocket> connect(Opts opts, long pingInterval = 25000)
+{
+    opts.transports.push_back("websocket");
+    auto socket = std::make_shared<EngineIOSocket>("", opts);
+    FakeWebSocket::last()->handshake(pingInterval);
+    return socket;
+}
+
+static ValueObject lane(EngineIOSocket::Priority priority, bool continued = false)
+{
+    ValueObject options;
+    options["priority"] = (int)priority;
+    if (continued)
+        options["continued"] = true;
+    return options;
+}
+
+/**
+ * A message of `size` bytes once encoded, all `fill`.
+ */
+
+static Value bulk(char fill, size_t size)
+{
+    return Value(std::string(size - 1, fill));
+}
+
+/**
+ * The messages of the transport's next write from `from` on, the long
+ * ones shortened to their first bytes and length.
+ */
+
+static Strings nextWrite(const FakeWebSocket& ws, size_t& from)
+{
+    Strings write;
+    while (from < ws.messages.size())
+    {
+        const FakeWebSocket::Message& message = ws.messages[from++];
+        if (message.data.size() > 16)
+            write.push_back(message.data.substr(0, 2) + ":" + std::to_string(message.data.size()));
+        else
+            write.push_back(message.data);
+        if (!message.more)
+            break;
+    }
+    return write;
+}
+
+/**
+ * Lets the transport's write go and runs the drain that follows.
+ */
+
+static void release(FakeWebSocket& ws)
+{
+    ws.release();
+    pump();
+}
+
+static void testBackpressure()
+{
+    Opts opts = Opts();
+    opts.highWaterMark = 1000;
+    opts.lowWaterMark = 300;
+    auto socket = connect(opts);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+
+    int writables = 0;
+    int drains = 0;
+    socket->on<>(EventId::WRITABLE, [&]() {
+        ++writables;
+    });
+    socket->on<>(EventId::DRAIN, [&]() {
+        ++drains;
+    });
+
+    // 200 bytes queued each, type byte included; the first is written
+    // right away and held, the others wait for it
+    const Value message(std::string(199, 'x'));
+    for (int i = 0; i < 4; ++i)
+        assert(socket->send(message));
+    assert(socket->getBufferedAmount() == 800);
+    assert(socket->writable());
+    assert(!socket->send(message));
+    assert(!socket->writable());
+    assert(ws.messages.size() == 1);
+
+    // below the high mark but not down to the low one yet
+    release(ws);
+    assert(ws.messages.size() == 5);
+    assert(socket->getBufferedAmount() == 800);
+    assert(socket->writable());
+    assert(writables == 0 && drains == 0);
+
+    release(ws);
+    assert(socket->getBufferedAmount() == 0);
+    assert(writables == 1 && drains == 1);
+
+    // staying below the high mark, asking doesn't make it tell
+    for (int i = 0; i < 4; ++i)
+        assert(socket->send(message));
+    assert(socket->writable());
+    release(ws);
+    release(ws);
+    assert(socket->getBufferedAmount() == 0);
+    assert(writables == 1 && drains == 2);
+
+    // asking while over it doesn't make it tell twice
+    for (int i = 0; i < 4; ++i)
+        assert(socket->send(message));
+    assert(!socket->send(message));
+    assert(!socket->writable() && !socket->writable());
+    release(ws);
+    assert(socket->getBufferedAmount() == 800 && writables == 1);
+    release(ws);
+    assert(writables == 2 && drains == 3);
+    release(ws);
+    assert(writables == 2 && drains == 3);
+}
+
+static void testLanes()
+{
+    auto socket = connect(Opts(), 20);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+    size_t from = 0;
+
+    socket->send(Value(std::string("first")));
+    assert(nextWrite(ws, from) == (Strings{ "4first" }));
+
+    socket->send(bulk('A', 30000), lane(EngineIOSocket::Priority::BULK));
+    socket->send(bulk('B', 30000), lane(EngineIOSocket::Priority::BULK));
+    socket->send(bulk('C', 30000), lane(EngineIOSocket::Priority::BULK));
+    socket->send(Value(std::string("event")));
+    socket->send(Value(std::string("ack")), lane(EngineIOSocket::Priority::ACK));
+    // the ping
+    wait(40);
+    assert(from == ws.messages.size());
+
+    // a third bulk message would take the write past BULK_CHUNK
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "2", "4ack", "4event", "4A:30000", "4B:30000" }));
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4C:30000" }));
+
+    // bigger than a chunk, it still goes
+    socket->send(bulk('D', 100000), lane(EngineIOSocket::Priority::BULK));
+    socket->send(bulk('E', 10), lane(EngineIOSocket::Priority::BULK));
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4D:100000" }));
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4EEEEEEEEE" }));
+    release(ws);
+    assert(from == ws.messages.size());
+}
+
+static void testContinuedGroup()
+{
+    auto socket = connect(Opts(), 20);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+    size_t from = 0;
+
+    socket->send(Value(std::string("first")));
+    assert(nextWrite(ws, from) == (Strings{ "4first" }));
+
+    // a binary packet in five parts, three chunks together
+    socket->send(bulk('P', 30000), lane(EngineIOSocket::Priority::BULK, true));
+    socket->send(bulk('Q', 30000), lane(EngineIOSocket::Priority::BULK, true));
+    socket->send(bulk('R', 30000), lane(EngineIOSocket::Priority::BULK, true));
+    socket->send(bulk('S', 30000), lane(EngineIOSocket::Priority::BULK, true));
+    socket->send(bulk('T', 30000), lane(EngineIOSocket::Priority::BULK));
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4P:30000", "4Q:30000" }));
+
+    // queued while the group is partly written
+    socket->send(Value(std::string("ack")), lane(EngineIOSocket::Priority::ACK));
+    socket->send(Value(std::string("event")));
+    wait(40);
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "2", "4R:30000", "4S:30000" }));
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4T:30000", "4ack", "4event" }));
+    release(ws);
+    assert(from == ws.messages.size());
+}
+
+static void testCoalesceBytes()
+{
+    Opts opts = Opts();
+    opts.coalesce = true;
+    opts.coalesceBytes = 100;
+    auto socket = connect(opts);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+    size_t from = 0;
+
+    socket->send(bulk('a', 30));
+    socket->send(bulk('b', 30));
+    socket->send(bulk('c', 30));
+    assert(ws.messages.empty());
+
+    // 120 bytes held, written without waiting for the loop
+    socket->send(bulk('d', 30));
+    assert(nextWrite(ws, from) == (Strings{ "4a:30", "4b:30", "4c:30", "4d:30" }));
+    assert(socket->getFlushStats().writes == 1);
+    assert(socket->getFlushStats().packets == 4);
+
+    // the end of the turn that was waited for finds nothing left
+    release(ws);
+    assert(from == ws.messages.size());
+    assert(socket->getFlushStats().writes == 1);
+}
+
+static void testCoalesceEndOfTurn()
+{
+    Opts opts = Opts();
+    opts.coalesce = true;
+    auto socket = connect(opts);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+    size_t from = 0;
+
+    socket->send(Value(std::string("a")));
+    socket->send(Value(std::string("b")));
+    socket->send(Value(std::string("c")));
+    assert(ws.messages.empty());
+
+    getEventLoop()->runOnce(0);
+    assert(nextWrite(ws, from) == (Strings{ "4a", "4b", "4c" }));
+    assert(socket->getFlushStats().writes == 1);
+
+    // held back by the write, then all at once
+    socket->send(Value(std::string("d")));
+    socket->send(Value(std::string("e")));
+    getEventLoop()->runOnce(0);
+    assert(from == ws.messages.size());
+    release(ws);
+    assert(nextWrite(ws, from) == (Strings{ "4d", "4e" }));
+    assert(socket->getFlushStats().writes == 2);
+}
+
+static void testCoalesceAfterDestroy()
+{
+    Opts opts = Opts();
+    opts.coalesce = true;
+    auto socket = connect(opts);
+    FakeWebSocket& ws = *FakeWebSocket::last();
+
+    // the flush waiting for the end of the turn
+    socket->send(Value(std::string("a")));
+    socket.reset();
+    pump();
+    assert(ws.messages.empty());
+
+    // the flush waiting for its timer
+    opts.coalesceDelay = 1000;
+    socket = connect(opts);
+    FakeWebSocket& delayed = *FakeWebSocket::last();
+    socket->send(Value(std::string("a")));
+    socket.reset();
+    wait(10);
+    assert(delayed.messages.empty());
+}
+
+int main()
+{
+    FakeWebSocket::install();
+    testBackpressure();
+    testLanes();
+    testContinuedGroup();
+    testCoalesceBytes();
+    testCoalesceEndOfTurn();
+    testCoalesceAfterDestroy();
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "IOEpollLoop.h"
+#include "IOEpollWebSocket.h"
+#include "WebSocketTestServer.h"
+
+#include <sys/resource.h>
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <functional>
+
+/**
+ * EpollWebSocket against WebSocketTestServer over loopback: echo of text,
+ * binary and a 1 MB message, fragmented messages with a ping in between,
+ * a burst of 4 MB arriving faster than one readable event takes in, both
+ * closing handshakes, invalid UTF-8 and 2000 connections on the same loop.
+ */
+
+static const int CONNECTIONS = 2000;
+
+struct Client
+{
+    std::shared_ptr<IWebSocket> ws;
+    bool opened = false;
+    std::vector<Value> messages;
+    std::string error;
+    std::string closed;
+
+    explicit Client(EpollWebSocketFactory& factory)
+    : ws(factory.create())
+    {
+        ws->onopen = [this]() {
+            opened = true;
+        };
+        ws->onmessage = [this](const Value& message) {
+            messages.push_back(message);
+        };
+        ws->onerror = [this](const std::string& reason) {
+            error = reason;
+        };
+        ws->onclose = [this](const std::string& reason) {
+            closed = reason.empty() ? "-" : reason;
+        };
+    }
+};
+
+static std::shared_ptr<EpollEventLoop> __loop;
+
+/**
+ * Runs the loop until `done` or about 10 seconds.
+ */
+
+static void pump(const std::function<bool()>& done)
+{
+    for (int i = 0; i < 2000 && !done(); ++i)
+        __loop->runOnce(5);
+    assert(done());
+}
+
+static void testEcho(EpollWebSocketFactory& factory, const std::string& uri, WebSocketTestServer& server)
+{
+    Client client(factory);
+    assert(client.ws->open(uri, {}, ""));
+    pump([&]() { return client.opened; });
+
+    const uint8_t bytes[3] = { 0, 1, 255 };
+    std::string big(1 << 20, 'x');
+    for (size_t i = 0; i < big.size(); ++i)
+        big[i] = 'a' + i % 26;
+
+    client.ws->send(std::string("hello"));
+    client.ws->send(Buffer(bytes, sizeof(bytes)));
+    client.ws->send(big);
+    client.ws->send(std::string("frag"));
+    pump([&]() { return client.messages.size() == 4; });
+
+    assert(client.messages[0].asString() == "hello");
+    assert(client.messages[1].getType() == Value::Type::BINARY);
+    assert(client.messages[1].asBuffer().length() == 3 && client.messages[1].asBuffer()[2] == 255);
+    assert(client.messages[2].asString() == big);
+
+    // the ping between the fragments is answered right away
+    assert(client.messages[3].asString() == "hello world");
+    pump([&]() { return server.pongs == 1; });
+
+    client.ws->send(std::string("close"));
+    pump([&]() { return !client.closed.empty(); });
+    assert(client.closed == "bye");
+    assert(client.error.empty());
+}
+
+static void testBurst(EpollWebSocketFactory& factory, const std::string& uri)
+{
+    Client client(factory);
+    assert(client.ws->open(uri, {}, ""));
+    pump([&]() { return client.opened; });
+
+    client.ws->send(std::string("burst"));
+    pump([&]() { return client.messages.size() == 64; });
+    for (int i = 0; i < 64; ++i)
+    {
+        const Buffer& message = client.messages[i].asBuffer();
+        assert(message.length() == 64 * 1024);
+        assert(message[0] == i && message[64 * 1024 - 1] == i);
+    }
+
+    client.ws->close();
+    pump([&]() { return !client.closed.empty(); });
+    assert(client.error.empty());
+}
+
+static void testClientClose(EpollWebSocketFactory& factory, const std::string& uri)
+{
+    Client client(factory);
+    assert(client.ws->open(uri, {}, ""));
+    pump([&]() { return client.opened; });
+
+    client.ws->close();
+    pump([&]() { return !client.closed.empty(); });
+    assert(client.error.empty());
+}
+
+static void testInvalidUtf8(EpollWebSocketFactory& factory, const std::string& uri)
+{
+    Client client(factory);
+    assert(client.ws->open(uri, {}, ""));
+    pump([&]() { return client.opened; });
+
+    client.ws->send(std::string("badutf8"));
+    pump([&]() { return !client.closed.empty(); });
+    assert(client.messages.empty());
+    assert(client.error == "invalid UTF-8 in text message");
+}
+
+static void testRefused(EpollWebSocketFactory& factory)
+{
+    Client client(factory);
+    assert(client.ws->open("ws://127.0.0.1:1/", {}, ""));
+    pump([&]() { return !client.error.empty(); });
+    assert(!client.opened);
+}
+
+static void testManyConnections(EpollWebSocketFactory& factory, const std::string& uri)
+{
+    // a client and a server socket per connection
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < 2 * CONNECTIONS + 64)
+    {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, 2 * CONNECTIONS + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < 2 * CONNECTIONS + 64)
+        {
+            printf("  skipped %d connections, only %lu descriptors\n", CONNECTIONS, (unsigned long)limit.rlim_cur);
+            return;
+        }
+    }
+
+    int echoes = 0;
+    int closes = 0;
+    std::vector<std::shared_ptr<IWebSocket>> sockets;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CONNECTIONS; ++i)
+    {
+        std::shared_ptr<IWebSocket> ws = factory.create();
+        IWebSocket* raw = ws.get();
+        ws->onopen = [raw]() {
+            raw->send(std::string("m"));
+        };
+        ws->onmessage = [&](const Value&) {
+            ++echoes;
+        };
+        ws->onclose = [&](const std::string&) {
+            ++closes;
+        };
+        assert(ws->open(uri, {}, ""));
+        sockets.push_back(ws);
+    }
+    pump([&]() { return echoes == CONNECTIONS; });
+    auto end = std::chrono::steady_clock::now();
+    printf("  %d connections opened and echoed in %.0f ms\n", CONNECTIONS,
+           std::chrono::duration<double, std::milli>(end - start).count());
+
+    for (auto& ws : sockets)
+        ws->close();
+    pump([&]() { return closes == CONNECTIONS; });
+}
+
+int main()
+{
+    // RFC 6455 1.3
+    assert(WebSocketTestServer::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+
+    WebSocketTestServer server;
+    __loop = std::make_shared<EpollEventLoop>();
+    EpollWebSocketFactory factory(__loop);
+    std::string uri = "ws://127.0.0.1:" + std::to_string(server.port) + "/engine.io/?EIO=3";
+
+    testEcho(factory, uri, server);
+    testBurst(factory, uri);
+    testClientClose(factory, uri);
+    testInvalidUtf8(factory, uri);
+    testRefused(factory);
+    testManyConnections(factory, uri);
+
+    __loop.reset();
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "IOEventLoop.h"
+#include "IOUtils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * IWebSocket that never touches the network, for driving the engine.io
+ * socket from a test. Messages given to it are recorded and held: they
+ * count in getBufferedAmount until `release`, which calls `ondrain` like
+ * a real socket would once they reached the network.
+ *
+ * Install it with `FakeWebSocket::install`, then `open` the transport and
+ * complete the handshake, after which the EngineIOSocket is OPENED.
+ */
+
+class FakeWebSocket : public IWebSocket
+{
+public:
+    struct Message
+    {
+        std::string data;
+        bool binary;
+        bool more;
+    };
+
+    FakeWebSocket()
+    : buffered(0)
+    , closed(false)
+    {}
+
+    virtual bool open(const std::string&, const std::vector<std::string>&, const std::string&) override
+    {
+        return true;
+    }
+
+    virtual void close() override
+    {
+        closed = true;
+    }
+
+    virtual void send(const Buffer& data, bool) override
+    {
+        hold(std::string((const char*)data.data(), data.length()), true, false);
+    }
+
+    virtual void send(const std::string& text, bool) override
+    {
+        hold(text, false, false);
+    }
+
+    virtual void sendv(const IOVec* slices, size_t count, bool binary, bool, bool more) override
+    {
+        std::string data;
+        for (size_t i = 0; i < count; ++i)
+            data.append((const char*)slices[i].data, slices[i].length);
+        hold(data, binary, more);
+    }
+
+    virtual size_t getBufferedAmount() const override
+    {
+        return buffered;
+    }
+
+    /**
+     * Lets everything held go, as if the network took it.
+     */
+
+    void release()
+    {
+        bool wasHolding = buffered > 0;
+        buffered = 0;
+        if (wasHolding && ondrain)
+            ondrain();
+    }
+
+    /**
+     * Opens the socket and answers the engine.io handshake, the first ping
+     * going out `pingInterval` ms later.
+     */
+
+    void handshake(long pingInterval = 25000)
+    {
+        onopen();
+        onmessage(Value("0{\"sid\":\"fake\",\"upgrades\":[],\"pingInterval\":" + std::to_string(pingInterval)
+                        + ",\"pingTimeout\":60000}"));
+    }
+
+    /**
+     * Makes EngineIOSocket open FakeWebSockets on a fresh event loop.
+     */
+
+    static void install()
+    {
+        setEventLoop(std::make_shared<EventLoop>());
+        setWebSocketFactory(std::make_shared<Factory>());
+    }
+
+    /**
+     * The socket created last.
+     */
+
+    static std::shared_ptr<FakeWebSocket>& last()
+    {
+        static std::shared_ptr<FakeWebSocket> ws;
+        return ws;
+    }
+
+    std::vector<Message> messages;
+    size_t buffered;
+    bool closed;
+
+private:
+    class Factory : public IWebSocketFactory
+    {
+    public:
+        virtual std::shared_ptr<IWebSocket> create() override
+        {
+            last() = std::make_shared<FakeWebSocket>();
+            return last();
+        }
+    };
+
+    void hold(const std::string& data, bool binary, bool more)
+    {
+        Message message = { data, binary, more };
+        messages.push_back(message);
+        buffered += data.size();
+    }
+};
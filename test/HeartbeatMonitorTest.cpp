@@ -0,0 +1,126 @@
+#include "IOEventLoop.h"
+#include "IOHeartbeatMonitor.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <functional>
+#include <memory>
+
+/**
+ * HeartbeatMonitor on a real EventLoop: a deadline moved earlier than the
+ * one being waited for fires on time, one moved later doesn't fire at the
+ * old one, and callbacks may unwatch, including connections due on the
+ * same tick and themselves, or watch new ones reusing their slot.
+ */
+
+static std::shared_ptr<EventLoop> __loop;
+
+/**
+ * Runs the loop until `done` or `limit` ms.
+ */
+
+static void pump(const std::function<bool()>& done, long limit)
+{
+    uint64_t end = __loop->now() + limit;
+    while (!done() && __loop->now() < end)
+        __loop->runOnce(1);
+}
+
+static void testTouchEarlier()
+{
+    HeartbeatMonitor monitor(__loop);
+    uint64_t firedAt = 0;
+    TimerHandle handle = monitor.watch([&]() {
+        firedAt = __loop->now();
+    });
+
+    monitor.touch(handle, 5000);
+    uint64_t start = __loop->now();
+    monitor.touch(handle, 20);
+    pump([&]() { return firedAt != 0; }, 2000);
+
+    assert(firedAt >= start + 20);
+    assert(firedAt < start + 1000);
+    assert(monitor.size() == 0);
+}
+
+static void testTouchLater()
+{
+    HeartbeatMonitor monitor(__loop);
+    uint64_t firedAt = 0;
+    TimerHandle handle = monitor.watch([&]() {
+        firedAt = __loop->now();
+    });
+
+    monitor.touch(handle, 20);
+    uint64_t start = __loop->now();
+    monitor.touch(handle, 100);
+
+    // the check at 20 finds the later deadline and waits for it
+    pump([&]() { return firedAt != 0; }, 60);
+    assert(firedAt == 0);
+    assert(monitor.size() == 1);
+    pump([&]() { return firedAt != 0; }, 2000);
+    assert(firedAt >= start + 100);
+
+    // stale, ignored
+    monitor.touch(handle, 10);
+    monitor.unwatch(handle);
+    assert(monitor.size() == 0);
+}
+
+static void testUnwatchFromCallback()
+{
+    HeartbeatMonitor monitor(__loop);
+    int firstCalls = 0;
+    int secondCalls = 0;
+    int replacementCalls = 0;
+    TimerHandle first = INVALID_TIMER_HANDLE;
+    TimerHandle second = INVALID_TIMER_HANDLE;
+    TimerHandle replacement = INVALID_TIMER_HANDLE;
+
+    first = monitor.watch([&]() {
+        ++firstCalls;
+
+        // takes the slot `first` just left
+        replacement = monitor.watch([&]() {
+            ++replacementCalls;
+        });
+        assert((replacement & 0xffffffff) == (first & 0xffffffff));
+        monitor.touch(replacement, 30);
+
+        // due at the same time, not called any more
+        monitor.unwatch(second);
+        // no longer watched already
+        monitor.unwatch(first);
+        assert(monitor.size() == 1);
+    });
+    second = monitor.watch([&]() {
+        ++secondCalls;
+    });
+
+    monitor.touch(first, 10);
+    monitor.touch(second, 10);
+    pump([&]() { return firstCalls != 0; }, 2000);
+    assert(firstCalls == 1 && secondCalls == 0);
+    assert(monitor.size() == 1);
+
+    // the stale handle of `first` leaves its replacement alone
+    monitor.unwatch(first);
+    monitor.touch(first, 0);
+    assert(monitor.size() == 1);
+    pump([&]() { return replacementCalls != 0; }, 2000);
+    assert(replacementCalls == 1);
+    assert(firstCalls == 1 && secondCalls == 0);
+    assert(monitor.size() == 0);
+}
+
+int main()
+{
+    __loop = std::make_shared<EventLoop>();
+    testTouchEarlier();
+    testTouchLater();
+    testUnwatchFromCallback();
+    __loop.reset();
+    return 0;
+}
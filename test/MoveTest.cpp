@@ -0,0 +1,161 @@
+#include "Emitter.h"
+#include "EngineIOParser.h"
+#include "IOTypes.h"
+#include "SocketIOParser.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <type_traits>
+
+/**
+ * Follows the stages of a send and checks that none of them copies the
+ * payload: arguments concatenated behind the event name, moved into a
+ * SocketIOPacket, boxed into Values and emitted, encoded by socket.io
+ * and then by engine.io for a gather write.
+ *
+ * The allocator counts the bytes it hands out. A payload of 1 MiB copied
+ * anywhere on the way shows up as that many bytes.
+ */
+
+static size_t __allocated = 0;
+
+void* operator new(size_t size)
+{
+    __allocated += size;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// the nothrow forms too, so every delete below frees what this new gave out
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    __allocated += size;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+static const size_t PAYLOAD = 1024 * 1024;
+
+// less than any copy of the payload, more than the bookkeeping
+static const size_t NO_COPY = PAYLOAD / 16;
+
+static_assert(std::is_nothrow_move_constructible<Value>::value, "");
+static_assert(std::is_nothrow_move_assignable<Value>::value, "");
+static_assert(std::is_nothrow_move_constructible<Buffer>::value, "");
+static_assert(std::is_nothrow_move_constructible<SocketIOPacket>::value, "");
+static_assert(std::is_nothrow_move_constructible<EngineIOPacket>::value, "");
+
+static Value makeArguments()
+{
+    ValueArray args;
+    args.push_back(Value(std::string(PAYLOAD, 'x')));
+    args.push_back(Value(Buffer(nullptr, PAYLOAD)));
+    return Value(std::move(args));
+}
+
+static void testMoves()
+{
+    Value args = makeArguments();
+
+    size_t before = __allocated;
+    SocketIOPacket packet;
+    packet.type = SocketIOPacket::Type::BINARY_EVENT;
+    packet.data = Value::concat(Value("upload"), std::move(args));
+    SocketIOPacket moved(std::move(packet));
+    Value boxed(std::move(moved));
+    Value assigned;
+    assigned = std::move(boxed);
+    assert(__allocated - before < NO_COPY);
+
+    const ValueArray& data = assigned.asSocketIOPacket().data.asArray();
+    assert(data.size() == 3);
+    assert(data[1].asString().length() == PAYLOAD);
+    assert(data[2].asBuffer().length() == PAYLOAD);
+
+    EngineIOPacket engine("message", Value(Buffer(nullptr, PAYLOAD)));
+    before = __allocated;
+    EngineIOPacket engineMoved(std::move(engine));
+    std::vector<EngineIOPacket> writeBuffer;
+    writeBuffer.reserve(1);
+    writeBuffer.push_back(std::move(engineMoved));
+    assert(__allocated - before < NO_COPY);
+}
+
+static void testEmit()
+{
+    Emitter emitter;
+    size_t received = 0;
+    emitter.on("upload", [&](const Value& args) {
+        received += args.asArray().size();
+    });
+
+    Value args = makeArguments();
+    size_t before = __allocated;
+    emitter.emit("upload", std::move(args));
+    assert(__allocated - before < NO_COPY);
+    assert(received == 3);
+
+    // a typed listener gets the moved arguments themselves
+    const Value* seen = nullptr;
+    emitter.on<Value>(EventId::find("upload"), [&](const Value& args) {
+        seen = &args;
+    });
+    args = makeArguments();
+    emitter.emit(EventId::find("upload"), std::move(args));
+    assert(seen == &args);
+    assert(received == 6);
+}
+
+static void testEncode()
+{
+    SocketIOPacket packet;
+    packet.type = SocketIOPacket::Type::BINARY_EVENT;
+    packet.nsp = "/";
+    ValueArray data;
+    data.push_back(Value("upload"));
+    data.push_back(Value(Buffer(nullptr, PAYLOAD)));
+    packet.data = Value(std::move(data));
+    const uint8_t* attachment = packet.data.asArray()[1].asBuffer().data();
+
+    size_t before = __allocated;
+    socketio::parser::Encoder encoder;
+    ValueArray encoded = encoder.encode(packet);
+    assert(encoded.size() == 2);
+    assert(encoded[1].asBuffer().data() == attachment);
+
+    EngineIOPacket engine("message", std::move(encoded[1]));
+    engineio::parser::PacketSlices slices;
+    assert(engineio::parser::encodePacket(engine, true, slices));
+    assert(slices.binary);
+    assert(slices.data.data == attachment);
+    assert(slices.data.length == PAYLOAD);
+    assert(__allocated - before < NO_COPY);
+}
+
+int main()
+{
+    testMoves();
+    testEmit();
+    testEncode();
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "IORingBuffer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <deque>
+#include <random>
+#include <string>
+
+/**
+ * RingBuffer against a std::deque doing the same pushes, pops, clears and
+ * linearizes at random, with the queue wrapping around the end of the
+ * ring and growing while it does. Also the slot reuse the write queue of
+ * EngineIOSocket counts on.
+ */
+
+static void check(const RingBuffer<std::string>& ring, const std::deque<std::string>& model)
+{
+    assert(ring.size() == model.size());
+    assert(ring.empty() == model.empty());
+    for (size_t i = 0; i < model.size(); ++i)
+        assert(ring[i] == model[i]);
+    if (!model.empty())
+        assert(ring.front() == model.front());
+}
+
+static void testWraparound()
+{
+    RingBuffer<std::string> ring;
+    std::deque<std::string> model;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        ring.push(std::to_string(i));
+        model.push_back(std::to_string(i));
+    }
+    assert(ring.capacity() == 8);
+    ring.pop(5);
+    model.erase(model.begin(), model.begin() + 5);
+
+    // 5 to 10 in slots 5, 6, 7, 0, 1, 2
+    for (int i = 6; i < 11; ++i)
+    {
+        ring.push(std::to_string(i));
+        model.push_back(std::to_string(i));
+    }
+    assert(ring.capacity() == 8);
+    check(ring, model);
+
+    std::string* items = ring.linearize();
+    for (size_t i = 0; i < model.size(); ++i)
+        assert(items[i] == model[i]);
+    check(ring, model);
+
+    // growing while wrapped keeps the order
+    ring.pop(3);
+    model.erase(model.begin(), model.begin() + 3);
+    for (int i = 11; i < 20; ++i)
+    {
+        ring.push(std::to_string(i));
+        model.push_back(std::to_string(i));
+    }
+    assert(ring.capacity() == 16);
+    check(ring, model);
+
+    // popping more than there is empties it
+    ring.pop(100);
+    assert(ring.empty());
+    assert(ring.linearize() == &ring[0]);
+}
+
+static void testSlotReuse()
+{
+    RingBuffer<std::string> ring;
+    ring.push(std::string(1000, 'x'));
+    ring.pop();
+
+    // the slot comes back as it was left, its capacity included
+    std::string& slot = ring.push();
+    assert(slot.size() == 1000);
+    size_t capacity = slot.capacity();
+    slot.assign("y");
+    assert(ring.front() == "y" && ring.front().capacity() == capacity);
+
+    // clear releases what the elements hold
+    ring.clear();
+    assert(ring.empty());
+    assert(ring.push().empty());
+}
+
+static void testRandom()
+{
+    RingBuffer<std::string> ring;
+    std::deque<std::string> model;
+    std::mt19937 random(2024);
+    int next = 0;
+
+    for (int step = 0; step < 200000; ++step)
+    {
+        unsigned op = random() % 100;
+        if (op < 50)
+        {
+            // bursts of pushes, so the ring grows now and then
+            unsigned count = 1 + random() % 8;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                std::string value = std::to_string(next++);
+                if (random() % 2)
+                    ring.push(value);
+                else
+                    ring.push() = value;
+                model.push_back(value);
+            }
+        }
+        else if (op < 90)
+        {
+            size_t count = random() % 10;
+            ring.pop(count);
+            model.erase(model.begin(), model.begin() + std::min(count, model.size()));
+        }
+        else if (op < 99)
+        {
+            std::string* items = ring.linearize();
+            for (size_t i = 0; i < model.size(); ++i)
+                assert(items[i] == model[i]);
+        }
+        else
+        {
+            ring.clear();
+            model.clear();
+        }
+
+        check(ring, model);
+        assert(ring.capacity() == 0 || (ring.capacity() & (ring.capacity() - 1)) == 0);
+        assert(ring.size() <= ring.capacity());
+    }
+    printf("  capacity %zu after %d pushes\n", ring.capacity(), next);
+}
+
+int main()
+{
+    testWraparound();
+    testSlotReuse();
+    testRandom();
+    return 0;
+}
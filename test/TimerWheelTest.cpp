@@ -0,0 +1,325 @@
+#include "IOTimerWheel.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+/**
+ * TimerWheel against a std::multimap of expiries. Random adds, cancels
+ * and advances, from single ticks to jumps across every level, with
+ * callbacks adding and cancelling timers, the ones due on the same tick
+ * included. Every timer must fire on its tick, in expiry order, exactly
+ * once unless cancelled; cancel must succeed exactly for pending timers,
+ * whatever became of the slot a stale handle points to; nextTimeout must
+ * never be later than the first timer.
+ */
+
+static void testCascade()
+{
+    TimerWheel wheel;
+    const uint64_t delays[] = { 1, 255, 256, 257, 511, 65535, 65536, 65537, 1 << 24, (1 << 24) + 1, 300000000 };
+    std::vector<uint64_t> firedAt;
+    for (uint64_t delay : delays)
+    {
+        wheel.add([&]() {
+            firedAt.push_back(wheel.now());
+        }, delay);
+    }
+
+    // the way the event loop drives it, waking up when nextTimeout says
+    size_t wakeups = 0;
+    int64_t timeout;
+    while ((timeout = wheel.nextTimeout()) >= 0)
+    {
+        wheel.advance(wheel.now() + timeout);
+        ++wakeups;
+    }
+    assert(firedAt.size() == sizeof(delays) / sizeof(delays[0]));
+    for (size_t i = 0; i < firedAt.size(); ++i)
+        assert(firedAt[i] == delays[i]);
+    printf("  %zu wakeups up to %llu ms\n", wakeups, (unsigned long long)wheel.now());
+
+    // capped to about 49 days
+    uint64_t start = wheel.now();
+    firedAt.clear();
+    wheel.add([&]() {
+        firedAt.push_back(wheel.now());
+    }, ~0ull);
+    assert(wheel.advance(start + 0xfffffffe) == 0);
+    assert(wheel.advance(start + 0xffffffff) == 1);
+    assert(firedAt.size() == 1);
+}
+
+static void testStaleHandle()
+{
+    TimerWheel wheel;
+    int fired = 0;
+
+    TimerHandle first = wheel.add([]() {
+        assert(false);
+    }, 10);
+    assert(wheel.cancel(first));
+    assert(!wheel.cancel(first));
+
+    // reuses the slot with a new generation
+    TimerHandle second = wheel.add([&]() {
+        ++fired;
+    }, 10);
+    assert((second & 0xffffffff) == (first & 0xffffffff));
+    assert(!wheel.cancel(first));
+    assert(!wheel.cancel(INVALID_TIMER_HANDLE));
+    assert(!wheel.cancel(12345));
+    assert(wheel.advance(10) == 1 && fired == 1);
+    assert(!wheel.cancel(second));
+    assert(wheel.size() == 0 && wheel.nextTimeout() == -1);
+}
+
+static void testNextTimeout()
+{
+    TimerWheel wheel(1000);
+    assert(wheel.nextTimeout() == -1);
+
+    wheel.add([]() {}, 10);
+    assert(wheel.nextTimeout() == 10);
+    wheel.advance(1005);
+    assert(wheel.nextTimeout() == 5);
+    wheel.advance(1010);
+    assert(wheel.nextTimeout() == -1);
+
+    // on a higher level, wakes up when level 0 wraps at 1024
+    wheel.add([]() {}, 5000);
+    assert(wheel.nextTimeout() == 1024 - 1010);
+
+    // past due
+    TimerWheel late;
+    late.add([]() {}, 0);
+    assert(late.nextTimeout() == 0);
+}
+
+/**
+ * The wheel and what it should hold.
+ */
+
+struct Model
+{
+    TimerWheel wheel;
+    std::mt19937 random;
+
+    // every handle given out, by timer id
+    std::vector<TimerHandle> handles;
+    std::map<TimerHandle, uint64_t> pending;
+    std::multimap<uint64_t, TimerHandle> byExpiry;
+
+    // first tick not processed yet, timers never expire before it
+    uint64_t base = 0;
+    // advance running: `base` before it, expiry of the last timer fired
+    uint64_t before = 0;
+    uint64_t firing = 0;
+    bool advancing = false;
+    size_t fired = 0;
+    size_t cancelled = 0;
+
+    Model()
+    : random(2016)
+    {}
+
+    uint64_t randomDelay()
+    {
+        // spread over the four levels
+        static const uint32_t ranges[] = { 1 << 8, 1 << 16, 1 << 24, 1 << 26 };
+        uint32_t range = ranges[random() % 4];
+        return random() % range;
+    }
+
+    void add(uint64_t delay)
+    {
+        size_t id = handles.size();
+        TimerHandle handle = wheel.add([this, id]() {
+            onFire(id);
+        }, delay);
+        handles.push_back(handle);
+
+        uint64_t expires = std::max(wheel.now() + delay, base);
+        assert(pending.count(handle) == 0);
+        pending[handle] = expires;
+        byExpiry.insert(std::make_pair(expires, handle));
+    }
+
+    void forget(TimerHandle handle)
+    {
+        auto it = pending.find(handle);
+        auto range = byExpiry.equal_range(it->second);
+        for (auto i = range.first; i != range.second; ++i)
+        {
+            if (i->second == handle)
+            {
+                byExpiry.erase(i);
+                break;
+            }
+        }
+        pending.erase(it);
+    }
+
+    /**
+     * Cancels any handle ever given out, pending or not, a recent one
+     * half of the time.
+     */
+
+    void cancelAny()
+    {
+        if (handles.empty())
+            return;
+        size_t range = random() % 2 ? handles.size() : std::min<size_t>(handles.size(), 64);
+        TimerHandle handle = handles[handles.size() - 1 - random() % range];
+        bool isPending = pending.count(handle) > 0;
+        assert(wheel.cancel(handle) == isPending);
+        if (isPending)
+        {
+            forget(handle);
+            ++cancelled;
+        }
+    }
+
+    /**
+     * Cancels one of the timers due on the tick firing, parked but not
+     * run yet, if there is one.
+     */
+
+    void cancelSameTick()
+    {
+        auto range = byExpiry.equal_range(firing);
+        if (range.first == range.second)
+            return;
+        TimerHandle handle = range.first->second;
+        assert(wheel.cancel(handle));
+        forget(handle);
+        ++cancelled;
+    }
+
+    void onFire(size_t id)
+    {
+        assert(advancing);
+        TimerHandle handle = handles[id];
+        auto it = pending.find(handle);
+        // neither fired nor cancelled before
+        assert(it != pending.end());
+        uint64_t expires = it->second;
+        // on its tick, in order
+        assert(expires >= before && expires <= wheel.now());
+        assert(expires >= firing);
+        firing = expires;
+        forget(handle);
+        ++fired;
+
+        // added from here, at the earliest on the tick after
+        base = firing + 1;
+
+        switch (random() % 8)
+        {
+        case 0:
+            add(random() % 4);
+            break;
+        case 1:
+            add(randomDelay());
+            break;
+        case 2:
+            cancelAny();
+            break;
+        case 3:
+            cancelSameTick();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void advance(uint64_t now)
+    {
+        size_t firedBefore = fired;
+        uint64_t nowBefore = wheel.now();
+        before = base;
+        firing = 0;
+        advancing = true;
+        size_t count = wheel.advance(now);
+        advancing = false;
+        base = wheel.now() + 1;
+
+        assert(count == fired - firedBefore);
+        assert(wheel.now() == std::max(now, nowBefore));
+        // nothing left behind
+        assert(byExpiry.empty() || byExpiry.begin()->first > wheel.now());
+    }
+
+    void check()
+    {
+        assert(wheel.size() == pending.size());
+        int64_t timeout = wheel.nextTimeout();
+        if (pending.empty())
+        {
+            assert(timeout == -1);
+            return;
+        }
+        assert(timeout >= 0);
+        uint64_t first = byExpiry.begin()->first;
+        assert((uint64_t)timeout <= (first > wheel.now() ? first - wheel.now() : 0));
+    }
+};
+
+static void testRandom()
+{
+    Model model;
+
+    for (int step = 0; step < 50000; ++step)
+    {
+        uint32_t op = model.random() % 100;
+        if (op < 40)
+        {
+            model.add(model.randomDelay());
+        }
+        else if (op < 55)
+        {
+            model.cancelAny();
+        }
+        else if (op < 80)
+        {
+            model.advance(model.wheel.now() + 1 + model.random() % 300);
+        }
+        else if (op < 92)
+        {
+            // as the event loop would
+            int64_t timeout = model.wheel.nextTimeout();
+            if (timeout >= 0)
+                model.advance(model.wheel.now() + timeout);
+        }
+        else if (op < 98)
+        {
+            model.advance(model.wheel.now() + model.random() % (1 << 20));
+        }
+        else
+        {
+            model.advance(model.wheel.now() + model.random() % (1 << 26));
+        }
+        model.check();
+    }
+
+    // everything still pending fires
+    while (!model.pending.empty())
+    {
+        model.advance(model.byExpiry.rbegin()->first);
+        model.check();
+    }
+    assert(model.wheel.nextTimeout() == -1);
+    printf("  %zu fired, %zu cancelled\n", model.fired, model.cancelled);
+}
+
+int main()
+{
+    testCascade();
+    testStaleHandle();
+    testNextTimeout();
+    testRandom();
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "IOJson.h"
+#include "IOTypes.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+/**
+ * Values read lazily from JSON: nested arrays and objects left as text by
+ * json::Parser::parseShallow must behave like parsed ones wherever they
+ * go, including the rvalue paths that steal their storage.
+ */
+
+static Value parseShallow(const char* text)
+{
+    Value value;
+    json::Parser parser;
+    bool ok = parser.parseShallow(Buffer(text), value);
+    assert(ok);
+    return value;
+}
+
+static void testConcatLazyArray()
+{
+    Value event = parseShallow("[\"ev\",[1,2,3],{\"a\":1}]");
+    Value copy = event.asArray()[1];
+    assert(copy.isLazy());
+
+    ValueArray args = Value::concat(Value("name"), std::move(copy));
+    assert(args.size() == 4);
+    assert(args[0].asString() == "name");
+    assert(args[1].asInt() == 1 && args[2].asInt() == 2 && args[3].asInt() == 3);
+
+    // the same through the const overload
+    Value again = event.asArray()[1];
+    args = Value::concat(Value("name"), again);
+    assert(args.size() == 4 && args[3].asInt() == 3);
+}
+
+static void testConcatLazyObject()
+{
+    Value event = parseShallow("[\"ev\",{\"a\":1}]");
+    Value copy = event.asArray()[1];
+    assert(copy.isLazy());
+
+    // objects are appended as one argument
+    ValueArray args = Value::concat(Value("name"), std::move(copy));
+    assert(args.size() == 2);
+    assert(args[1].getType() == Value::Type::OBJECT);
+    assert(args[1].asObject().at("a").asInt() == 1);
+}
+
+int main()
+{
+    testConcatLazyArray();
+    testConcatLazyObject();
+    return 0;
+}
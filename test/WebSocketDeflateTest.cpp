@@ -0,0 +1,411 @@
+#include "IOWebSocketDeflate.h"
+
+#include <zlib.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/**
+ * PerMessageDeflate against the server side written straight on zlib:
+ * negotiation, round trips with and without context takeover both ways,
+ * a reduced client window, empty messages, server payloads with the
+ * 00 00 ff ff tail inside them or ending in a final block, and a
+ * decompression bomb stopped at `maxSize`.
+ */
+
+using websocket::PerMessageDeflate;
+
+/**
+ * The server end of a connection, RFC 7692 on plain zlib.
+ */
+
+class Peer
+{
+public:
+    explicit Peer(const PerMessageDeflate::Params& params)
+    : _params(params)
+    {
+        memset(&_deflate, 0, sizeof(_deflate));
+        memset(&_inflate, 0, sizeof(_inflate));
+        deflateInit2(&_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -params.serverMaxWindowBits, 8, Z_DEFAULT_STRATEGY);
+        inflateInit2(&_inflate, -params.clientMaxWindowBits);
+    }
+
+    ~Peer()
+    {
+        deflateEnd(&_deflate);
+        inflateEnd(&_inflate);
+    }
+
+    /**
+     * A message as sent to the client, each of `parts` flushed with
+     * `flush` and the last one with `last`, without the tail of a sync
+     * flush at the end.
+     */
+
+    std::string compress(const std::vector<std::string>& parts, int flush = Z_SYNC_FLUSH, int last = Z_SYNC_FLUSH)
+    {
+        std::string out;
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            int mode = i + 1 == parts.size() ? last : flush;
+            _deflate.next_in = (Bytef*)parts[i].data();
+            _deflate.avail_in = (uInt)parts[i].size();
+            int r;
+            do
+            {
+                uint8_t buffer[4096];
+                _deflate.next_out = buffer;
+                _deflate.avail_out = sizeof(buffer);
+                r = deflate(&_deflate, mode);
+                assert(r == Z_OK || r == Z_BUF_ERROR || r == Z_STREAM_END);
+                out.append((const char*)buffer, sizeof(buffer) - _deflate.avail_out);
+            } while (_deflate.avail_out == 0 || (mode == Z_FINISH && r != Z_STREAM_END));
+        }
+
+        if (last == Z_FINISH)
+            deflateReset(&_deflate);
+        else if (out.size() >= 4 && out.compare(out.size() - 4, 4, std::string("\0\0\xff\xff", 4)) == 0)
+            out.resize(out.size() - 4);
+        if (_params.serverNoContextTakeover)
+            deflateReset(&_deflate);
+        return out;
+    }
+
+    std::string compress(const std::string& message)
+    {
+        return compress(std::vector<std::string>{ message });
+    }
+
+    /**
+     * A message from the client, false if zlib won't have it.
+     */
+
+    bool decompress(const std::vector<uint8_t>& payload, std::string& message)
+    {
+        std::string in((const char*)payload.data(), payload.size());
+        in.append("\0\0\xff\xff", 4);
+        _inflate.next_in = (Bytef*)in.data();
+        _inflate.avail_in = (uInt)in.size();
+
+        message.clear();
+        do
+        {
+            uint8_t buffer[4096];
+            _inflate.next_out = buffer;
+            _inflate.avail_out = sizeof(buffer);
+            int r = inflate(&_inflate, Z_SYNC_FLUSH);
+            if (r != Z_OK && r != Z_BUF_ERROR)
+                return false;
+            message.append((const char*)buffer, sizeof(buffer) - _inflate.avail_out);
+        } while (_inflate.avail_in > 0 || _inflate.avail_out == 0);
+
+        if (_params.clientNoContextTakeover)
+            inflateReset(&_inflate);
+        return true;
+    }
+
+private:
+    PerMessageDeflate::Params _params;
+    z_stream _deflate;
+    z_stream _inflate;
+};
+
+static std::string text(const std::vector<uint8_t>& bytes)
+{
+    return std::string((const char*)bytes.data(), bytes.size());
+}
+
+static std::vector<uint8_t> bytes(const std::string& s)
+{
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+/**
+ * What a socket.io connection sends, similar from one message to the next.
+ */
+
+static std::string message(int i)
+{
+    return "42[\"update\",{\"id\":" + std::to_string(i) + ",\"name\":\"player\",\"x\":" + std::to_string(i * 7 % 640)
+        + ",\"y\":" + std::to_string(i * 13 % 480) + ",\"state\":\"running\",\"items\":[\"sword\",\"shield\"]}]";
+}
+
+static void testNegotiate()
+{
+    PerMessageDeflate::Params params;
+    assert(PerMessageDeflate::negotiate("permessage-deflate", params));
+    assert(!params.serverNoContextTakeover && !params.clientNoContextTakeover);
+    assert(params.serverMaxWindowBits == 15 && params.clientMaxWindowBits == 15);
+
+    assert(PerMessageDeflate::negotiate("Permessage-Deflate ; server_no_context_takeover;client_no_context_takeover;"
+                                        " server_max_window_bits=10; client_max_window_bits=\"12\"", params));
+    assert(params.serverNoContextTakeover && params.clientNoContextTakeover);
+    assert(params.serverMaxWindowBits == 10 && params.clientMaxWindowBits == 12);
+
+    const char* refused[] = {
+        "",
+        "x-webkit-deflate-frame",
+        "permessage-deflate, permessage-deflate",
+        "permessage-deflate; server_no_context_takeover; server_no_context_takeover",
+        "permessage-deflate; server_no_context_takeover=1",
+        "permessage-deflate; server_max_window_bits=7",
+        "permessage-deflate; server_max_window_bits=16",
+        "permessage-deflate; server_max_window_bits",
+        "permessage-deflate; client_max_window_bits=8",
+        "permessage-deflate; client_max_window_bits=0x9",
+        "permessage-deflate; unknown",
+    };
+    for (const char* header : refused)
+        assert(!PerMessageDeflate::negotiate(header, params));
+}
+
+/**
+ * Messages both ways over the same connection.
+ */
+
+static void roundTrips(const PerMessageDeflate::Params& params, size_t& firstSize, size_t& laterSize)
+{
+    PerMessageDeflate client(params);
+    Peer server(params);
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> out;
+    std::string received;
+
+    for (int i = 0; i < 50; ++i)
+    {
+        std::string m = message(i);
+        assert(client.compress((const uint8_t*)m.data(), m.size(), payload));
+        assert(server.decompress(payload, received));
+        assert(received == m);
+        if (i == 0)
+            firstSize = payload.size();
+        laterSize = payload.size();
+
+        std::vector<uint8_t> reply = bytes(server.compress(m));
+        assert(client.decompress(reply.data(), reply.size(), 1 << 20, out));
+        assert(text(out) == m);
+    }
+}
+
+static void testContextTakeover()
+{
+    size_t firstSize, laterSize;
+    roundTrips(PerMessageDeflate::Params(), firstSize, laterSize);
+    // the previous messages make a dictionary
+    assert(laterSize < firstSize / 2);
+    printf("  %zu bytes for the first message, %zu later\n", firstSize, laterSize);
+}
+
+static void testNoContextTakeover()
+{
+    PerMessageDeflate::Params params;
+    params.clientNoContextTakeover = true;
+    params.serverNoContextTakeover = true;
+    size_t firstSize, laterSize;
+    roundTrips(params, firstSize, laterSize);
+    assert(laterSize > firstSize / 2);
+
+    // only one way
+    params.serverNoContextTakeover = false;
+    roundTrips(params, firstSize, laterSize);
+    params.clientNoContextTakeover = false;
+    params.serverNoContextTakeover = true;
+    roundTrips(params, firstSize, laterSize);
+}
+
+static void testWindowBits()
+{
+    PerMessageDeflate::Params params;
+    params.clientMaxWindowBits = 9;
+    params.serverMaxWindowBits = 9;
+    PerMessageDeflate client(params);
+    Peer server(params);
+
+    // only repeats 600 bytes back, which a 512 byte window can't reach
+    std::string block(600, 'a');
+    uint32_t seed = 1;
+    for (auto& c : block)
+        c = (char)('a' + ((seed = seed * 1103515245 + 12345) >> 16) % 26);
+    std::vector<uint8_t> payload;
+    std::string received;
+    for (int i = 0; i < 4; ++i)
+    {
+        assert(client.compress((const uint8_t*)block.data(), block.size(), payload));
+        assert(server.decompress(payload, received));
+        assert(received == block);
+    }
+}
+
+static void testEmpty()
+{
+    PerMessageDeflate::Params params;
+    PerMessageDeflate client(params);
+    Peer server(params);
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> out;
+    std::string received;
+
+    // first thing on the stream, then right after another message
+    std::string m = message(1);
+    for (int i = 0; i < 2; ++i)
+    {
+        assert(client.compress((const uint8_t*)nullptr, 0, payload));
+        assert(!payload.empty());
+        assert(server.decompress(payload, received));
+        assert(received.empty());
+
+        assert(client.compress((const uint8_t*)m.data(), m.size(), payload));
+        assert(server.decompress(payload, received) && received == m);
+    }
+
+    // no slices at all, or only empty ones
+    assert(client.compress((const IOVec*)nullptr, 0, payload));
+    assert(server.decompress(payload, received) && received.empty());
+    IOVec none[2] = { { (const uint8_t*)"", 0 }, { (const uint8_t*)"", 0 } };
+    assert(client.compress(none, 2, payload));
+    assert(server.decompress(payload, received) && received.empty());
+
+    // from the server, compressed or as an empty payload
+    std::vector<uint8_t> reply = bytes(server.compress(std::string()));
+    assert(client.decompress(reply.data(), reply.size(), 100, out) && out.empty());
+    assert(client.decompress(nullptr, 0, 100, out) && out.empty());
+
+    // still in step
+    reply = bytes(server.compress(m));
+    assert(client.decompress(reply.data(), reply.size(), 1 << 20, out) && text(out) == m);
+}
+
+static void testSlices()
+{
+    PerMessageDeflate::Params params;
+    PerMessageDeflate client(params);
+    Peer server(params);
+    std::vector<uint8_t> payload;
+    std::string received;
+
+    std::string m = message(3) + message(4);
+    IOVec slices[3] = { { (const uint8_t*)m.data(), 1 }, { (const uint8_t*)m.data() + 1, 0 },
+                        { (const uint8_t*)m.data() + 1, m.size() - 1 } };
+    assert(client.compress(slices, 3, payload));
+    assert(server.decompress(payload, received) && received == m);
+
+    // bigger than the first guess at the output
+    std::string noise(300000, 0);
+    uint32_t seed = 1;
+    for (auto& c : noise)
+        c = (char)((seed = seed * 1103515245 + 12345) >> 16);
+    assert(client.compress((const uint8_t*)noise.data(), noise.size(), payload));
+    assert(server.decompress(payload, received) && received == noise);
+}
+
+static void testServerFlushes()
+{
+    PerMessageDeflate::Params params;
+    PerMessageDeflate client(params);
+    Peer server(params);
+    std::vector<uint8_t> out;
+    std::string m = message(5);
+    std::string big(200000, 'z');
+
+    // the server flushed after every fragment, 00 00 ff ff inside the
+    // payload too
+    std::vector<std::string> parts = { m.substr(0, 10), m.substr(10, 30), m.substr(40) };
+    std::string payload = server.compress(parts);
+    assert(payload.find(std::string("\0\0\xff\xff", 4)) != std::string::npos);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+
+    // ... with a full flush
+    payload = server.compress(parts, Z_FULL_FLUSH);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+
+    // ending in a final block, the next message starts a new stream
+    payload = server.compress(std::vector<std::string>{ m }, Z_SYNC_FLUSH, Z_FINISH);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+    payload = server.compress(parts, Z_NO_FLUSH, Z_FINISH);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+
+    // larger than the output first reserved, across a final block
+    payload = server.compress(std::vector<std::string>{ big, m }, Z_SYNC_FLUSH, Z_FINISH);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == big + m);
+
+    payload = server.compress(m);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+}
+
+static void testBomb()
+{
+    PerMessageDeflate::Params params;
+    params.serverNoContextTakeover = true;
+    PerMessageDeflate client(params);
+    Peer server(params);
+    std::vector<uint8_t> out;
+
+    // 64 MB of zeros in about 64 KB
+    std::vector<std::string> zeros(64, std::string(1 << 20, '\0'));
+    std::string payload = server.compress(zeros, Z_NO_FLUSH);
+    printf("  %zu bytes inflating to %d MB\n", payload.size(), (int)zeros.size());
+    assert(!client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(out.size() > 1 << 20);
+    assert(out.size() <= 2 << 20);
+
+    // right at the limit and one past it
+    std::string exact(1000, 'q');
+    payload = server.compress(exact);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1000, out));
+    assert(out.size() == 1000);
+    assert(!client.decompress((const uint8_t*)payload.data(), payload.size(), 999, out));
+
+    // the connection would fail here, but the stream is usable again
+    std::string m = message(6);
+    payload = server.compress(m);
+    assert(client.decompress((const uint8_t*)payload.data(), payload.size(), 1 << 20, out));
+    assert(text(out) == m);
+
+    // not deflate at all
+    const uint8_t corrupt[] = { 0xff, 0xff, 0xff, 0xff, 0x00 };
+    assert(!client.decompress(corrupt, sizeof(corrupt), 1 << 20, out));
+}
+
+static void testPool()
+{
+    // streams come and go through the pool, or straight from malloc
+    PerMessageDeflate::Params params;
+    std::string m = message(7);
+    std::vector<uint8_t> payload;
+    for (size_t limit : { (size_t)0, (size_t)8 << 20 })
+    {
+        PerMessageDeflate::setPoolLimit(limit);
+        for (int i = 0; i < 20; ++i)
+        {
+            PerMessageDeflate client(params);
+            Peer server(params);
+            std::string received;
+            assert(client.compress((const uint8_t*)m.data(), m.size(), payload));
+            assert(server.decompress(payload, received) && received == m);
+        }
+    }
+}
+
+int main()
+{
+    testNegotiate();
+    testContextTakeover();
+    testNoContextTakeover();
+    testWindowBits();
+    testEmpty();
+    testSlices();
+    testServerFlushes();
+    testBomb();
+    testPool();
+    return 0;
+}
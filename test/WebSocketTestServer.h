@@ -0,0 +1,371 @@
+#pragma once
+
+#include "IOBase64.h"
+#include "IOWebSocketFrame.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * RFC 6455 server on 127.0.0.1 for the WebSocket client tests, running
+ * its own epoll loop on a thread of its own.
+ *
+ * Messages are echoed back, except for a few commands asking the server
+ * to misbehave or do the unusual:
+ *
+ *   - "frag": "hello world" in three fragments with a ping in between
+ *   - "close": a close frame with code 4000 and reason "bye"
+ *   - "badutf8": a text message that is not UTF-8
+ *   - "burst": 64 binary messages of 64 KB, numbered by their first byte,
+ *     written at once
+ *
+ * It is written separately from the client on purpose, down to its own
+ * SHA-1, so that both can't share the same mistake.
+ */
+
+class WebSocketTestServer
+{
+public:
+    WebSocketTestServer()
+    : pings(0)
+    , pongs(0)
+    , _stop(false)
+    {
+        _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int one = 1;
+        setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(_listenFd, 4096) != 0
+            || getsockname(_listenFd, (sockaddr*)&addr, &len) != 0)
+        {
+            perror("test server");
+            abort();
+        }
+        port = ntohs(addr.sin_port);
+
+        _epoll = epoll_create1(0);
+        watch(_listenFd, EPOLL_CTL_ADD, EPOLLIN);
+        _thread = std::thread([this]() {
+            run();
+        });
+    }
+
+    ~WebSocketTestServer()
+    {
+        _stop = true;
+        _thread.join();
+        for (auto& conn : _conns)
+            close(conn.first);
+        close(_listenFd);
+        close(_epoll);
+    }
+
+    /**
+     * Sec-WebSocket-Accept for `key`.
+     */
+
+    static std::string acceptKey(const std::string& key)
+    {
+        std::string s = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        uint8_t digest[20];
+        sha1((const uint8_t*)s.data(), s.length(), digest);
+
+        std::string accept;
+        base64::encode(digest, sizeof(digest), accept);
+        return accept;
+    }
+
+    uint16_t port;
+
+    // control frames received from clients
+    std::atomic<long> pings;
+    std::atomic<long> pongs;
+
+private:
+    struct Conn
+    {
+        std::string in;
+        std::string out;
+        bool open = false;
+
+        // message being received
+        std::string message;
+        int opcode = 0;
+    };
+
+    static uint32_t rotate(uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    static void sha1(const uint8_t* data, size_t len, uint8_t digest[20])
+    {
+        uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+        std::string padded((const char*)data, len);
+        padded += '\x80';
+        padded.append((119 - len % 64) % 64, '\0');
+        for (int shift = 56; shift >= 0; shift -= 8)
+            padded += (char)((uint64_t)len * 8 >> shift);
+
+        for (size_t block = 0; block < padded.size(); block += 64)
+        {
+            const uint8_t* p = (const uint8_t*)padded.data() + block;
+            uint32_t w[80];
+            for (int i = 0; i < 80; ++i)
+            {
+                w[i] = i < 16 ? (uint32_t)p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 | p[i * 4 + 3]
+                              : rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+
+            static const uint32_t k[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; ++i)
+            {
+                uint32_t f;
+                if (i < 20)
+                    f = (b & c) | (~b & d);
+                else if (i >= 40 && i < 60)
+                    f = (b & c) | (b & d) | (c & d);
+                else
+                    f = b ^ c ^ d;
+
+                uint32_t t = rotate(a, 5) + f + e + k[i / 20] + w[i];
+                e = d;
+                d = c;
+                c = rotate(b, 30);
+                b = a;
+                a = t;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+
+        for (int i = 0; i < 20; ++i)
+            digest[i] = (uint8_t)(h[i / 4] >> (24 - i % 4 * 8));
+    }
+
+    void watch(int fd, int op, uint32_t events)
+    {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(_epoll, op, fd, &ev);
+    }
+
+    static void frame(Conn& conn, websocket::Opcode opcode, const std::string& payload, bool fin = true)
+    {
+        uint8_t header[websocket::MAX_HEADER_SIZE];
+        size_t n = websocket::writeHeader(header, opcode, fin, payload.size(), nullptr);
+        conn.out.append((const char*)header, n);
+        conn.out += payload;
+    }
+
+    void flush(int fd, Conn& conn)
+    {
+        while (!conn.out.empty())
+        {
+            ssize_t n = send(fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            conn.out.erase(0, n);
+        }
+        watch(fd, EPOLL_CTL_MOD, EPOLLIN | (conn.out.empty() ? 0u : (uint32_t)EPOLLOUT));
+    }
+
+    void drop(int fd)
+    {
+        epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        _conns.erase(fd);
+    }
+
+    void onMessage(Conn& conn, int opcode, const std::string& message)
+    {
+        if (opcode == websocket::TEXT && message == "frag")
+        {
+            frame(conn, websocket::TEXT, "hel", false);
+            frame(conn, websocket::PING, "pp");
+            frame(conn, websocket::CONTINUATION, "lo ", false);
+            frame(conn, websocket::CONTINUATION, "world");
+        }
+        else if (opcode == websocket::TEXT && message == "close")
+        {
+            frame(conn, websocket::CLOSE, std::string("\x0f\xa0", 2) + "bye");
+        }
+        else if (opcode == websocket::TEXT && message == "badutf8")
+        {
+            frame(conn, websocket::TEXT, "\xc3\x28");
+        }
+        else if (opcode == websocket::TEXT && message == "burst")
+        {
+            for (int i = 0; i < 64; ++i)
+                frame(conn, websocket::BINARY, std::string(64 * 1024, (char)i));
+        }
+        else
+        {
+            frame(conn, (websocket::Opcode)opcode, message);
+        }
+    }
+
+    /**
+     * Answers the opening handshake once it is all in.
+     *
+     * @return false if the request has no key
+     */
+
+    bool onHandshake(Conn& conn)
+    {
+        size_t end = conn.in.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return true;
+
+        std::string request = conn.in.substr(0, end);
+        conn.in.erase(0, end + 4);
+
+        static const char header[] = "Sec-WebSocket-Key: ";
+        size_t start = request.find(header);
+        if (start == std::string::npos)
+            return false;
+        start += sizeof(header) - 1;
+        std::string key = request.substr(start, request.find("\r\n", start) - start);
+
+        conn.out += "HTTP/1.1 101 Switching Protocols\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n\r\n";
+        conn.open = true;
+        return true;
+    }
+
+    void process(int fd, Conn& conn)
+    {
+        if (!conn.open && !onHandshake(conn))
+        {
+            drop(fd);
+            return;
+        }
+
+        while (conn.open)
+        {
+            websocket::FrameHeader header;
+            size_t n = websocket::readHeader((const uint8_t*)conn.in.data(), conn.in.size(), header);
+            if (n == 0 || conn.in.size() - n < header.length)
+                break;
+
+            // clients must mask everything they send
+            if (!header.masked)
+            {
+                drop(fd);
+                return;
+            }
+
+            std::string payload = conn.in.substr(n, header.length);
+            conn.in.erase(0, n + header.length);
+            websocket::mask((uint8_t*)&payload[0], payload.size(), header.maskKey);
+
+            if (header.opcode == websocket::CLOSE)
+            {
+                frame(conn, websocket::CLOSE, payload);
+                flush(fd, conn);
+                drop(fd);
+                return;
+            }
+            if (header.opcode == websocket::PING)
+            {
+                ++pings;
+                frame(conn, websocket::PONG, payload);
+                continue;
+            }
+            if (header.opcode == websocket::PONG)
+            {
+                ++pongs;
+                continue;
+            }
+
+            if (header.opcode != websocket::CONTINUATION)
+            {
+                conn.opcode = header.opcode;
+                conn.message.clear();
+            }
+            conn.message += payload;
+            if (header.fin)
+                onMessage(conn, conn.opcode, conn.message);
+        }
+
+        flush(fd, conn);
+    }
+
+    void run()
+    {
+        epoll_event events[256];
+        while (!_stop)
+        {
+            int count = epoll_wait(_epoll, events, 256, 10);
+            for (int i = 0; i < count; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == _listenFd)
+                {
+                    int client;
+                    while ((client = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+                    {
+                        _conns[client];
+                        watch(client, EPOLL_CTL_ADD, EPOLLIN);
+                    }
+                    continue;
+                }
+
+                auto it = _conns.find(fd);
+                if (it == _conns.end())
+                    continue;
+                Conn& conn = it->second;
+
+                if (events[i].events & EPOLLIN)
+                {
+                    char buffer[65536];
+                    ssize_t n;
+                    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                        conn.in.append(buffer, n);
+                    if (n == 0)
+                    {
+                        drop(fd);
+                        continue;
+                    }
+                    process(fd, conn);
+                    if (!_conns.count(fd))
+                        continue;
+                }
+
+                if (events[i].events & EPOLLOUT)
+                    flush(fd, conn);
+            }
+        }
+    }
+
+    int _listenFd;
+    int _epoll;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+    std::map<int, Conn> _conns;
+};